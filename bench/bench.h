@@ -0,0 +1,261 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreenode.h"
+#include "rtreeobject.h"
+
+/** The file given with --json, or null. Benchmarks that support it write JSON there. */
+extern const char *benchJsonPath;
+
+/** Set by benchmarks whose results disagree with a reference, to fail the run. */
+extern bool benchFailed;
+
+/** Clock used to time benchmarks. */
+typedef std::chrono::steady_clock BenchClock;
+
+/**
+ * Returns the number of nanoseconds elapsed since a point in time.
+ *
+ * @param start The point in time to measure from.
+ * @return The elapsed nanoseconds.
+ */
+inline double elapsedNs(BenchClock::time_point start) {
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+}
+
+/**
+ * Creates square objects at uniformly random positions.
+ *
+ * @param count The number of objects to create.
+ * @param width The width of the area to place the objects in.
+ * @param height The height of the area to place the objects in.
+ * @param size The side length of each object.
+ * @param seed The seed of the random number generator.
+ * @return The new objects.
+ */
+std::vector<std::shared_ptr<RTreeObject>> uniformObjects(size_t count,
+    float width, float height, float size, unsigned int seed);
+
+/**
+ * Creates uniformly random query centers.
+ *
+ * @param count The number of centers to create.
+ * @param width The width of the area to place the centers in.
+ * @param height The height of the area to place the centers in.
+ * @param seed The seed of the random number generator.
+ * @return The new centers.
+ */
+std::vector<Vec2> uniformPoints(size_t count, float width, float height,
+    unsigned int seed);
+
+/**
+ * Creates square objects in gaussian clusters around random points.
+ *
+ * @param count The number of objects to create.
+ * @param width The width of the area to place the clusters in.
+ * @param height The height of the area to place the clusters in.
+ * @param size The side length of each object.
+ * @param clusters The number of clusters.
+ * @param spread The standard deviation of the distance of an object from the
+ * center of its cluster along each axis.
+ * @param seed The seed of the random number generator.
+ * @return The new objects.
+ */
+std::vector<std::shared_ptr<RTreeObject>> clusteredObjects(size_t count,
+    float width, float height, float size, size_t clusters, float spread,
+    unsigned int seed);
+
+/**
+ * Creates square objects at uniformly random positions that move when their
+ * update() is called.
+ *
+ * The objects take their random velocities from rand(), which is seeded first
+ * so that the same seed gives the same motion.
+ *
+ * @param count The number of objects to create.
+ * @param width The width of the area to place the objects in.
+ * @param height The height of the area to place the objects in.
+ * @param size The side length of each object.
+ * @param seed The seed of the random number generators.
+ * @return The new objects.
+ */
+std::vector<std::shared_ptr<RTreeObject>> movingObjects(size_t count,
+    float width, float height, float size, unsigned int seed);
+
+/**
+ * Counts the nodes a rectangular search visits, that is the root and every
+ * inner node whose bounding box meets the search area.
+ *
+ * @param tree The tree being searched.
+ * @param n The root of the subtree to count.
+ * @param area The search area.
+ * @return The number of nodes visited.
+ */
+size_t countVisits(const RTree &tree, const RTreeNode &n, const Rect &area);
+
+/**
+ * Counts the nodes a circular search visits, that is the root and every inner
+ * node whose bounding box meets the circle.
+ *
+ * @param tree The tree being searched.
+ * @param n The root of the subtree to count.
+ * @param center The center of the circle.
+ * @param radius The radius of the circle.
+ * @return The number of nodes visited.
+ */
+size_t countVisits(const RTree &tree, const RTreeNode &n, const Vec2 center,
+    float radius);
+
+/**
+ * Finds the objects whose rects meet a circle by testing every object.
+ *
+ * @param objects The objects in the tree.
+ * @param center The center of the circle.
+ * @param radius The radius of the circle.
+ * @param res Cleared and filled with the objects found.
+ */
+void bruteSearch(const std::vector<std::shared_ptr<RTreeObject>> &objects,
+    const Vec2 center, float radius, std::vector<RTreeObject *> &res);
+
+/**
+ * Returns whether two searches found the same objects, in any order.
+ *
+ * @param found The objects found by one search.
+ * @param expected The objects found by the other.
+ * @return Whether the lists hold the same objects.
+ */
+bool sameObjects(std::vector<RTreeObject *> found, std::vector<RTreeObject *> expected);
+
+/**
+ * Checks that searches on a tree find the same objects as linear scans of
+ * the objects that should be in it.
+ *
+ * @param tree The tree to search.
+ * @param live The objects that should be in the tree.
+ * @param side The side length of the area holding the objects.
+ * @return Whether every search matched.
+ */
+bool verifyTree(const RTree &tree, const std::vector<std::shared_ptr<RTreeObject>> &live,
+    float side);
+
+/**
+ * Compares the SIMD child test in RTree::search against testing each child on
+ * its own, for fanouts from 4 to 32.
+ */
+void benchSimd();
+
+/**
+ * Compares RTree::overlappingPairs against querying the tree once per object.
+ */
+void benchPairs();
+
+/**
+ * Compares RTree::join between a static and a dynamic tree against querying
+ * the static tree once per dynamic object.
+ */
+void benchJoin();
+
+/**
+ * Times RTree::reconstruct with 1 to 8 build threads, checking searches on
+ * each tree against a linear scan.
+ */
+void benchBuild();
+
+/**
+ * Compares the frame times of RTree::update when rebuilds block the caller
+ * and when they run on a worker thread, checking searches against a linear
+ * scan every 10 frames.
+ */
+void benchRebuild();
+
+/**
+ * Compares trees grown by each insertion strategy and split policy, and a
+ * bulk-loaded tree, by build time and by the nodes each search visits. Every
+ * tree must find the same objects, and match a linear scan.
+ */
+void benchInsert();
+
+/**
+ * Compares Hilbert packing against Sort-Tile-Recursive by build time, rebuild
+ * time after small moves, and the nodes each search visits. Searches on every
+ * tree are checked against a linear scan.
+ */
+void benchHilbert();
+
+/**
+ * Compares fixed padding against velocity padding on a mix of fast and
+ * static objects by escape rate, false positive rate, and update and query
+ * time, checking each final tree against linear scans.
+ */
+void benchPadding();
+
+/**
+ * Compares keeping an RTree current with update() every frame against a
+ * TPR-tree that only changes when objects bounce, on objects moving in
+ * straight lines. Every TPR search is checked against a linear scan.
+ */
+void benchTPR();
+
+/**
+ * Times removing and moving objects by handle and by shared pointer, at
+ * several tree sizes, checking searches against a linear scan after each
+ * phase.
+ */
+void benchHandles();
+
+/**
+ * Compares update() against updateMany() when few objects move each frame,
+ * checking searches against a linear scan every 25 frames.
+ */
+void benchBatch();
+
+/**
+ * Compares searchBatch against one search per query when every object
+ * searches around itself, and checks every batch row against its search.
+ */
+void benchSearchBatch();
+
+/**
+ * Measures how searchBatch scales from one query thread to every core, and
+ * checks every batch against single searches.
+ */
+void benchQueryThreads();
+
+/**
+ * Compares readers sharing a tree behind a mutex against readers searching
+ * published snapshots while the writer updates it.
+ */
+void benchSnapshot();
+
+/**
+ * Compares the threshold rebuild policy against the adaptive one, with
+ * objects that jump far, which wears the tree down without reaching the
+ * rebuild threshold, and with objects that move a little, which escape past
+ * the threshold but are cheap to fix. Each final tree is checked against
+ * linear scans.
+ */
+void benchQuality();
+
+/**
+ * Runs insert, bulkInsert, search, update, reconstruct and remove on uniform,
+ * clustered and moving objects for a sweep of fanouts and buffer sizes. Every
+ * search is checked against a linear scan of the objects, and the results
+ * are written as JSON to benchJsonPath if it is set.
+ */
+void benchSuite();
+
+/**
+ * Compares RTree against RTreeFixed, whose fanout and dimensions are fixed
+ * at compile time, on 2D inserts, bulk loads and searches, and times
+ * RTreeFixed in 3D.
+ */
+void benchFixed();
+
+#endif
@@ -0,0 +1,97 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Runs frames in which a fraction of the objects move, and returns the mean
+ * time to bring the tree up to date.
+ *
+ * @param count The number of objects.
+ * @param fraction The fraction of objects moving each frame.
+ * @param batch Whether to report the moves with updateMany instead of update.
+ * @param verified Set to false if a search disagreed with a linear scan.
+ * @return The mean time per frame in milliseconds.
+ */
+static double runFrames(size_t count, float fraction, bool batch, bool &verified) {
+    const float width = 8192;
+    const float height = 8192;
+    const int frames = 100;
+    std::vector<std::shared_ptr<RTreeObject>> objects =
+        uniformObjects(count, width, height, 8, 61);
+    RTree tree(0, 0, width, height, 16, 6, 4);
+    tree.bulkInsert(objects);
+    std::vector<RTree::Handle> handles;
+    handles.reserve(count);
+    for (const std::shared_ptr<RTreeObject> &obj : objects) {
+        handles.push_back(tree.getHandle(obj));
+    }
+
+    std::mt19937 rng(67);
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    std::uniform_real_distribution<float> step(-6, 6);
+    size_t moving = static_cast<size_t>(count * fraction);
+    std::vector<std::pair<RTree::Handle, Rect>> moves;
+    std::vector<size_t> movers;
+    double total = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        moves.clear();
+        movers.clear();
+        for (size_t i = 0; i < moving; ++i) {
+            size_t index = pick(rng);
+            Rect rect = objects[index]->rect;
+            rect.origin.x += step(rng);
+            rect.origin.y += step(rng);
+            moves.emplace_back(handles[index], rect);
+            movers.push_back(index);
+        }
+
+        BenchClock::time_point start = BenchClock::now();
+        if (batch) {
+            tree.updateMany(moves);
+        } else {
+            for (size_t i = 0; i < moving; ++i) {
+                objects[movers[i]]->rect = moves[i].second;
+            }
+            tree.update();
+        }
+        total += elapsedNs(start);
+        if (frame % 25 == 24) {
+            verified = verifyTree(tree, objects, width) && verified;
+        }
+    }
+    return total / frames / 1e6;
+}
+
+/**
+ * Compares update() against updateMany() when few objects move each frame,
+ * checking searches against a linear scan every 25 frames.
+ */
+void benchBatch() {
+    std::printf("batch: 8x8 objects, a fraction moving up to 6 per frame, 100 frames\n");
+    std::printf("%8s %10s %12s %14s %6s\n", "objects", "moving", "update ms",
+                "updateMany ms", "ok");
+
+    size_t counts[] = {50000, 200000};
+    float fractions[] = {0.01f, 0.1f};
+    for (size_t count : counts) {
+        for (float fraction : fractions) {
+            bool verified = true;
+            double update = runFrames(count, fraction, false, verified);
+            double updateMany = runFrames(count, fraction, true, verified);
+            std::printf("%8zu %9.0f%% %12.3f %14.3f %6s\n", count, fraction * 100, update,
+                        updateMany, verified ? "yes" : "NO");
+            if (!verified) {
+                benchFailed = true;
+            }
+        }
+    }
+}
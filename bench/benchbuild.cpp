@@ -0,0 +1,54 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Times RTree::reconstruct with 1 to 8 build threads, checking searches on
+ * each tree against a linear scan.
+ */
+void benchBuild() {
+    const float width = 8192;
+    const float height = 8192;
+    const int repeats = 5;
+    std::printf("build: reconstruct of 8x8 objects, fanout 16, %u hardware threads\n",
+                std::thread::hardware_concurrency());
+    std::printf("%8s %8s %12s %8s %6s\n", "objects", "threads", "build ms", "speedup", "ok");
+
+    size_t counts[] = {100000, 400000};
+    unsigned int threadCounts[] = {1, 2, 4, 8};
+    for (size_t count : counts) {
+        std::vector<std::shared_ptr<RTreeObject>> objects =
+            uniformObjects(count, width, height, 8, 11);
+        RTree tree(0, 0, width, height, 16, 6, 4);
+        tree.bulkInsert(objects);
+
+        double serial = 0;
+        for (unsigned int threads : threadCounts) {
+            tree.setBuildThreads(threads);
+            tree.reconstruct();
+
+            BenchClock::time_point start = BenchClock::now();
+            for (int i = 0; i < repeats; ++i) {
+                tree.reconstruct();
+            }
+            double build = elapsedNs(start) / 1e6 / repeats;
+            if (threads == 1) {
+                serial = build;
+            }
+            bool verified = verifyTree(tree, objects, width);
+            std::printf("%8zu %8u %12.2f %7.2fx %6s\n", count, threads, build,
+                        serial / build, verified ? "yes" : "NO");
+            if (!verified) {
+                benchFailed = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,197 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreefixed.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Builds a 2D RTreeFixed over the objects by inserting them one at a time and
+ * by bulk loading them, times both and a batch of rect searches, and checks
+ * that every search finds as many objects as the runtime tree did.
+ *
+ * @param label The name of the configuration to print.
+ * @param objects The objects.
+ * @param queries The search rects.
+ * @param expected The number of objects found by each search.
+ */
+template <int MaxChildren, int MinChildren>
+static void runFixed2D(const char *label, const std::vector<std::shared_ptr<RTreeObject>> &objects,
+        const std::vector<Rect> &queries, const std::vector<size_t> &expected) {
+    typedef RTreeFixed<2, MaxChildren, MinChildren> Tree;
+    std::vector<std::pair<typename Tree::Box, RTreeObject *>> items;
+    for (const std::shared_ptr<RTreeObject> &obj : objects) {
+        items.emplace_back(toBox(obj->rect), obj.get());
+    }
+
+    Tree inserted;
+    BenchClock::time_point start = BenchClock::now();
+    for (const auto &item : items) {
+        inserted.insert(item.first, item.second);
+    }
+    double insertNs = elapsedNs(start);
+
+    Tree bulk;
+    start = BenchClock::now();
+    bulk.bulkLoad(items);
+    double bulkNs = elapsedNs(start);
+
+    Tree *trees[] = {&inserted, &bulk};
+    double searchNs[2];
+    for (int t = 0; t < 2; ++t) {
+        start = BenchClock::now();
+        size_t mismatches = 0;
+        for (size_t q = 0; q < queries.size(); ++q) {
+            size_t found = 0;
+            trees[t]->query(toBox(queries[q]), [&found](RTreeObject *) { ++found; });
+            mismatches += found != expected[q];
+        }
+        searchNs[t] = elapsedNs(start);
+        if (mismatches != 0) {
+            std::printf("  %s: %zu searches disagree with RTree\n", label, mismatches);
+            benchFailed = true;
+        }
+    }
+
+    std::printf("%-16s %6zu %10.2f %10.2f %12.2f %10.2f\n", label, Tree::nodeBytes(),
+                insertNs / 1e6, bulkNs / 1e6, searchNs[0] / 1e6, searchNs[1] / 1e6);
+}
+
+/**
+ * Times a 3D RTreeFixed, checking a sample of its searches against a linear
+ * scan.
+ */
+static void runFixed3D() {
+    typedef RTreeFixed<3, 16, 6, size_t> Tree;
+    const float world = 1024;
+    const size_t count = 100000;
+    const size_t queries = 10000;
+    std::mt19937 rng(71);
+    std::uniform_real_distribution<float> place(0, world - 8);
+
+    std::vector<std::pair<Tree::Box, size_t>> items;
+    for (size_t i = 0; i < count; ++i) {
+        Tree::Box box;
+        for (int d = 0; d < 3; ++d) {
+            box.min[d] = place(rng);
+            box.max[d] = box.min[d] + 8;
+        }
+        items.emplace_back(box, i);
+    }
+    std::vector<Tree::Box> areas;
+    for (size_t i = 0; i < queries; ++i) {
+        Tree::Box box;
+        for (int d = 0; d < 3; ++d) {
+            box.min[d] = place(rng);
+            box.max[d] = box.min[d] + 64;
+        }
+        areas.push_back(box);
+    }
+
+    Tree inserted;
+    BenchClock::time_point start = BenchClock::now();
+    for (const auto &item : items) {
+        inserted.insert(item.first, item.second);
+    }
+    double insertNs = elapsedNs(start);
+
+    Tree bulk;
+    start = BenchClock::now();
+    bulk.bulkLoad(items);
+    double bulkNs = elapsedNs(start);
+
+    Tree *trees[] = {&inserted, &bulk};
+    double searchNs[2];
+    std::vector<size_t> found[2];
+    for (int t = 0; t < 2; ++t) {
+        start = BenchClock::now();
+        for (const Tree::Box &area : areas) {
+            size_t hits = 0;
+            trees[t]->query(area, [&hits](size_t) { ++hits; });
+            found[t].push_back(hits);
+        }
+        searchNs[t] = elapsedNs(start);
+    }
+
+    size_t mismatches = 0;
+    for (size_t q = 0; q < queries; q += 100) {
+        size_t expected = 0;
+        for (const auto &item : items) {
+            expected += item.first.intersects(areas[q]);
+        }
+        mismatches += (found[0][q] != expected) + (found[1][q] != expected);
+    }
+    if (mismatches != 0) {
+        std::printf("  3D: %zu searches disagree with a linear scan\n", mismatches);
+        benchFailed = true;
+    }
+
+    std::printf("%-16s %6zu %10.2f %10.2f %12.2f %10.2f\n", "fixed 3D 16/6", Tree::nodeBytes(),
+                insertNs / 1e6, bulkNs / 1e6, searchNs[0] / 1e6, searchNs[1] / 1e6);
+}
+
+/**
+ * Compares RTree against RTreeFixed, whose fanout and dimensions are fixed
+ * at compile time, on 2D inserts, bulk loads and searches, and times
+ * RTreeFixed in 3D.
+ */
+void benchFixed() {
+    const float world = 4096;
+    const size_t count = 100000;
+    const size_t queries = 10000;
+    std::vector<std::shared_ptr<RTreeObject>> objects =
+        uniformObjects(count, world, world, 8, 73);
+    std::vector<Vec2> corners = uniformPoints(queries, world - 64, world - 64, 79);
+    std::vector<Rect> areas;
+    for (const Vec2 &c : corners) {
+        areas.push_back(Rect(c.x, c.y, 64, 64));
+    }
+
+    std::printf("fixed: 100k 8x8 objects, 10k 64x64 searches (ms)\n");
+    std::printf("%-16s %6s %10s %10s %12s %10s\n", "tree", "node B", "insert", "bulk",
+                "search/ins", "search/bulk");
+
+    // The runtime tree without padding, so both trees test exact rects
+    RTree inserted(0, 0, world, world, 16, 6, 0);
+    BenchClock::time_point start = BenchClock::now();
+    for (const std::shared_ptr<RTreeObject> &obj : objects) {
+        inserted.insert(obj);
+    }
+    double insertNs = elapsedNs(start);
+
+    RTree bulk(0, 0, world, world, 16, 6, 0);
+    start = BenchClock::now();
+    bulk.bulkInsert(objects);
+    double bulkNs = elapsedNs(start);
+
+    RTree *trees[] = {&inserted, &bulk};
+    double searchNs[2];
+    std::vector<size_t> expected[2];
+    for (int t = 0; t < 2; ++t) {
+        start = BenchClock::now();
+        for (const Rect &area : areas) {
+            size_t found = 0;
+            trees[t]->query(area, [&found](RTreeObject &) { ++found; });
+            expected[t].push_back(found);
+        }
+        searchNs[t] = elapsedNs(start);
+    }
+    if (expected[0] != expected[1]) {
+        std::printf("  RTree: inserted and bulk trees disagree\n");
+        benchFailed = true;
+    }
+    std::printf("%-16s %6s %10.2f %10.2f %12.2f %10.2f\n", "RTree 16/6", "-",
+                insertNs / 1e6, bulkNs / 1e6, searchNs[0] / 1e6, searchNs[1] / 1e6);
+
+    runFixed2D<8, 3>("fixed 2D 8/3", objects, areas, expected[0]);
+    runFixed2D<16, 6>("fixed 2D 16/6", objects, areas, expected[0]);
+    runFixed2D<32, 12>("fixed 2D 32/12", objects, areas, expected[0]);
+    runFixed3D();
+}
@@ -0,0 +1,79 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Times removing and moving objects by handle and by shared pointer, at
+ * several tree sizes. Both walk up from the leaf of the object, so the time
+ * per operation should grow with the height of the tree only. After each
+ * phase, searches are checked against a linear scan.
+ */
+void benchHandles() {
+    std::printf("handles: mean time per operation on 8x8 objects\n");
+    std::printf("%8s %14s %14s %12s %6s\n", "objects", "remove ptr ns", "remove hdl ns",
+                "move hdl ns", "ok");
+
+    const float width = 8192;
+    const float height = 8192;
+    size_t counts[] = {10000, 100000, 400000};
+    for (size_t count : counts) {
+        std::vector<std::shared_ptr<RTreeObject>> objects =
+            uniformObjects(count, width, height, 8, 53);
+        RTree tree(0, 0, width, height, 16, 6, 4);
+        std::vector<RTree::Handle> handles;
+        handles.reserve(count);
+        for (const std::shared_ptr<RTreeObject> &obj : objects) {
+            handles.push_back(tree.insert(obj));
+        }
+
+        // Take out a tenth of the objects each way, then put them back
+        size_t ops = count / 10;
+        BenchClock::time_point start = BenchClock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            tree.remove(objects[i]);
+        }
+        double removePtr = elapsedNs(start) / ops;
+        std::vector<std::shared_ptr<RTreeObject>> live(objects.begin() + ops, objects.end());
+        bool ok = verifyTree(tree, live, width);
+        for (size_t i = 0; i < ops; ++i) {
+            handles[i] = tree.insert(objects[i]);
+        }
+        ok = ok && verifyTree(tree, objects, width);
+
+        start = BenchClock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            tree.remove(handles[ops + i]);
+        }
+        double removeHandle = elapsedNs(start) / ops;
+        live.assign(objects.begin(), objects.begin() + ops);
+        live.insert(live.end(), objects.begin() + 2 * ops, objects.end());
+        ok = ok && verifyTree(tree, live, width);
+        for (size_t i = 0; i < ops; ++i) {
+            handles[ops + i] = tree.insert(objects[ops + i]);
+        }
+
+        std::mt19937 rng(59);
+        std::uniform_real_distribution<float> x(0, width - 8);
+        std::uniform_real_distribution<float> y(0, height - 8);
+        start = BenchClock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            tree.move(handles[i], Rect(x(rng), y(rng), 8, 8));
+        }
+        double moveHandle = elapsedNs(start) / ops;
+        ok = ok && verifyTree(tree, objects, width);
+
+        std::printf("%8zu %14.0f %14.0f %12.0f %6s\n", count, removePtr, removeHandle,
+                    moveHandle, ok ? "yes" : "NO");
+        if (!ok) {
+            benchFailed = true;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Bulk loads objects one way and prints the build time, the rebuild time
+ * after every object moved a little, and the time and nodes visited per
+ * search, then checks searches against a linear scan.
+ *
+ * @param layout The name of the object layout.
+ * @param loader The bulk loading algorithm.
+ * @param objects The objects to load. They are moved by the benchmark.
+ * @param queries The search areas.
+ */
+static void runLoader(const char *layout, RTree::BulkLoader loader,
+        const std::vector<std::shared_ptr<RTreeObject>> &objects,
+        const std::vector<Rect> &queries) {
+    RTree tree(0, 0, 8192, 8192, 16, 6, 4);
+    tree.setBulkLoader(loader);
+
+    BenchClock::time_point start = BenchClock::now();
+    tree.bulkInsert(objects);
+    double build = elapsedNs(start) / 1e6;
+
+    std::mt19937 rng(23);
+    std::uniform_real_distribution<float> step(-2, 2);
+    for (const std::shared_ptr<RTreeObject> &obj : objects) {
+        obj->rect.origin.x += step(rng);
+        obj->rect.origin.y += step(rng);
+    }
+    start = BenchClock::now();
+    tree.reconstruct();
+    double rebuild = elapsedNs(start) / 1e6;
+
+    size_t found = 0;
+    start = BenchClock::now();
+    for (const Rect &area : queries) {
+        tree.query(area, [&](RTreeObject &) { ++found; });
+    }
+    double search = elapsedNs(start) / 1e3 / queries.size();
+
+    size_t visits = 0;
+    for (const Rect &area : queries) {
+        visits += countVisits(tree, tree.getRoot(), area);
+    }
+
+    // Check circles anywhere, and a sample of the searches where the objects are
+    bool verified = verifyTree(tree, objects, 8192);
+    for (size_t q = 0; q < queries.size(); q += 20) {
+        size_t hits = 0;
+        tree.query(queries[q], [&hits](RTreeObject &) { ++hits; });
+        size_t expected = 0;
+        for (const std::shared_ptr<RTreeObject> &obj : objects) {
+            expected += obj->rect.doesIntersect(queries[q]);
+        }
+        verified = verified && hits == expected;
+    }
+    if (!verified) {
+        benchFailed = true;
+    }
+
+    std::printf("%10s %8zu %8s %10.2f %10.2f %10.2f %8.1f %9zu %6s\n", layout,
+                objects.size(), loader == RTree::BulkLoader::STR ? "str" : "hilbert",
+                build, rebuild, search, (double)visits / queries.size(), found,
+                verified ? "yes" : "NO");
+}
+
+/**
+ * Compares Hilbert packing against Sort-Tile-Recursive by build time, rebuild
+ * time after small moves, and the nodes each search visits. Searches on every
+ * tree are checked against a linear scan.
+ */
+void benchHilbert() {
+    std::printf("hilbert: 8x8 objects, fanout 16, 64x64 searches\n");
+    std::printf("%10s %8s %8s %10s %10s %10s %8s %9s %6s\n", "layout", "objects",
+                "loader", "build ms", "rebuild ms", "search us", "visits", "found", "ok");
+
+    size_t counts[] = {100000, 400000};
+    for (size_t count : counts) {
+        std::vector<std::shared_ptr<RTreeObject>> uniform =
+            uniformObjects(count, 8192, 8192, 8, 29);
+        std::vector<std::shared_ptr<RTreeObject>> clustered =
+            clusteredObjects(count, 8192, 8192, 8, 48, 120, 31);
+
+        // Search where the objects are, so clustered layouts are not mostly empty
+        std::vector<Rect> uniformQueries;
+        std::vector<Rect> clusteredQueries;
+        for (size_t i = 0; i < 2000; ++i) {
+            const Rect &u = uniform[i * 37 % count]->rect;
+            const Rect &c = clustered[i * 37 % count]->rect;
+            uniformQueries.push_back(Rect(u.getMidX() - 32, u.getMidY() - 32, 64, 64));
+            clusteredQueries.push_back(Rect(c.getMidX() - 32, c.getMidY() - 32, 64, 64));
+        }
+
+        runLoader("uniform", RTree::BulkLoader::STR, uniform, uniformQueries);
+        runLoader("uniform", RTree::BulkLoader::Hilbert, uniform, uniformQueries);
+        runLoader("clustered", RTree::BulkLoader::STR, clustered, clusteredQueries);
+        runLoader("clustered", RTree::BulkLoader::Hilbert, clustered, clusteredQueries);
+    }
+}
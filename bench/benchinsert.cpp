@@ -0,0 +1,106 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreenode.h"
+#include "rtreeobject.h"
+
+/**
+ * Builds a tree one way and prints the build time, the time and nodes
+ * visited per search, and whether searches match a linear scan.
+ *
+ * @param label The name of the way the tree is built.
+ * @param strategy The insertion algorithm, ignored when bulk loading.
+ * @param split The split algorithm, ignored when bulk loading.
+ * @param bulk Whether to bulk load instead of inserting one at a time.
+ * @param objects The objects to insert.
+ * @param queries The search areas.
+ * @return The number of objects found by all the searches.
+ */
+static size_t runInserts(const char *label, RTree::InsertStrategy strategy,
+        RTree::SplitPolicy split, bool bulk,
+        const std::vector<std::shared_ptr<RTreeObject>> &objects,
+        const std::vector<Rect> &queries) {
+    RTree tree(0, 0, 4096, 4096, 16, 6, 4);
+    tree.setInsertStrategy(strategy);
+    tree.setSplitPolicy(split);
+
+    BenchClock::time_point start = BenchClock::now();
+    if (bulk) {
+        tree.bulkInsert(objects);
+    } else {
+        for (const std::shared_ptr<RTreeObject> &obj : objects) {
+            tree.insert(obj);
+        }
+    }
+    double build = elapsedNs(start) / 1e6;
+
+    size_t found = 0;
+    start = BenchClock::now();
+    for (const Rect &area : queries) {
+        tree.query(area, [&](RTreeObject &) { ++found; });
+    }
+    double search = elapsedNs(start) / 1e3 / queries.size();
+
+    size_t visits = 0;
+    for (const Rect &area : queries) {
+        visits += countVisits(tree, tree.getRoot(), area);
+    }
+
+    bool verified = verifyTree(tree, objects, 4096);
+    std::printf("%8zu %16s %10.2f %12.2f %12.1f %10zu %6s\n", objects.size(), label,
+                build, search, (double)visits / queries.size(), found,
+                verified ? "yes" : "NO");
+    if (!verified) {
+        benchFailed = true;
+    }
+    return found;
+}
+
+/**
+ * Compares trees grown by each insertion strategy and split policy, and a
+ * bulk-loaded tree, by build time and by the nodes each search visits. Every
+ * tree must find the same objects, and match a linear scan.
+ */
+void benchInsert() {
+    std::printf("insert: 8x8 objects, fanout 16, 64x64 searches\n");
+    std::printf("%8s %16s %10s %12s %12s %10s %6s\n", "objects", "insert/split",
+                "build ms", "search us", "visits", "found", "ok");
+
+    std::vector<Vec2> centers = uniformPoints(2000, 4096, 4096, 21);
+    std::vector<Rect> queries;
+    for (const Vec2 &c : centers) {
+        queries.push_back(Rect(c.x - 32, c.y - 32, 64, 64));
+    }
+
+    size_t counts[] = {20000, 100000};
+    for (size_t count : counts) {
+        std::vector<std::shared_ptr<RTreeObject>> objects =
+            uniformObjects(count, 4096, 4096, 8, 19);
+        // Every way of building the tree must find the same objects
+        size_t found[] = {
+            runInserts("linear/linear", RTree::InsertStrategy::Linear,
+                       RTree::SplitPolicy::Linear, false, objects, queries),
+            runInserts("linear/quadratic", RTree::InsertStrategy::Linear,
+                       RTree::SplitPolicy::Quadratic, false, objects, queries),
+            runInserts("linear/rstar", RTree::InsertStrategy::Linear,
+                       RTree::SplitPolicy::RStar, false, objects, queries),
+            runInserts("rstar/rstar", RTree::InsertStrategy::RStar,
+                       RTree::SplitPolicy::RStar, false, objects, queries),
+            runInserts("bulk", RTree::InsertStrategy::Linear,
+                       RTree::SplitPolicy::Linear, true, objects, queries),
+        };
+        for (size_t f : found) {
+            if (f != found[0]) {
+                std::printf("  (found differs)\n");
+                benchFailed = true;
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Compares RTree::join between a static and a dynamic tree against querying
+ * the static tree once per dynamic object.
+ */
+void benchJoin() {
+    const float width = 4096;
+    const float height = 4096;
+    std::printf("join: 8x8 actors against 16x16 static objects\n");
+    std::printf("%8s %8s %8s %14s %14s %8s\n", "static", "actors", "pairs",
+                "per-object ms", "join ms", "speedup");
+
+    size_t staticCounts[] = {20000, 80000};
+    size_t actorCounts[] = {1000, 10000, 40000};
+    for (size_t staticCount : staticCounts) {
+        std::vector<std::shared_ptr<RTreeObject>> statics =
+            uniformObjects(staticCount, width, height, 16, 5);
+        RTree world(0, 0, width, height, 16, 6, 0);
+        world.bulkInsert(statics);
+
+        for (size_t actorCount : actorCounts) {
+            std::vector<std::shared_ptr<RTreeObject>> actors =
+                uniformObjects(actorCount, width, height, 8, 7);
+            RTree dynamic(0, 0, width, height, 8, 3, 4);
+            dynamic.bulkInsert(actors);
+
+            size_t perObjectPairs = 0;
+            BenchClock::time_point start = BenchClock::now();
+            for (const std::shared_ptr<RTreeObject> &actor : actors) {
+                world.query(actor->rect, [&](RTreeObject &) { ++perObjectPairs; });
+            }
+            double perObject = elapsedNs(start) / 1e6;
+
+            size_t joinPairs = 0;
+            start = BenchClock::now();
+            RTree::join(world, dynamic, [&](RTreeObject &, RTreeObject &) { ++joinPairs; });
+            double join = elapsedNs(start) / 1e6;
+
+            std::printf("%8zu %8zu %8zu %14.2f %14.2f %7.2fx%s\n", staticCount,
+                        actorCount, joinPairs, perObject, join, perObject / join,
+                        perObjectPairs == joinPairs ? "" : "  (pairs differ)");
+            if (perObjectPairs != joinPairs) {
+                benchFailed = true;
+            }
+        }
+    }
+}
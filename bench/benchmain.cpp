@@ -0,0 +1,74 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/** The file given with --json, or null. Benchmarks that support it write JSON there. */
+const char *benchJsonPath = nullptr;
+
+/** Set by benchmarks whose results disagree with a reference, to fail the run. */
+bool benchFailed = false;
+
+/** A benchmark that can be selected on the command line. */
+struct Benchmark {
+    /** The name used to select the benchmark. */
+    const char *name;
+    /** The function that runs the benchmark. */
+    void (*run)();
+};
+
+/** Every benchmark, in the order they run when none is selected. */
+static const Benchmark BENCHMARKS[] = {
+    {"simd", benchSimd},
+    {"pairs", benchPairs},
+    {"join", benchJoin},
+    {"build", benchBuild},
+    {"rebuild", benchRebuild},
+    {"insert", benchInsert},
+    {"hilbert", benchHilbert},
+    {"padding", benchPadding},
+    {"tpr", benchTPR},
+    {"handles", benchHandles},
+    {"batch", benchBatch},
+    {"searchbatch", benchSearchBatch},
+    {"querythreads", benchQueryThreads},
+    {"snapshot", benchSnapshot},
+    {"quality", benchQuality},
+    {"suite", benchSuite},
+    {"fixed", benchFixed},
+};
+
+/**
+ * Runs the benchmarks named on the command line, or all of them if none are
+ * named. "--json file" writes the results of the benchmarks that support it
+ * to a file.
+ */
+int main(int argc, char **argv) {
+    std::vector<const char *> names;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            benchJsonPath = argv[++i];
+        } else {
+            names.push_back(argv[i]);
+        }
+    }
+
+    bool ranAny = false;
+    for (const Benchmark &bench : BENCHMARKS) {
+        bool selected = names.empty();
+        for (const char *name : names) {
+            selected = selected || std::strcmp(name, bench.name) == 0;
+        }
+        if (selected) {
+            bench.run();
+            ranAny = true;
+        }
+    }
+
+    if (!ranAny) {
+        std::fprintf(stderr, "usage: %s [--json file] [benchmark...]\n", argv[0]);
+        return 1;
+    }
+    return benchFailed ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+#include "bench.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Runs frames in which a fifth of the objects move fast in a straight line
+ * and the rest stand still, then prints the escape and false positive rates
+ * and the mean update and query times, and checks the final tree.
+ *
+ * @param label The name of the padding to print.
+ * @param mode The padding mode of the tree.
+ * @param buffer The buffer size used by fixed padding.
+ */
+static void runFrames(const char *label, RTree::PaddingMode mode, float buffer) {
+    const float width = 8192;
+    const float height = 8192;
+    const size_t count = 50000;
+    const int frames = 120;
+    const int queries = 200;
+    std::vector<std::shared_ptr<RTreeObject>> objects =
+        uniformObjects(count, width, height, 8, 29);
+    std::vector<Vec2> centers = uniformPoints(queries, width, height, 31);
+
+    std::mt19937 rng(37);
+    std::uniform_real_distribution<float> angle(0, 6.2831853f);
+    std::uniform_real_distribution<float> speed(4, 10);
+    std::vector<Vec2> velocity(count);
+    for (size_t i = 0; i < count; i += 5) {
+        float a = angle(rng);
+        float s = speed(rng);
+        velocity[i] = Vec2(std::cos(a) * s, std::sin(a) * s);
+    }
+
+    RTree tree(0, 0, width, height, 16, 6, buffer);
+    tree.setPaddingMode(mode);
+    tree.setRebuildThreshold(1.0f);
+    tree.bulkInsert(objects);
+    tree.resetPaddingStats();
+
+    double updateNs = 0;
+    double queryNs = 0;
+    size_t found = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        for (size_t i = 0; i < count; ++i) {
+            Rect &rect = objects[i]->rect;
+            rect.origin = rect.origin + velocity[i];
+            // Bounce off the edges so that moving objects stay in the world
+            if (rect.origin.x < 0 || rect.origin.x > width - 8) {
+                velocity[i].x = -velocity[i].x;
+            }
+            if (rect.origin.y < 0 || rect.origin.y > height - 8) {
+                velocity[i].y = -velocity[i].y;
+            }
+        }
+
+        BenchClock::time_point start = BenchClock::now();
+        tree.update();
+        updateNs += elapsedNs(start);
+
+        start = BenchClock::now();
+        for (const Vec2 &center : centers) {
+            found += tree.search(Rect(center.x - 64, center.y - 64, 128, 128)).size();
+        }
+        queryNs += elapsedNs(start);
+    }
+
+    RTree::PaddingStats stats = tree.getPaddingStats();
+    bool verified = verifyTree(tree, objects, width);
+    std::printf("%10s %10.4f %10.4f %10.2f %10.3f %10zu %4s\n", label,
+                stats.escapeRate(), stats.falsePositiveRate(),
+                updateNs / frames / 1e6, queryNs / frames / 1e6, found / frames,
+                verified ? "yes" : "NO");
+    if (!verified) {
+        benchFailed = true;
+    }
+}
+
+/**
+ * Compares fixed padding against velocity padding on a mix of fast and
+ * static objects by escape rate, false positive rate, and update and query
+ * time, checking each final tree against linear scans.
+ */
+void benchPadding() {
+    std::printf("padding: 50000 8x8 objects, a fifth moving 4-10 per frame, 120 frames\n");
+    std::printf("%10s %10s %10s %10s %10s %10s %4s\n", "padding", "escapes", "false pos",
+                "update ms", "query ms", "found", "ok");
+
+    runFrames("fixed 4", RTree::PaddingMode::Fixed, 4);
+    runFrames("fixed 16", RTree::PaddingMode::Fixed, 16);
+    runFrames("velocity", RTree::PaddingMode::Velocity, 4);
+}
@@ -0,0 +1,52 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Compares RTree::overlappingPairs against querying the tree once per object.
+ */
+void benchPairs() {
+    const float width = 4096;
+    const float height = 4096;
+    std::printf("pairs: overlapping pairs of 8x8 objects\n");
+    std::printf("%8s %8s %14s %14s %8s\n", "objects", "pairs",
+                "per-object ms", "self-join ms", "speedup");
+
+    size_t counts[] = {5000, 20000, 80000};
+    for (size_t count : counts) {
+        std::vector<std::shared_ptr<RTreeObject>> objects =
+            uniformObjects(count, width, height, 8, 3);
+        RTree tree(0, 0, width, height, 8, 3, 4);
+        tree.bulkInsert(objects);
+
+        // Each pair is found from both of its objects, so keep one of them
+        size_t perObjectPairs = 0;
+        BenchClock::time_point start = BenchClock::now();
+        for (const std::shared_ptr<RTreeObject> &obj : objects) {
+            const RTreeObject *self = obj.get();
+            tree.query(obj->rect, [&](RTreeObject &other) {
+                perObjectPairs += self < &other;
+            });
+        }
+        double perObject = elapsedNs(start) / 1e6;
+
+        size_t joinPairs = 0;
+        start = BenchClock::now();
+        tree.overlappingPairs([&](RTreeObject &, RTreeObject &) { ++joinPairs; });
+        double join = elapsedNs(start) / 1e6;
+
+        std::printf("%8zu %8zu %14.2f %14.2f %7.2fx%s\n", count, joinPairs,
+                    perObject, join, perObject / join,
+                    perObjectPairs == joinPairs ? "" : "  (pairs differ)");
+        if (perObjectPairs != joinPairs) {
+            benchFailed = true;
+        }
+    }
+}
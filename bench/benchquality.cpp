@@ -0,0 +1,94 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Runs frames in which some objects move and many searches are made, then
+ * prints the mean update and search times and the final shape of the tree,
+ * and checks the final tree against linear scans.
+ *
+ * @param label The name of the policy to print.
+ * @param policy The rebuild policy of the tree.
+ * @param fraction The fraction of the objects that move each frame.
+ * @param jump Whether the objects jump anywhere instead of a few units.
+ */
+static void runPolicy(const char *label, RTree::RebuildPolicy policy, float fraction,
+        bool jump) {
+    const float world = 8192;
+    const size_t count = 100000;
+    const int frames = 300;
+    const size_t queries = 2000;
+    std::vector<std::shared_ptr<RTreeObject>> objects =
+        uniformObjects(count, world, world, 8, 59);
+    std::vector<Vec2> centers = uniformPoints(queries, world, world, 61);
+
+    RTree tree(0, 0, world, world, 16, 6, 4);
+    tree.setRebuildPolicy(policy);
+    tree.bulkInsert(objects);
+
+    std::mt19937 rng(67);
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    std::uniform_real_distribution<float> place(0, world - 8);
+    std::uniform_real_distribution<float> step(-6, 6);
+    size_t moves = (size_t)(count * fraction);
+    double updateNs = 0;
+    double searchNs = 0;
+    size_t found = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        for (size_t i = 0; i < moves; ++i) {
+            Vec2 &origin = objects[pick(rng)]->rect.origin;
+            origin = jump ? Vec2(place(rng), place(rng)) : origin + Vec2(step(rng), step(rng));
+        }
+        BenchClock::time_point start = BenchClock::now();
+        tree.update();
+        updateNs += elapsedNs(start);
+
+        start = BenchClock::now();
+        for (const Vec2 &c : centers) {
+            tree.query(RTreeCircle(c, 32), [&found](RTreeObject &) { ++found; });
+        }
+        searchNs += elapsedNs(start);
+    }
+
+    RTree::Quality quality = tree.quality();
+    bool verified = verifyTree(tree, objects, world);
+    std::printf("%6s %6.1f%% %10s %10.2f %10.2f %12.2f %8.3f %6.2f %4s\n",
+                jump ? "jump" : "jitter", fraction * 100, label,
+                updateNs / 1e6 / frames, searchNs / 1e6 / frames,
+                (updateNs + searchNs) / 1e6 / frames, quality.overlapRatio(), quality.fill,
+                verified ? "yes" : "NO");
+    if (!verified) {
+        benchFailed = true;
+    }
+}
+
+/**
+ * Compares the threshold rebuild policy against the adaptive one, with
+ * objects that jump far, which wears the tree down without reaching the
+ * rebuild threshold, and with objects that move a little, which escape past
+ * the threshold but are cheap to fix. Each final tree is checked against
+ * linear scans.
+ */
+void benchQuality() {
+    std::printf("quality: 100k 8x8 objects, buffer 4, fanout 16, 300 frames of 2000 searches\n");
+    std::printf("%6s %7s %10s %10s %10s %12s %8s %6s %4s\n", "moves", "moving", "policy",
+                "update ms", "search ms", "frame ms", "overlap", "fill", "ok");
+    float jumps[] = {0.02f, 0.1f};
+    for (float fraction : jumps) {
+        runPolicy("threshold", RTree::RebuildPolicy::Threshold, fraction, true);
+        runPolicy("adaptive", RTree::RebuildPolicy::Adaptive, fraction, true);
+    }
+    float jitters[] = {0.6f, 1.0f};
+    for (float fraction : jitters) {
+        runPolicy("threshold", RTree::RebuildPolicy::Threshold, fraction, false);
+        runPolicy("adaptive", RTree::RebuildPolicy::Adaptive, fraction, false);
+    }
+}
@@ -0,0 +1,89 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Measures how searchBatch scales from one query thread to every core, and
+ * checks every batch against single searches.
+ */
+void benchQueryThreads() {
+    const size_t count = 400000;
+    const float radius = 32;
+    const int rounds = 5;
+    float side = 16 * std::sqrt((float)count);
+    std::vector<std::shared_ptr<RTreeObject>> objects =
+        uniformObjects(count, side, side, 4, 73);
+    RTree tree(0, 0, side, side, 16, 6, 2);
+    tree.bulkInsert(objects);
+
+    // Every tenth query is wide, so packets cost unevenly and stealing matters
+    std::vector<RTree::Query> queries(count);
+    for (size_t i = 0; i < count; ++i) {
+        queries[i].center = Vec2(objects[i]->rect.getMidX(), objects[i]->rect.getMidY());
+        queries[i].radius = i % 10 == 0 ? 4 * radius : radius;
+    }
+
+    // The batch is checked against single searches, and a sample of those
+    // against a linear scan
+    std::vector<std::vector<RTreeObject *>> expected(count);
+    std::vector<RTreeObject *> scanned;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i) {
+        tree.query(RTreeCircle(queries[i].center, queries[i].radius), expected[i]);
+        if (i % 4000 == 0) {
+            bruteSearch(objects, queries[i].center, queries[i].radius, scanned);
+            mismatches += !sameObjects(expected[i], scanned);
+        }
+    }
+    if (mismatches != 0) {
+        std::printf("  %zu searches disagree with a linear scan\n", mismatches);
+        benchFailed = true;
+    }
+
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::printf("querythreads: %zu objects, one query around each, best of %d rounds\n",
+                count, rounds);
+    std::printf("%8s %12s %10s %8s %6s\n", "threads", "batch ms", "speedup", "hits", "ok");
+
+    // Powers of two below the number of cores, then every core
+    std::vector<unsigned int> counts;
+    for (unsigned int threads = 1; threads < cores; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(cores);
+
+    RTree::BatchResults results;
+    double single = 0;
+    for (unsigned int threads : counts) {
+        tree.setQueryThreads(threads);
+        double best = 0;
+        for (int round = 0; round < rounds; ++round) {
+            BenchClock::time_point start = BenchClock::now();
+            tree.searchBatch(queries, results);
+            double ms = elapsedNs(start) / 1e6;
+            best = round == 0 ? ms : std::min(best, ms);
+        }
+        single = threads == 1 ? best : single;
+
+        size_t wrong = results.size() == count ? 0 : count;
+        for (size_t i = 0; wrong == 0 && i < count; ++i) {
+            std::vector<RTreeObject *> row(results.begin(i), results.begin(i) + results.count(i));
+            wrong += !sameObjects(row, expected[i]);
+        }
+        std::printf("%8u %12.2f %9.2fx %8zu %6s\n", threads, best, single / best,
+                    results.objects.size(), wrong == 0 ? "yes" : "NO");
+        if (wrong != 0) {
+            benchFailed = true;
+        }
+    }
+}
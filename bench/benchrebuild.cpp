@@ -0,0 +1,84 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Runs frames in which every object moves, and returns the mean and worst
+ * time of RTree::update.
+ *
+ * @param background Whether the tree rebuilds on a worker thread.
+ * @param count The number of objects.
+ * @param mean Set to the mean update time in milliseconds.
+ * @param worst Set to the worst update time in milliseconds.
+ * @param verified Set to false if a search disagreed with a linear scan.
+ */
+static void runFrames(bool background, size_t count, double &mean, double &worst,
+        bool &verified) {
+    const float width = 8192;
+    const float height = 8192;
+    const int frames = 120;
+    std::vector<std::shared_ptr<RTreeObject>> objects =
+        uniformObjects(count, width, height, 8, 13);
+    RTree tree(0, 0, width, height, 16, 6, 4);
+    tree.setBackgroundRebuild(background);
+    tree.bulkInsert(objects);
+
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<float> step(-3, 3);
+    double total = 0;
+    worst = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        for (const std::shared_ptr<RTreeObject> &obj : objects) {
+            obj->rect.origin.x += step(rng);
+            obj->rect.origin.y += step(rng);
+        }
+
+        BenchClock::time_point start = BenchClock::now();
+        tree.update();
+        double ms = elapsedNs(start) / 1e6;
+        total += ms;
+        worst = std::max(worst, ms);
+
+        // Check the tree while rebuilds are pending and after they are swapped in
+        if (frame % 10 == 9) {
+            verified = verifyTree(tree, objects, width) && verified;
+        }
+    }
+    mean = total / frames;
+}
+
+/**
+ * Compares the frame times of RTree::update when rebuilds block the caller
+ * and when they run on a worker thread, checking searches against a linear
+ * scan every 10 frames.
+ */
+void benchRebuild() {
+    std::printf("rebuild: update() of drifting 8x8 objects over 120 frames\n");
+    std::printf("%8s %12s %10s %10s %6s\n", "objects", "rebuild", "mean ms", "worst ms",
+                "ok");
+
+    size_t counts[] = {50000, 200000};
+    for (size_t count : counts) {
+        for (int background = 0; background < 2; ++background) {
+            double mean;
+            double worst;
+            bool verified = true;
+            runFrames(background == 1, count, mean, worst, verified);
+            std::printf("%8zu %12s %10.2f %10.2f %6s\n", count,
+                        background == 1 ? "background" : "blocking", mean, worst,
+                        verified ? "yes" : "NO");
+            if (!verified) {
+                benchFailed = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Compares searchBatch against one search per query when every object
+ * searches around itself, as agents looking for their neighbors do, and
+ * checks every batch row against its search.
+ */
+void benchSearchBatch() {
+    const float radius = 32;
+    const int rounds = 5;
+    std::printf("searchbatch: one query of radius %.0f around each 4x4 object, "
+                "best of %d rounds\n", radius, rounds);
+    std::printf("%8s %14s %14s %14s %8s %4s\n", "objects", "search ns/op",
+                "query ns/op", "batch ns/op", "speedup", "ok");
+
+    size_t counts[] = {10000, 100000, 400000};
+    for (size_t count : counts) {
+        // Keep the density fixed so each query finds about the same number of objects
+        float side = 16 * std::sqrt((float)count);
+        std::vector<std::shared_ptr<RTreeObject>> objects =
+            uniformObjects(count, side, side, 4, 71);
+        RTree tree(0, 0, side, side, 16, 6, 2);
+        tree.bulkInsert(objects);
+
+        std::vector<RTree::Query> queries(count);
+        for (size_t i = 0; i < count; ++i) {
+            queries[i].center = Vec2(objects[i]->rect.getMidX(), objects[i]->rect.getMidY());
+            queries[i].radius = radius;
+        }
+
+        double searchNs = 0;
+        double queryNs = 0;
+        double batchNs = 0;
+        size_t searchHits = 0;
+        size_t queryHits = 0;
+        size_t batchHits = 0;
+        std::vector<RTreeObject *> found;
+        RTree::BatchResults results;
+        for (int round = 0; round < rounds; ++round) {
+            searchHits = 0;
+            BenchClock::time_point start = BenchClock::now();
+            for (const RTree::Query &q : queries) {
+                searchHits += tree.search(q.center, q.radius).size();
+            }
+            double ns = elapsedNs(start) / count;
+            searchNs = round == 0 ? ns : std::min(searchNs, ns);
+
+            queryHits = 0;
+            start = BenchClock::now();
+            for (const RTree::Query &q : queries) {
+                found.clear();
+                tree.query(RTreeCircle(q.center, q.radius), found);
+                queryHits += found.size();
+            }
+            ns = elapsedNs(start) / count;
+            queryNs = round == 0 ? ns : std::min(queryNs, ns);
+
+            start = BenchClock::now();
+            tree.searchBatch(queries, results);
+            ns = elapsedNs(start) / count;
+            batchNs = round == 0 ? ns : std::min(batchNs, ns);
+            batchHits = results.objects.size();
+        }
+
+        // Check every batch row against its own search, outside the timed loops
+        bool same = searchHits == queryHits && searchHits == batchHits &&
+                    results.size() == count;
+        for (size_t i = 0; same && i < count; ++i) {
+            std::vector<RTreeObject *> row(results.begin(i), results.end(i));
+            found.clear();
+            tree.query(RTreeCircle(queries[i].center, queries[i].radius), found);
+            same = sameObjects(row, found);
+        }
+        std::printf("%8zu %14.1f %14.1f %14.1f %7.2fx %4s\n", count, searchNs,
+                    queryNs, batchNs, searchNs / batchNs, same ? "yes" : "NO");
+        if (!same) {
+            benchFailed = true;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Runs every query against a tree and returns the average time per query.
+ *
+ * @param tree The tree to search.
+ * @param centers The centers of the queries.
+ * @param radius The radius of the queries.
+ * @param hits Set to the total number of objects found.
+ * @return The average nanoseconds per query.
+ */
+static double timeQueries(RTree &tree, const std::vector<Vec2> &centers,
+        float radius, size_t &hits) {
+    hits = 0;
+    BenchClock::time_point start = BenchClock::now();
+    for (const Vec2 &center : centers) {
+        hits += tree.search(center, radius).size();
+    }
+    return elapsedNs(start) / centers.size();
+}
+
+/**
+ * Compares the SIMD child test in RTree::search against testing each child on
+ * its own, for fanouts from 4 to 32.
+ */
+void benchSimd() {
+    const float width = 4096;
+    const float height = 4096;
+    const float radius = 48;
+    std::vector<std::shared_ptr<RTreeObject>> objects =
+        uniformObjects(50000, width, height, 4, 1);
+    std::vector<Vec2> centers = uniformPoints(20000, width, height, 2);
+
+    std::printf("simd: %zu objects, %zu queries of radius %.0f\n",
+                objects.size(), centers.size(), radius);
+    std::printf("%8s %14s %14s %8s\n", "fanout", "scalar ns/op", "simd ns/op", "speedup");
+    unsigned int fanouts[] = {4, 8, 12, 16, 24, 32};
+    for (unsigned int fanout : fanouts) {
+        RTree tree(0, 0, width, height, fanout, fanout / 2, 2);
+        tree.bulkInsert(objects);
+
+        size_t scalarHits;
+        size_t simdHits;
+        tree.setSimdQueries(false);
+        double scalar = timeQueries(tree, centers, radius, scalarHits);
+        tree.setSimdQueries(true);
+        double simd = timeQueries(tree, centers, radius, simdHits);
+
+        std::printf("%8u %14.1f %14.1f %7.2fx%s\n", fanout, scalar, simd,
+                    scalar / simd, scalarHits == simdHits ? "" : "  (hits differ)");
+        if (scalarHits != simdHits) {
+            benchFailed = true;
+        }
+    }
+}
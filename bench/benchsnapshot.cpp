@@ -0,0 +1,178 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Checks searches of the snapshot the writer just published against linear
+ * scans of the objects as they were published.
+ *
+ * A snapshot searches padded bounding boxes, so it must find every object
+ * whose rect meets the circle. A box is as wide as the padding on both sides
+ * of its rect and still holds it, so nothing farther than twice the padding
+ * from the circle may be found.
+ *
+ * @param tree The tree, whose snapshot is current.
+ * @param objects The objects in the tree.
+ * @param padding The padding on each side of each bounding box.
+ * @param rng The random number generator to pick the circles with.
+ * @return The number of searches that found the wrong objects.
+ */
+static size_t checkSnapshot(const RTree &tree,
+        const std::vector<std::shared_ptr<RTreeObject>> &objects, float padding,
+        std::mt19937 &rng) {
+    const float side = 8192;
+    const float radius = 64;
+    std::uniform_real_distribution<float> pos(0, side);
+    RTreeReadGuard snapshot = tree.read();
+    std::vector<RTreeObject *> found;
+    std::vector<RTreeObject *> exact;
+    size_t mismatches = 0;
+    for (int i = 0; i < 20; ++i) {
+        Vec2 center(pos(rng), pos(rng));
+        found.clear();
+        snapshot->search(center, radius, found);
+        bruteSearch(objects, center, radius, exact);
+        std::sort(found.begin(), found.end());
+        std::sort(exact.begin(), exact.end());
+
+        bool ok = std::adjacent_find(found.begin(), found.end()) == found.end() &&
+                  std::includes(found.begin(), found.end(), exact.begin(), exact.end());
+        for (RTreeObject *obj : found) {
+            const Rect &r = obj->rect;
+            Rect reach(r.origin.x - 2 * padding, r.origin.y - 2 * padding,
+                       r.size.width + 4 * padding, r.size.height + 4 * padding);
+            ok = ok && reach.doesIntersect(center, radius);
+        }
+        mismatches += !ok;
+    }
+    return mismatches;
+}
+
+/**
+ * Runs frames in which a fraction of the objects move, with reader threads
+ * searching meanwhile, and returns the mean time the writer spends per frame.
+ *
+ * @param count The number of objects.
+ * @param readers The number of reader threads.
+ * @param snapshots Whether readers search published snapshots instead of
+ * sharing the tree behind a mutex.
+ * @param searches Set to the number of searches the readers made per frame.
+ * @param mismatches Incremented by the number of snapshot searches that
+ * disagreed with a linear scan.
+ * @return The mean time per frame in milliseconds.
+ */
+static double runFrames(size_t count, unsigned int readers, bool snapshots,
+        double &searches, size_t &mismatches) {
+    const float side = 8192;
+    const int frames = 100;
+    std::vector<std::shared_ptr<RTreeObject>> objects =
+        uniformObjects(count, side, side, 8, 79);
+    RTree tree(0, 0, side, side, 16, 6, 4);
+    tree.bulkInsert(objects);
+    std::vector<RTree::Handle> handles;
+    for (const std::shared_ptr<RTreeObject> &obj : objects) {
+        handles.push_back(tree.getHandle(obj));
+    }
+    tree.publish();
+
+    std::mutex lock;
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> done(0);
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < readers; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(83 + t);
+            std::uniform_real_distribution<float> pos(0, side);
+            std::vector<RTreeObject *> found;
+            while (!stop.load(std::memory_order_relaxed)) {
+                found.clear();
+                Vec2 center(pos(rng), pos(rng));
+                if (snapshots) {
+                    RTreeReadGuard snapshot = tree.read();
+                    snapshot->search(center, 64, found);
+                } else {
+                    std::lock_guard<std::mutex> guard(lock);
+                    tree.query(RTreeCircle(center, 64), found);
+                }
+                done.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    std::mt19937 rng(89);
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    std::uniform_real_distribution<float> step(-6, 6);
+    std::vector<std::pair<RTree::Handle, Rect>> moves;
+    double total = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        moves.clear();
+        for (size_t i = 0; i < count / 100; ++i) {
+            size_t index = pick(rng);
+            Rect rect = objects[index]->rect;
+            rect.origin.x += step(rng);
+            rect.origin.y += step(rng);
+            moves.emplace_back(handles[index], rect);
+        }
+
+        BenchClock::time_point start = BenchClock::now();
+        if (snapshots) {
+            tree.updateMany(moves);
+            tree.publish();
+        } else {
+            std::lock_guard<std::mutex> guard(lock);
+            tree.updateMany(moves);
+        }
+        total += elapsedNs(start);
+        if (snapshots && frame % 10 == 0) {
+            mismatches += checkSnapshot(tree, objects, 4, rng);
+        }
+        std::this_thread::yield();
+    }
+
+    stop = true;
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    searches = (double)done / frames;
+    return total / frames / 1e6;
+}
+
+/**
+ * Compares readers sharing a tree behind a mutex against readers searching
+ * published snapshots while the writer updates it.
+ */
+void benchSnapshot() {
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned int readers = std::max(cores, 2u) - 1;
+    std::printf("snapshot: 1%% of 8x8 objects moving per frame, %u reader threads, "
+                "100 frames\n", readers);
+    std::printf("%8s %10s %14s %16s\n", "objects", "readers", "writer ms", "searches/frame");
+
+    size_t counts[] = {50000, 200000};
+    size_t mismatches = 0;
+    for (size_t count : counts) {
+        for (int mode = 0; mode < 2; ++mode) {
+            double searches;
+            double ms = runFrames(count, readers, mode == 1, searches, mismatches);
+            std::printf("%8zu %10s %14.3f %16.0f\n", count, mode == 1 ? "snapshot" : "mutex",
+                        ms, searches);
+        }
+    }
+    if (mismatches != 0) {
+        std::printf("  %zu snapshot searches disagree with a linear scan\n", mismatches);
+        benchFailed = true;
+    }
+}
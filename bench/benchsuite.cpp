@@ -0,0 +1,297 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/** The measurements of one operation in one configuration of the suite. */
+struct SuiteResult {
+    /** The name of the workload. */
+    const char *workload;
+    /** The maximum number of children per node. */
+    unsigned int fanout;
+    /** The padding on each side of each bounding box. */
+    float buffer;
+    /** The name of the operation. */
+    const char *op;
+    /** The number of times the operation was timed. */
+    size_t ops;
+    /** The mean nanoseconds per operation. */
+    double ns;
+    /** The mean nodes visited per search, or -1 if not a search. */
+    double visits;
+    /** The mean nanoseconds per linear scan, or -1 if not a search. */
+    double bruteNs;
+    /** Whether every search after the operation matched the linear scan. */
+    bool verified;
+};
+
+/** The side length of the square world. */
+static const float SUITE_WORLD = 4096;
+/** The side length of each object. */
+static const float SUITE_SIZE = 8;
+/** The radius of each search. */
+static const float SUITE_RADIUS = 32;
+/** The number of frames of movement timed by update. */
+static const int SUITE_FRAMES = 20;
+
+/**
+ * Times the searches on a tree and on a linear scan of its objects, and
+ * checks that each search finds the same objects as the scan.
+ *
+ * @param tree The tree to search.
+ * @param objects The objects in the tree.
+ * @param centers The centers of the searches.
+ * @param result Filled with the time per search, the nodes visited, the time
+ * per scan and whether every search matched.
+ */
+static void timeSearches(const RTree &tree,
+        const std::vector<std::shared_ptr<RTreeObject>> &objects,
+        const std::vector<Vec2> &centers, SuiteResult &result) {
+    std::vector<std::vector<RTreeObject *>> found(centers.size());
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i = 0; i < centers.size(); ++i) {
+        for (const std::shared_ptr<RTreeObject> &obj : tree.search(centers[i], SUITE_RADIUS)) {
+            found[i].push_back(obj.get());
+        }
+    }
+    result.ns = elapsedNs(start) / centers.size();
+    result.ops = centers.size();
+
+    std::vector<std::vector<RTreeObject *>> expected(centers.size());
+    start = BenchClock::now();
+    for (size_t i = 0; i < centers.size(); ++i) {
+        bruteSearch(objects, centers[i], SUITE_RADIUS, expected[i]);
+    }
+    result.bruteNs = elapsedNs(start) / centers.size();
+
+    size_t visits = 0;
+    result.verified = true;
+    for (size_t i = 0; i < centers.size(); ++i) {
+        visits += countVisits(tree, tree.getRoot(), centers[i], SUITE_RADIUS);
+        result.verified = result.verified && sameObjects(found[i], expected[i]);
+    }
+    result.visits = (double)visits / centers.size();
+}
+
+/**
+ * Checks that every search on a tree finds the same objects as a linear scan
+ * of its objects.
+ *
+ * @param tree The tree to search.
+ * @param objects The objects in the tree.
+ * @param centers The centers of the searches.
+ * @return Whether every search matched.
+ */
+static bool verifySearches(const RTree &tree,
+        const std::vector<std::shared_ptr<RTreeObject>> &objects,
+        const std::vector<Vec2> &centers) {
+    SuiteResult result = {};
+    timeSearches(tree, objects, centers, result);
+    return result.verified;
+}
+
+/**
+ * Runs every operation of the suite on one workload with one fanout and
+ * buffer size.
+ *
+ * @param workload The name of the workload.
+ * @param moving Whether the objects move between frames.
+ * @param source The objects, which are moved in place if moving.
+ * @param fanout The maximum number of children per node.
+ * @param buffer The padding on each side of each bounding box.
+ * @param centers The centers of the searches.
+ * @param results The list to append the measurements to.
+ */
+static void runSuiteCase(const char *workload, bool moving,
+        const std::vector<std::shared_ptr<RTreeObject>> &source, unsigned int fanout,
+        float buffer, const std::vector<Vec2> &centers,
+        std::vector<SuiteResult> &results) {
+    // Each case starts from the same positions, so copy the moving objects
+    std::vector<std::shared_ptr<RTreeObject>> objects;
+    objects.reserve(source.size());
+    for (const std::shared_ptr<RTreeObject> &obj : source) {
+        objects.push_back(moving ? std::make_shared<RTreeObject>(*obj) : obj);
+    }
+    unsigned int minChildren = std::max(2u, fanout * 2 / 5);
+    SuiteResult base = {workload, fanout, buffer, "", 0, 0, -1, -1, true};
+
+    RTree inserted(0, 0, SUITE_WORLD, SUITE_WORLD, fanout, minChildren, buffer);
+    SuiteResult insert = base;
+    insert.op = "insert";
+    BenchClock::time_point start = BenchClock::now();
+    for (const std::shared_ptr<RTreeObject> &obj : objects) {
+        inserted.insert(obj);
+    }
+    insert.ops = objects.size();
+    insert.ns = elapsedNs(start) / insert.ops;
+    results.push_back(insert);
+
+    SuiteResult searchInserted = base;
+    searchInserted.op = "search/inserted";
+    timeSearches(inserted, objects, centers, searchInserted);
+    results.push_back(searchInserted);
+
+    RTree tree(0, 0, SUITE_WORLD, SUITE_WORLD, fanout, minChildren, buffer);
+    SuiteResult bulk = base;
+    bulk.op = "bulkInsert";
+    start = BenchClock::now();
+    tree.bulkInsert(objects);
+    bulk.ops = objects.size();
+    bulk.ns = elapsedNs(start) / bulk.ops;
+    results.push_back(bulk);
+
+    SuiteResult searchBulk = base;
+    searchBulk.op = "search/bulk";
+    timeSearches(tree, objects, centers, searchBulk);
+    results.push_back(searchBulk);
+
+    if (moving) {
+        SuiteResult update = base;
+        update.op = "update";
+        double ns = 0;
+        for (int frame = 0; frame < SUITE_FRAMES; ++frame) {
+            for (const std::shared_ptr<RTreeObject> &obj : objects) {
+                obj->update(SUITE_WORLD, SUITE_WORLD);
+            }
+            start = BenchClock::now();
+            tree.update();
+            ns += elapsedNs(start);
+        }
+        update.ops = objects.size() * SUITE_FRAMES;
+        update.ns = ns / update.ops;
+        update.verified = verifySearches(tree, objects, centers);
+        results.push_back(update);
+    }
+
+    SuiteResult reconstruct = base;
+    reconstruct.op = "reconstruct";
+    start = BenchClock::now();
+    tree.reconstruct();
+    reconstruct.ops = objects.size();
+    reconstruct.ns = elapsedNs(start) / reconstruct.ops;
+    reconstruct.verified = verifySearches(tree, objects, centers);
+    results.push_back(reconstruct);
+
+    // Remove every tenth object
+    SuiteResult remove = base;
+    remove.op = "remove";
+    std::vector<std::shared_ptr<RTreeObject>> kept;
+    start = BenchClock::now();
+    for (size_t i = 0; i < objects.size(); ++i) {
+        if (i % 10 == 0) {
+            tree.remove(objects[i]);
+        }
+    }
+    remove.ns = elapsedNs(start);
+    for (size_t i = 0; i < objects.size(); ++i) {
+        if (i % 10 != 0) {
+            kept.push_back(objects[i]);
+        }
+    }
+    remove.ops = objects.size() - kept.size();
+    remove.ns /= remove.ops;
+    remove.verified = verifySearches(tree, kept, centers);
+    results.push_back(remove);
+}
+
+/**
+ * Writes the results of the suite as JSON.
+ *
+ * @param path The file to write.
+ * @param count The number of objects in each workload.
+ * @param results The measurements.
+ */
+static void writeSuiteJson(const char *path, size_t count,
+        const std::vector<SuiteResult> &results) {
+    std::FILE *file = std::fopen(path, "w");
+    if (file == nullptr) {
+        std::fprintf(stderr, "suite: cannot write %s\n", path);
+        benchFailed = true;
+        return;
+    }
+
+    std::fprintf(file, "{\n  \"benchmark\": \"suite\",\n");
+    std::fprintf(file, "  \"objects\": %zu,\n  \"objectSize\": %g,\n", count, SUITE_SIZE);
+    std::fprintf(file, "  \"searchRadius\": %g,\n  \"frames\": %d,\n", SUITE_RADIUS,
+                 SUITE_FRAMES);
+    std::fprintf(file, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const SuiteResult &r = results[i];
+        std::fprintf(file, "    {\"workload\": \"%s\", \"fanout\": %u, \"buffer\": %g, "
+                     "\"op\": \"%s\", \"ops\": %zu, \"nsPerOp\": %.1f, ",
+                     r.workload, r.fanout, r.buffer, r.op, r.ops, r.ns);
+        if (r.visits >= 0) {
+            std::fprintf(file, "\"visitsPerOp\": %.2f, \"bruteNsPerOp\": %.1f, ",
+                         r.visits, r.bruteNs);
+        } else {
+            std::fprintf(file, "\"visitsPerOp\": null, \"bruteNsPerOp\": null, ");
+        }
+        std::fprintf(file, "\"verified\": %s}%s\n", r.verified ? "true" : "false",
+                     i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    std::fclose(file);
+}
+
+/**
+ * Runs insert, bulkInsert, search, update, reconstruct and remove on uniform,
+ * clustered and moving objects for a sweep of fanouts and buffer sizes. Every
+ * search is checked against a linear scan of the objects, and the results
+ * are written as JSON to benchJsonPath if it is set.
+ */
+void benchSuite() {
+    const size_t count = 20000;
+    const size_t queries = 500;
+    std::printf("suite: %zu 8x8 objects, %zu searches of radius 32, %d update frames\n",
+                count, queries, SUITE_FRAMES);
+    std::printf("  ns per object for insert, bulkInsert, reconstruct and remove,\n");
+    std::printf("  per object per frame for update, and per search for search\n");
+    std::printf("%10s %6s %6s %16s %10s %8s %10s %6s\n", "workload", "fanout",
+                "buffer", "op", "ns/op", "visits", "brute ns", "ok");
+
+    std::vector<Vec2> centers = uniformPoints(queries, SUITE_WORLD, SUITE_WORLD, 41);
+    std::vector<std::shared_ptr<RTreeObject>> uniform =
+        uniformObjects(count, SUITE_WORLD, SUITE_WORLD, SUITE_SIZE, 43);
+    std::vector<std::shared_ptr<RTreeObject>> clustered =
+        clusteredObjects(count, SUITE_WORLD, SUITE_WORLD, SUITE_SIZE, 20, 100, 47);
+    std::vector<std::shared_ptr<RTreeObject>> moving =
+        movingObjects(count, SUITE_WORLD, SUITE_WORLD, SUITE_SIZE, 53);
+
+    unsigned int fanouts[] = {5, 8, 16, 32};
+    float buffers[] = {0, 5, 20, 50};
+    std::vector<SuiteResult> results;
+    for (unsigned int fanout : fanouts) {
+        for (float buffer : buffers) {
+            size_t first = results.size();
+            runSuiteCase("uniform", false, uniform, fanout, buffer, centers, results);
+            runSuiteCase("clustered", false, clustered, fanout, buffer, centers, results);
+            runSuiteCase("moving", true, moving, fanout, buffer, centers, results);
+            for (size_t i = first; i < results.size(); ++i) {
+                const SuiteResult &r = results[i];
+                if (r.visits >= 0) {
+                    std::printf("%10s %6u %6g %16s %10.1f %8.1f %10.1f %6s\n", r.workload,
+                                r.fanout, r.buffer, r.op, r.ns, r.visits, r.bruteNs,
+                                r.verified ? "yes" : "NO");
+                } else {
+                    std::printf("%10s %6u %6g %16s %10.1f %8s %10s %6s\n", r.workload,
+                                r.fanout, r.buffer, r.op, r.ns, "-", "-",
+                                r.verified ? "yes" : "NO");
+                }
+                if (!r.verified) {
+                    benchFailed = true;
+                }
+            }
+        }
+    }
+
+    if (benchJsonPath != nullptr) {
+        writeSuiteJson(benchJsonPath, count, results);
+    }
+}
@@ -0,0 +1,205 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+#include "rtreetpr.h"
+
+/** The side length of the world of the benchmark. */
+static const float WORLD = 8192;
+
+/** The number of frames in the benchmark. */
+static const int FRAMES = 200;
+
+/**
+ * Creates objects with random velocities.
+ *
+ * @param count The number of objects.
+ * @param velocity Set to the velocity of each object.
+ * @return The new objects.
+ */
+static std::vector<std::shared_ptr<RTreeObject>> movers(size_t count,
+                                                        std::vector<Vec2> &velocity) {
+    std::vector<std::shared_ptr<RTreeObject>> objects =
+        uniformObjects(count, WORLD - 8, WORLD - 8, 8, 41);
+    std::mt19937 rng(43);
+    std::uniform_real_distribution<float> angle(0, 6.2831853f);
+    std::uniform_real_distribution<float> speed(1, 4);
+    velocity.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        float a = angle(rng);
+        float s = speed(rng);
+        velocity[i] = Vec2(std::cos(a) * s, std::sin(a) * s);
+    }
+    return objects;
+}
+
+/**
+ * Moves an object one frame along its velocity, bouncing off the edges.
+ *
+ * @param obj The object to move.
+ * @param velocity The velocity of the object.
+ * @return Whether the object bounced.
+ */
+static bool moveObject(RTreeObject &obj, Vec2 &velocity) {
+    obj.rect.origin = obj.rect.origin + velocity;
+    bool bounced = false;
+    if (obj.rect.origin.x < 0 || obj.rect.origin.x > WORLD - 8) {
+        velocity.x = -velocity.x;
+        bounced = true;
+    }
+    if (obj.rect.origin.y < 0 || obj.rect.origin.y > WORLD - 8) {
+        velocity.y = -velocity.y;
+        bounced = true;
+    }
+    return bounced;
+}
+
+/** A straight line an object moves along, as last given to the TPR-tree. */
+struct Trajectory {
+    /** The rect of the object at the start time. */
+    Rect rect;
+    /** The velocity of the object. */
+    Vec2 velocity;
+    /** The time the object was at rect. */
+    float time;
+};
+
+/**
+ * Checks a search of the TPR-tree against a linear scan of the rects the
+ * objects are predicted to have from their trajectories.
+ *
+ * The tree predicts rects with its own arithmetic, so objects within a
+ * small tolerance of the circle may go either way.
+ *
+ * @param found The objects found by the search.
+ * @param objects The objects in the tree.
+ * @param paths The trajectory of each object.
+ * @param center The center of the circle.
+ * @param radius The radius of the circle.
+ * @param time The time searched at.
+ * @return Whether the search found the objects the scan did.
+ */
+static bool checkSearch(std::vector<std::shared_ptr<RTreeObject>> found,
+        const std::vector<std::shared_ptr<RTreeObject>> &objects,
+        const std::vector<Trajectory> &paths, Vec2 center, float radius, float time) {
+    const float tolerance = 0.05f;
+    std::sort(found.begin(), found.end());
+    if (std::adjacent_find(found.begin(), found.end()) != found.end()) {
+        return false;
+    }
+    for (size_t i = 0; i < objects.size(); ++i) {
+        Rect r = paths[i].rect;
+        r.origin = r.origin + paths[i].velocity * (time - paths[i].time);
+        bool hit = std::binary_search(found.begin(), found.end(), objects[i]);
+        bool sure = r.doesIntersect(center, radius - tolerance);
+        bool near = r.doesIntersect(center, radius + tolerance);
+        if ((sure && !hit) || (hit && !near)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Compares keeping an RTree current with update() every frame against a
+ * TPR-tree that only changes when objects bounce, on objects moving in
+ * straight lines. Every TPR search is checked against a linear scan.
+ */
+void benchTPR() {
+    std::printf("tpr: 8x8 objects moving 1-4 per frame for %d frames, 200 searches per frame\n",
+                FRAMES);
+    std::printf("%8s %10s %12s %10s %10s\n", "objects", "index", "maintain ms",
+                "query ms", "found");
+
+    const int queries = 200;
+    std::vector<Vec2> centers = uniformPoints(queries, WORLD, WORLD, 47);
+    size_t counts[] = {10000, 50000};
+    for (size_t count : counts) {
+        std::vector<Vec2> velocity;
+        std::vector<std::shared_ptr<RTreeObject>> objects = movers(count, velocity);
+        RTree tree(0, 0, WORLD, WORLD, 16, 6, 4);
+        tree.bulkInsert(objects);
+
+        double maintainNs = 0;
+        double queryNs = 0;
+        size_t found = 0;
+        for (int frame = 1; frame <= FRAMES; ++frame) {
+            for (size_t i = 0; i < count; ++i) {
+                moveObject(*objects[i], velocity[i]);
+            }
+            BenchClock::time_point start = BenchClock::now();
+            tree.update();
+            maintainNs += elapsedNs(start);
+
+            start = BenchClock::now();
+            for (const Vec2 &center : centers) {
+                found += tree.search(center, 64).size();
+            }
+            queryNs += elapsedNs(start);
+        }
+        std::printf("%8zu %10s %12.3f %10.3f %10zu\n", count, "rtree",
+                    maintainNs / FRAMES / 1e6, queryNs / FRAMES / 1e6, found / FRAMES);
+
+        objects = movers(count, velocity);
+        const float horizon = 60;
+        const int advanceEvery = 10;
+        RTreeTPR tpr(16, 6, horizon);
+        std::vector<Trajectory> paths(count);
+        for (size_t i = 0; i < count; ++i) {
+            tpr.insert(objects[i], velocity[i], 0);
+            paths[i] = {objects[i]->rect, velocity[i], 0};
+        }
+
+        maintainNs = 0;
+        queryNs = 0;
+        found = 0;
+        size_t mismatches = 0;
+        std::vector<std::vector<std::shared_ptr<RTreeObject>>> results(queries);
+        for (int frame = 1; frame <= FRAMES; ++frame) {
+            BenchClock::time_point start = BenchClock::now();
+            for (size_t i = 0; i < count; ++i) {
+                if (moveObject(*objects[i], velocity[i])) {
+                    tpr.setTrajectory(objects[i], velocity[i], frame);
+                    paths[i] = {objects[i]->rect, velocity[i], (float)frame};
+                }
+            }
+            if (frame % advanceEvery == 0) {
+                tpr.advance(frame);
+            }
+            maintainNs += elapsedNs(start);
+
+            start = BenchClock::now();
+            for (int q = 0; q < queries; ++q) {
+                results[q] = tpr.search(centers[q], 64, frame);
+                found += results[q].size();
+            }
+            queryNs += elapsedNs(start);
+
+            for (int q = 0; q < queries; ++q) {
+                mismatches += !checkSearch(results[q], objects, paths, centers[q], 64, frame);
+            }
+        }
+
+        // Search before the last advance, where bounds shrink back in time
+        for (int q = 0; q < queries; ++q) {
+            float time = FRAMES - advanceEvery / 2;
+            mismatches += !checkSearch(tpr.search(centers[q], 64, time), objects, paths,
+                                       centers[q], 64, time);
+        }
+        std::printf("%8zu %10s %12.3f %10.3f %10zu\n", count, "tpr",
+                    maintainNs / FRAMES / 1e6, queryNs / FRAMES / 1e6, found / FRAMES);
+        if (mismatches != 0) {
+            std::printf("  %zu TPR searches disagree with a linear scan\n", mismatches);
+            benchFailed = true;
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreenode.h"
+#include "rtreeobject.h"
+
+/**
+ * Creates square objects at uniformly random positions.
+ *
+ * @param count The number of objects to create.
+ * @param width The width of the area to place the objects in.
+ * @param height The height of the area to place the objects in.
+ * @param size The side length of each object.
+ * @param seed The seed of the random number generator.
+ * @return The new objects.
+ */
+std::vector<std::shared_ptr<RTreeObject>> uniformObjects(size_t count,
+        float width, float height, float size, unsigned int seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> x(0, width - size);
+    std::uniform_real_distribution<float> y(0, height - size);
+
+    std::vector<std::shared_ptr<RTreeObject>> objects;
+    objects.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        objects.push_back(std::make_shared<RTreeObject>(x(rng), y(rng), size, size));
+    }
+    return objects;
+}
+
+/**
+ * Creates uniformly random query centers.
+ *
+ * @param count The number of centers to create.
+ * @param width The width of the area to place the centers in.
+ * @param height The height of the area to place the centers in.
+ * @param seed The seed of the random number generator.
+ * @return The new centers.
+ */
+std::vector<Vec2> uniformPoints(size_t count, float width, float height,
+        unsigned int seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> x(0, width);
+    std::uniform_real_distribution<float> y(0, height);
+
+    std::vector<Vec2> points;
+    points.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        points.push_back(Vec2(x(rng), y(rng)));
+    }
+    return points;
+}
+
+/**
+ * Creates square objects in gaussian clusters around random points.
+ *
+ * @param count The number of objects to create.
+ * @param width The width of the area to place the clusters in.
+ * @param height The height of the area to place the clusters in.
+ * @param size The side length of each object.
+ * @param clusters The number of clusters.
+ * @param spread The standard deviation of the distance of an object from the
+ * center of its cluster along each axis.
+ * @param seed The seed of the random number generator.
+ * @return The new objects.
+ */
+std::vector<std::shared_ptr<RTreeObject>> clusteredObjects(size_t count,
+        float width, float height, float size, size_t clusters, float spread,
+        unsigned int seed) {
+    std::vector<Vec2> centers = uniformPoints(clusters, width, height, seed);
+    std::mt19937 rng(seed + 1);
+    std::uniform_int_distribution<size_t> pick(0, clusters - 1);
+    std::normal_distribution<float> offset(0, spread);
+
+    std::vector<std::shared_ptr<RTreeObject>> objects;
+    objects.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const Vec2 &center = centers[pick(rng)];
+        objects.push_back(std::make_shared<RTreeObject>(center.x + offset(rng),
+                                                        center.y + offset(rng),
+                                                        size, size));
+    }
+    return objects;
+}
+
+/**
+ * Creates square objects at uniformly random positions that move when their
+ * update() is called.
+ *
+ * The objects take their random velocities from rand(), which is seeded first
+ * so that the same seed gives the same motion.
+ *
+ * @param count The number of objects to create.
+ * @param width The width of the area to place the objects in.
+ * @param height The height of the area to place the objects in.
+ * @param size The side length of each object.
+ * @param seed The seed of the random number generators.
+ * @return The new objects.
+ */
+std::vector<std::shared_ptr<RTreeObject>> movingObjects(size_t count,
+        float width, float height, float size, unsigned int seed) {
+    std::srand(seed);
+    return uniformObjects(count, width, height, size, seed);
+}
+
+/**
+ * Counts the nodes a rectangular search visits, that is the root and every
+ * inner node whose bounding box meets the search area.
+ *
+ * @param tree The tree being searched.
+ * @param n The root of the subtree to count.
+ * @param area The search area.
+ * @return The number of nodes visited.
+ */
+size_t countVisits(const RTree &tree, const RTreeNode &n, const Rect &area) {
+    size_t visits = 1;
+    if (n.level > 0) {
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+            const RTreeNode &child = tree.getChild(n, i);
+            if (child.rect.doesIntersect(area)) {
+                visits += countVisits(tree, child, area);
+            }
+        }
+    }
+    return visits;
+}
+
+/**
+ * Counts the nodes a circular search visits, that is the root and every inner
+ * node whose bounding box meets the circle.
+ *
+ * @param tree The tree being searched.
+ * @param n The root of the subtree to count.
+ * @param center The center of the circle.
+ * @param radius The radius of the circle.
+ * @return The number of nodes visited.
+ */
+size_t countVisits(const RTree &tree, const RTreeNode &n, const Vec2 center,
+        float radius) {
+    size_t visits = 1;
+    if (n.level > 0) {
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+            const RTreeNode &child = tree.getChild(n, i);
+            if (child.rect.doesIntersect(center, radius)) {
+                visits += countVisits(tree, child, center, radius);
+            }
+        }
+    }
+    return visits;
+}
+
+/**
+ * Finds the objects whose rects meet a circle by testing every object.
+ *
+ * @param objects The objects in the tree.
+ * @param center The center of the circle.
+ * @param radius The radius of the circle.
+ * @param res Cleared and filled with the objects found.
+ */
+void bruteSearch(const std::vector<std::shared_ptr<RTreeObject>> &objects,
+        const Vec2 center, float radius, std::vector<RTreeObject *> &res) {
+    res.clear();
+    for (const std::shared_ptr<RTreeObject> &obj : objects) {
+        if (obj->rect.doesIntersect(center, radius)) {
+            res.push_back(obj.get());
+        }
+    }
+}
+
+/**
+ * Returns whether two searches found the same objects, in any order.
+ *
+ * @param found The objects found by one search.
+ * @param expected The objects found by the other.
+ * @return Whether the lists hold the same objects.
+ */
+bool sameObjects(std::vector<RTreeObject *> found, std::vector<RTreeObject *> expected) {
+    std::sort(found.begin(), found.end());
+    std::sort(expected.begin(), expected.end());
+    return found == expected;
+}
+
+/**
+ * Checks that searches on a tree find the same objects as linear scans of
+ * the objects that should be in it.
+ *
+ * @param tree The tree to search.
+ * @param live The objects that should be in the tree.
+ * @param side The side length of the area holding the objects.
+ * @return Whether every search matched.
+ */
+bool verifyTree(const RTree &tree,
+        const std::vector<std::shared_ptr<RTreeObject>> &live, float side) {
+    std::vector<Vec2> centers = uniformPoints(50, side, side, 61);
+    std::vector<RTreeObject *> found;
+    std::vector<RTreeObject *> expected;
+    bool ok = true;
+    for (const Vec2 &center : centers) {
+        found.clear();
+        tree.query(RTreeCircle(center, 64), found);
+        bruteSearch(live, center, 64, expected);
+        ok = ok && sameObjects(found, expected);
+    }
+    return ok;
+}
@@ -1,190 +1,371 @@
 #include "rtree.h"
 
-#include <cugl/cugl.h>
-
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
-#include <iostream>
+#include <functional>
+#include <future>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "rtreearena.h"
+#include "rtreegeometry.h"
 #include "rtreenode.h"
 #include "rtreeobject.h"
+#include "rtreepool.h"
+#include "rtreesimd.h"
+#include "rtreesnapshot.h"
+#include "rtreesplit.h"
 
-using namespace cugl;
 /**
- * Fills a vector with objects in a subtree that intersect with a given
- * circular area.
+ * Returns the squared distance from a point to the closest point of a
+ * rectangle, which is 0 if the point is inside it.
  *
- * @param n The root of the subtree.
- * @param center The center of the circle.
- * @param radius The radius of the circle.
- * @param res Vector containing objects that intersect the area.
+ * @param r The rectangle.
+ * @param p The point.
+ * @return The squared distance.
  */
-void RTree::findIntersections(RTreeNode &n, const Vec2 center, float radius,
-                            std::vector<std::shared_ptr<RTreeObject>> &res) {
-    if (n.level == 0) {
-        for (auto &child : n.children) {
-            if (child->obj->rect.doesIntersect(center, radius)) {
-                res.push_back(child->obj);
+static float distanceSquared(const Rect &r, const Vec2 p) {
+    float dx = std::max(std::max(r.getMinX() - p.x, p.x - r.getMaxX()), 0.0f);
+    float dy = std::max(std::max(r.getMinY() - p.y, p.y - r.getMaxY()), 0.0f);
+    return dx * dx + dy * dy;
+}
+
+/** The fraction of the children of an overflowing node that R* reinserts. */
+static const float REINSERT_FRACTION = 0.3f;
+
+/**
+ * Returns the area of a rectangle.
+ *
+ * @param r The rectangle.
+ * @return The area.
+ */
+static float area(const Rect &r) {
+    return r.size.width * r.size.height;
+}
+
+/**
+ * Returns the area of the intersection of two rectangles, which is 0 if they
+ * do not intersect.
+ *
+ * @param a The first rectangle.
+ * @param b The second rectangle.
+ * @return The area of the intersection.
+ */
+static float overlapArea(const Rect &a, const Rect &b) {
+    float w = std::min(a.getMaxX(), b.getMaxX()) - std::max(a.getMinX(), b.getMinX());
+    float h = std::min(a.getMaxY(), b.getMaxY()) - std::max(a.getMinY(), b.getMinY());
+    return w > 0 && h > 0 ? w * h : 0;
+}
+
+/** The number of cells along each side of the grid that Hilbert keys index. */
+static const uint32_t HILBERT_SIDE = 1 << 16;
+
+/**
+ * Returns the position of a cell along the Hilbert curve through a
+ * HILBERT_SIDE by HILBERT_SIDE grid.
+ *
+ * @param x The column of the cell.
+ * @param y The row of the cell.
+ * @return The Hilbert key of the cell.
+ */
+static uint32_t hilbertKey(uint32_t x, uint32_t y) {
+    uint32_t key = 0;
+    for (uint32_t s = HILBERT_SIDE / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        key += s * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the curve inside it has the base orientation
+        if (ry == 0) {
+            if (rx == 1) {
+                x = HILBERT_SIDE - 1 - x;
+                y = HILBERT_SIDE - 1 - y;
             }
+            std::swap(x, y);
         }
-    } else {
-        for (auto &child : n.children) {
-            if (child->rect.doesIntersect(center, radius)) {
-                findIntersections(*child, center, radius, res);
+    }
+    return key;
+}
+
+/**
+ * Insertion sorts keys, giving up once too many of them have been moved.
+ *
+ * Keys that compare equal keep their order. If the sort gives up, the keys
+ * are left in some order.
+ *
+ * @param keys The keys to sort by their key field.
+ * @param budget The most moves allowed.
+ * @return Whether the keys were sorted within the budget.
+ */
+template <typename Key>
+static bool insertionSortWithin(std::vector<Key> &keys, size_t budget) {
+    size_t moves = 0;
+    for (size_t i = 1; i < keys.size(); ++i) {
+        Key k = keys[i];
+        size_t j = i;
+        while (j > 0 && keys[j - 1].key > k.key) {
+            keys[j] = keys[j - 1];
+            j -= 1;
+            if (++moves > budget) {
+                keys[j] = k;
+                return false;
             }
         }
+        keys[j] = k;
     }
+    return true;
 }
 
 /**
- * Given a node to split, selects two children of the original node to become
- * the first children of the two new nodes.
+ * Sorts keys with a least significant digit radix sort on their 32-bit key
+ * field. Keys that compare equal keep their order.
  *
- * @param n The node to split
- * @return Pair of RTreeNode shared pointers containing the first two elements of the two new nodes
+ * @param keys The keys to sort.
+ * @param scratch Scratch space, resized to the number of keys.
  */
-std::pair<std::shared_ptr<RTreeNode>, std::shared_ptr<RTreeNode>> RTree::pickSeeds(RTreeNode &n) {
-    std::shared_ptr<RTreeNode> maxLowSideEntryX = nullptr;
-    std::shared_ptr<RTreeNode> minHighSideEntryX = nullptr;
-    std::shared_ptr<RTreeNode> maxLowSideEntryY = nullptr;
-    std::shared_ptr<RTreeNode> minHighSideEntryY = nullptr;
-
-    for (auto it = n.children.begin(); it != n.children.end(); ++it) {
-        std::shared_ptr<RTreeNode> child = *it;
-        if ((maxLowSideEntryX == nullptr ||
-                 child->rect.getMinX() > maxLowSideEntryX->rect.getMinX()) &&
-                child != minHighSideEntryX) {
-            maxLowSideEntryX = child;
+template <typename Key>
+static void radixSort(std::vector<Key> &keys, std::vector<Key> &scratch) {
+    scratch.resize(keys.size());
+    for (int shift = 0; shift < 32; shift += 8) {
+        size_t counts[257] = {0};
+        for (const Key &k : keys) {
+            counts[((k.key >> shift) & 0xFF) + 1] += 1;
+        }
+        for (int digit = 0; digit < 256; ++digit) {
+            counts[digit + 1] += counts[digit];
         }
+        for (const Key &k : keys) {
+            scratch[counts[(k.key >> shift) & 0xFF]++] = k;
+        }
+        keys.swap(scratch);
     }
+}
 
-    for (auto it = n.children.begin(); it != n.children.end(); ++it) {
-        std::shared_ptr<RTreeNode> child = *it;
-        if ((minHighSideEntryX == nullptr ||
-                 child->rect.getMaxX() < minHighSideEntryX->rect.getMaxX()) &&
-                child != maxLowSideEntryX) {
-            minHighSideEntryX = child;
-        }
+/** The fewest nodes in a level for bulk loading to split it across threads. */
+static const size_t PARALLEL_BUILD_MIN = 4096;
+
+/**
+ * Orders nodes whose centers are equal, so that bulk loading sorts into the
+ * same order no matter how the sort is split across threads.
+ *
+ * @param a The first node.
+ * @param b The second node.
+ * @return Whether a comes before b.
+ */
+static bool breakTie(const RTreeNode &a, const RTreeNode &b) {
+    if (a.rect.origin.x != b.rect.origin.x) {
+        return a.rect.origin.x < b.rect.origin.x;
+    }
+    if (a.rect.origin.y != b.rect.origin.y) {
+        return a.rect.origin.y < b.rect.origin.y;
     }
+    if (a.rect.size.width != b.rect.size.width) {
+        return a.rect.size.width < b.rect.size.width;
+    }
+    if (a.rect.size.height != b.rect.size.height) {
+        return a.rect.size.height < b.rect.size.height;
+    }
+    if (a.obj != b.obj) {
+        return std::less<const RTreeObject *>()(a.obj, b.obj);
+    }
+    return a.firstChild < b.firstChild;
+}
 
-    for (auto it = n.children.begin(); it != n.children.end(); ++it) {
-        std::shared_ptr<RTreeNode> child = *it;
-        if ((maxLowSideEntryY == nullptr ||
-                 child->rect.getMinY() > maxLowSideEntryY->rect.getMinY()) &&
-                child != minHighSideEntryY) {
-            maxLowSideEntryY = child;
-        }
+/**
+ * Orders nodes by the x-coordinate of their centers.
+ *
+ * @param a The first node.
+ * @param b The second node.
+ * @return Whether a comes before b.
+ */
+static bool lessOnX(const RTreeNode &a, const RTreeNode &b) {
+    if (a.rect.getMidX() != b.rect.getMidX()) {
+        return a.rect.getMidX() < b.rect.getMidX();
     }
+    if (a.rect.getMidY() != b.rect.getMidY()) {
+        return a.rect.getMidY() < b.rect.getMidY();
+    }
+    return breakTie(a, b);
+}
 
-    for (auto it = n.children.begin(); it != n.children.end(); ++it) {
-        std::shared_ptr<RTreeNode> child = *it;
-        if ((minHighSideEntryY == nullptr ||
-                 child->rect.getMaxY() < minHighSideEntryY->rect.getMaxY()) &&
-                child != maxLowSideEntryY) {
-            minHighSideEntryY = child;
-        }
+/**
+ * Orders nodes by the y-coordinate of their centers.
+ *
+ * @param a The first node.
+ * @param b The second node.
+ * @return Whether a comes before b.
+ */
+static bool lessOnY(const RTreeNode &a, const RTreeNode &b) {
+    if (a.rect.getMidY() != b.rect.getMidY()) {
+        return a.rect.getMidY() < b.rect.getMidY();
     }
+    if (a.rect.getMidX() != b.rect.getMidX()) {
+        return a.rect.getMidX() < b.rect.getMidX();
+    }
+    return breakTie(a, b);
+}
 
-    double separationX = (double)(minHighSideEntryX->rect.getMaxX() -
-                                                                 maxLowSideEntryX->rect.getMinX()) /
-                                                (n.rect.getMaxX() - n.rect.getMinX());
-    double separationY = (double)(minHighSideEntryY->rect.getMaxY() -
-                                                                 maxLowSideEntryY->rect.getMinY()) /
-                                                (n.rect.getMaxY() - n.rect.getMinY());
+/**
+ * Fills a vector with objects in a subtree that intersect with a given
+ * circular area.
+ *
+ * @param n The root of the subtree.
+ * @param center The center of the circle.
+ * @param radius The radius of the circle.
+ * @param res Vector containing objects that intersect the area.
+ * @param tests Counts of the leaf entries tested, added to.
+ */
+void RTree::findIntersections(const RTreeNode &n, const Vec2 center, float radius,
+                            std::vector<std::shared_ptr<RTreeObject>> &res,
+                            LeafTests &tests) const {
+    if (simdQueries) {
+        auto collect = [&res](RTreeObject &obj) {
+            res.push_back(obj.shared_from_this());
+        };
+        visitNode(n, RTreeCircle(center, radius), collect, tests);
+        return;
+    }
 
-    std::pair<std::shared_ptr<RTreeNode>, std::shared_ptr<RTreeNode>> seeds;
-    if (separationY > separationX) {
-        seeds.first = maxLowSideEntryY;
-        seeds.second = minHighSideEntryY;
+    RTREE_COUNT(tests.nodes += 1);
+    if (n.level == 0) {
+        RTREE_COUNT(tests.leaves += 1);
+        // Test the padded box first, as visitNode does, so that the padding
+        // statistics count the same candidates on both paths
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+            const RTreeNode &entry = arena[n.firstChild + i];
+            if (!entry.rect.doesIntersect(center, radius)) {
+                continue;
+            }
+            tests.candidates += 1;
+            if (entry.obj->rect.doesIntersect(center, radius)) {
+                RTREE_COUNT(tests.hits += 1);
+                res.push_back(entry.obj->shared_from_this());
+            } else {
+                tests.falsePositives += 1;
+            }
+        }
     } else {
-        seeds.first = maxLowSideEntryX;
-        seeds.second = minHighSideEntryX;
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+            const RTreeNode &child = arena[n.firstChild + i];
+            if (child.rect.doesIntersect(center, radius)) {
+                findIntersections(child, center, radius, res, tests);
+            }
+        }
     }
+}
 
-    return seeds;
+/**
+ * Splits an overflowing node into two nodes using the split policy.
+ *
+ * The first group of children is written back into the block of the node,
+ * and the second group into a newly allocated block.
+ *
+ * @param n The id of the node to be split.
+ * @param entries The children of the node, including the one that overflowed it.
+ * @return The new sibling of the node, holding the second group.
+ */
+RTreeNode RTree::splitNode(uint32_t n, std::vector<RTreeNode> &entries) {
+    RTREE_COUNT(statSplits += 1);
+    switch (splitPolicy) {
+    case SplitPolicy::Quadratic:
+        return splitWith<RTreeQuadraticSplit>(n, entries);
+    case SplitPolicy::RStar:
+        return splitWith<RTreeRStarSplit>(n, entries);
+    default:
+        return splitWith<RTreeLinearSplit>(n, entries);
+    }
 }
 
 /**
- * Selects one remaining child of the node to be split to be added to a newly
- * split node.
+ * Removes the children of an overflowing node that lie farthest from its
+ * center and queues them for reinsertion.
  *
- * @param children Vector of children of the node to be split
- * @param added Set of children already assigned to a new node
- * @param bbox_1 The bounding box of the first new node
- * @param bbox_2 The bounding box of the second new node
- * @return RTreeNode* The next child to be added to a new node
+ * @param n The id of the overflowing node.
+ * @param entries The children of the node, including the one that overflowed it.
  */
-std::shared_ptr<RTreeNode> RTree::pickNext(
-        const std::vector<std::shared_ptr<RTreeNode>> &children,
-        const std::unordered_set<std::shared_ptr<RTreeNode>> &added,
-        const Rect &bbox_1, const Rect &bbox_2) {
-    int max_diff = 0;
-    std::shared_ptr<RTreeNode> max_child = nullptr;
-    for (auto it = children.begin(); it != children.end(); ++it) {
-        std::shared_ptr<RTreeNode> child = *it;
-        if (added.find(child) != added.end()) {
-            continue;
-        }
+void RTree::forceReinsert(uint32_t n, std::vector<RTreeNode> &entries) {
+    RTreeNode &node = arena[n];
+    Vec2 center(node.rect.getMidX(), node.rect.getMidY());
+    auto distance = [&center](const RTreeNode &entry) {
+        float dx = entry.rect.getMidX() - center.x;
+        float dy = entry.rect.getMidY() - center.y;
+        return dx * dx + dy * dy;
+    };
+    std::sort(entries.begin(), entries.end(),
+              [&distance](const RTreeNode &a, const RTreeNode &b) {
+                  return distance(a) < distance(b);
+              });
 
-        Rect enlarged1 = bbox_1.getMerge(child->rect);
-        Rect enlarged2 = bbox_2.getMerge(child->rect);
-        float area1 = enlarged1.size.width * enlarged1.size.height;
-        float area2 = enlarged2.size.width * enlarged2.size.height;
-        float diff = std::abs(area1 - area2);
+    size_t count = entries.size();
+    size_t removed = std::max<size_t>(1, (size_t)(count * REINSERT_FRACTION));
+    removed = std::min(removed, count - std::max<size_t>(minPerLevel, 1));
+    size_t kept = count - removed;
+    RTREE_COUNT(statReinsertions += removed);
 
-        if (max_child == nullptr || diff > max_diff) {
-            max_child = child;
-            max_diff = diff;
-        }
+    node.rect = entries[0].rect;
+    node.numChildren = kept;
+    for (size_t i = 0; i < kept; ++i) {
+        arena.store(node.firstChild + i, entries[i]);
+        node.rect += entries[i].rect;
     }
+    arena.syncBounds(n);
 
-    return max_child;
+    // The queue is drained from the back, so the closest entries go in first
+    for (size_t i = count; i > kept; --i) {
+        reinsertQueue.push_back(entries[i - 1]);
+    }
 }
 
 /**
- * Splits an overflowing node into two nodes.
+ * Picks the child of a node to insert an entry into using the R*-tree
+ * criteria.
  *
- * @param n The node to be split.
- * @return The two resulting nodes from the split.
+ * @param n The parent of the candidate child nodes.
+ * @param entry The entry to insert.
+ * @return The id of the chosen child.
  */
-std::pair<std::shared_ptr<RTreeNode>, std::shared_ptr<RTreeNode>> RTree::linearSplit(RTreeNode &n) {
-    std::pair<std::shared_ptr<RTreeNode>, std::shared_ptr<RTreeNode>> seeds =
-            pickSeeds(n);
-
-    std::shared_ptr<RTreeNode> c1 = seeds.first;
-    std::shared_ptr<RTreeNode> c2 = seeds.second;
+uint32_t RTree::chooseSubtree(const RTreeNode &n, const RTreeNode &entry) const {
+    bool aboveTarget = n.level == entry.level + 2;
+    uint32_t bestChild = n.firstChild;
+    float bestOverlap = std::numeric_limits<float>::infinity();
+    float bestGrowth = std::numeric_limits<float>::infinity();
+    float bestArea = std::numeric_limits<float>::infinity();
 
-    std::unordered_set<std::shared_ptr<RTreeNode>> added;
-    std::shared_ptr<RTreeNode> node1 = std::make_shared<RTreeNode>(
-            c1->rect, std::vector<std::shared_ptr<RTreeNode>>{}, n.level);
-    std::shared_ptr<RTreeNode> node2 = std::make_shared<RTreeNode>(
-            c2->rect, std::vector<std::shared_ptr<RTreeNode>>{}, n.level);
+    for (uint32_t i = 0; i < n.numChildren; ++i) {
+        const Rect &r = arena[n.firstChild + i].rect;
+        Rect enlarged = r.getMerge(entry.rect);
+        float growth = area(enlarged) - area(r);
 
-    node1->children.push_back(c1);
-    node2->children.push_back(c2);
-    added.insert(c2);
-    added.insert(c1);
-    while (added.size() < n.children.size()) {
-        std::shared_ptr<RTreeNode> nextNode =
-                pickNext(n.children, added, node1->rect, node2->rect);
+        float overlap = 0;
+        if (aboveTarget) {
+            for (uint32_t j = 0; j < n.numChildren; ++j) {
+                if (j != i) {
+                    const Rect &other = arena[n.firstChild + j].rect;
+                    overlap += overlapArea(enlarged, other) - overlapArea(r, other);
+                }
+            }
+        }
 
-        added.insert(nextNode);
-        Rect enlarged1 = node1->rect.getMerge(nextNode->rect);
-        Rect enlarged2 = node2->rect.getMerge(nextNode->rect);
-        float area1 = enlarged1.size.width * enlarged1.size.height;
-        float area2 = enlarged2.size.width * enlarged2.size.height;
-        if (area1 < area2) {
-            node1->children.push_back(nextNode);
-            node1->rect = Rect(enlarged1);
-        } else {
-            node2->children.push_back(nextNode);
-            node2->rect = Rect(enlarged2);
+        if (overlap < bestOverlap ||
+                (overlap == bestOverlap && (growth < bestGrowth ||
+                    (growth == bestGrowth && area(r) < bestArea)))) {
+            bestOverlap = overlap;
+            bestGrowth = growth;
+            bestArea = area(r);
+            bestChild = n.firstChild + i;
         }
     }
-    return std::make_pair(node1, node2);
+
+    return bestChild;
 }
 
 /**
@@ -193,15 +374,14 @@ std::pair<std::shared_ptr<RTreeNode>, std::shared_ptr<RTreeNode>> RTree::linearS
  *
  * @param n The parent of the candidate child nodes to be checked.
  * @param containerRect The bounding box of the object to be inserted
- * @return The node that can expand to fit containerRect with minimal area increase.
+ * @return The id of the node that can expand to fit containerRect with minimal area increase.
  */
-std::shared_ptr<RTreeNode> RTree::findBestBB(RTreeNode &n, const Rect &containerRect) {
+uint32_t RTree::findBestBB(const RTreeNode &n, const Rect &containerRect) const {
     float minAreaIncrease = INT32_MAX;
-    Rect best_bb = Rect(-1, -1, -1, -1);
-    std::shared_ptr<RTreeNode> bestChild = nullptr;
+    uint32_t bestChild = n.firstChild;
 
-    for (auto &child : n.children) {
-        Rect r = child->rect;
+    for (uint32_t i = 0; i < n.numChildren; ++i) {
+        Rect r = arena[n.firstChild + i].rect;
         Rect enlargedBB = r.getMerge(containerRect);
         float areaEnlarged = enlargedBB.size.width * enlargedBB.size.height;
         float areaChild = r.size.width * r.size.height;
@@ -209,7 +389,7 @@ std::shared_ptr<RTreeNode> RTree::findBestBB(RTreeNode &n, const Rect &container
 
         if (areaIncrease < minAreaIncrease) {
             minAreaIncrease = areaIncrease;
-            bestChild = child;
+            bestChild = n.firstChild + i;
         }
     }
 
@@ -217,160 +397,300 @@ std::shared_ptr<RTreeNode> RTree::findBestBB(RTreeNode &n, const Rect &container
 }
 
 /**
- * Inserts an object into a node.
+ * Adds a child to a node, splitting the node if it is already full.
  *
- * @param n The node into which the object will be inserted.
- * @param obj The object to insert.
+ * @param n The id of the node to add the child to.
+ * @param child The child to add.
+ * @param sibling Set to the new sibling of the node if it was split.
+ * @return Whether the node was split.
  */
-void RTree::insertHelper(RTreeNode &n, std::shared_ptr<RTreeObject> &obj) {
-    Rect containerRect =
-            Rect(obj->rect.getMinX() - bufferSize, obj->rect.getMinY() - bufferSize,
-                     obj->rect.size.width + bufferSize * 2,
-                     obj->rect.size.height + bufferSize * 2);
+bool RTree::addChild(uint32_t n, const RTreeNode &child, RTreeNode &sibling) {
+    RTreeNode &node = arena[n];
+    if (node.numChildren < maxPerLevel) {
+        arena.store(node.firstChild + node.numChildren, child);
+        node.numChildren += 1;
+        return false;
+    }
 
-    if (n.level > 0) {
-        std::shared_ptr<RTreeNode> bestChild = nullptr;
-        bool fitsInChild = false;
-        for (auto it = n.children.begin(); it != n.children.end(); ++it) {
-            Rect r = (*it)->rect;
-            if (r.contains(containerRect)) {
-                insertHelper(*(*it), obj);
-                fitsInChild = true;
-                bestChild = (*it);
-                break;
-            }
-        }
+    const RTreeNode *children = &arena[node.firstChild];
+    splitEntries.assign(children, children + node.numChildren);
+    splitEntries.push_back(child);
 
-        // If no child node can fit this object, expand one of them to fit it
-        if (!fitsInChild) {
-            bestChild = findBestBB(n, containerRect);
-            bestChild->rect += containerRect;
-            insertHelper(*bestChild, obj);
-        }
-        if ((*bestChild).children.size() > maxPerLevel) {
-            std::pair<std::shared_ptr<RTreeNode>, std::shared_ptr<RTreeNode>> nodes =
-                    linearSplit(*bestChild);
-            n.deleteChild(*bestChild);
-            n.addChild(nodes.first);
-            n.addChild(nodes.second);
-        }
-    } else {
-        std::vector<std::shared_ptr<RTreeNode>> emptyVector;
-        std::shared_ptr<RTreeNode> containerNode =
-                std::make_shared<RTreeNode>(containerRect, emptyVector, -1);
-        containerNode->obj = obj;
-        n.children.push_back(containerNode);
-        objectToBBox.insert(std::make_pair(obj, containerRect));
+    // R* reinserts instead of splitting on the first overflow of each level
+    uint64_t levelBit = node.level < 64 ? uint64_t(1) << node.level : 0;
+    if (insertStrategy == InsertStrategy::RStar && n != root &&
+            (reinsertedLevels & levelBit) == 0) {
+        reinsertedLevels |= levelBit;
+        forceReinsert(n, splitEntries);
+        return false;
     }
+    sibling = splitNode(n, splitEntries);
+    return true;
 }
 
 /**
- * Searches for an object in a given node, and if it is found, removes it.
+ * Removes a child from a node by moving the last child into its place.
  *
- * If removing the object causes the node to have too few children, the
- * remaining children are removed and returned.
+ * @param n The id of the node to remove the child from.
+ * @param index The index of the child among the children of the node.
+ */
+void RTree::removeChild(uint32_t n, uint32_t index) {
+    RTreeNode &node = arena[n];
+    node.numChildren -= 1;
+    if (index != node.numChildren) {
+        arena.store(node.firstChild + index, arena[node.firstChild + node.numChildren]);
+    }
+}
+
+/**
+ * Inserts a node into a subtree, at the level just below its own.
  *
- * @param n The node to search.
- * @param obj The object to be removed.
- * @return A list of objects to reinsert into the tree.
+ * @param n The id of the node into which the entry will be inserted.
+ * @param entry The leaf node holding the object to insert, or an inner
+ * node being reinserted.
+ * @param sibling Set to the new sibling of the node if it was split.
+ * @return Whether the node was split.
  */
-std::vector<std::shared_ptr<RTreeObject>> RTree::removeHelper(
-        std::shared_ptr<RTreeNode> &n, std::shared_ptr<RTreeObject> &obj) {
-    std::vector<std::shared_ptr<RTreeObject>> entriesToReinsert;
+bool RTree::insertHelper(uint32_t n, const RTreeNode &entry, RTreeNode &sibling) {
+    // Read through the const arena, so that the descent copies a shared
+    // chunk only where a bounding box has to grow
+    const RTreeNodeArena &nodes = arena;
+    const RTreeNode &node = nodes[n];
+    if (node.level == entry.level + 1) {
+        return addChild(n, entry, sibling);
+    }
 
-    if (n->level == 0) {
-        for (auto it = n->children.begin(); it != n->children.end(); ++it) {
-            if ((*it)->obj.get() == obj.get()) {
-                n->children.erase(it);
-                break;
-            }
+    uint32_t bestChild = RTreeNodeArena::NONE;
+    if (insertStrategy == InsertStrategy::RStar) {
+        bestChild = chooseSubtree(node, entry);
+    }
+    for (uint32_t i = 0; bestChild == RTreeNodeArena::NONE && i < node.numChildren; ++i) {
+        if (nodes[node.firstChild + i].rect.contains(entry.rect)) {
+            bestChild = node.firstChild + i;
+            break;
         }
+    }
+
+    // If no child node can fit this object, expand one of them to fit it
+    if (bestChild == RTreeNodeArena::NONE) {
+        bestChild = findBestBB(node, entry.rect);
+    }
+    if (!nodes[bestChild].rect.contains(entry.rect)) {
+        arena[bestChild].rect += entry.rect;
+        arena.syncBounds(bestChild);
+    }
+
+    RTreeNode childSibling;
+    if (insertHelper(bestChild, entry, childSibling)) {
+        return addChild(n, childSibling, sibling);
+    }
+    return false;
+}
+
+/**
+ * Removes the leaf node of an object, walking up from it to the root.
+ *
+ * If removing the object causes a node to have too few children, that node
+ * is removed and the objects beneath it are added to toReinsert. The bounding
+ * boxes of the other nodes on the path are shrunk.
+ *
+ * @param slot The handle index of the object.
+ * @param toReinsert Vector of handle indices that must be reinserted.
+ * @return Whether the object was in the tree.
+ */
+bool RTree::removeEntry(uint32_t slot, std::vector<uint32_t> &toReinsert) {
+    uint32_t entry = arena.entryOf(slot);
+    if (entry == RTreeNodeArena::NONE) {
+        return false;
+    }
 
-        if (n->children.size() < minPerLevel) {
-            for (auto it = n->children.begin(); it != n->children.end(); ++it) {
-                entriesToReinsert.push_back((*it)->obj);
+    uint32_t n = arena.parentOf(entry);
+    arena.clearEntry(slot);
+    removeChild(n, entry - arena[n].firstChild);
+
+    while (n != root) {
+        uint32_t parent = arena.parentOf(n);
+        RTreeNode &node = arena[n];
+        if (node.numChildren < minPerLevel) {
+            // Condense the tree by dissolving the underfull node
+            RTREE_COUNT(size_t collected = toReinsert.size());
+            collectObjects(node, toReinsert);
+            RTREE_COUNT(statReinsertions += toReinsert.size() - collected);
+            releaseSubtree(node);
+            removeChild(parent, n - arena[parent].firstChild);
+        } else {
+            // Shrink the node's bounding box now that the object is gone
+            Rect newBBox = arena[node.firstChild].rect;
+            for (uint32_t j = 1; j < node.numChildren; ++j) {
+                newBBox += arena[node.firstChild + j].rect;
             }
-            n->children.clear();
+            node.rect = newBBox;
+            arena.syncBounds(n);
         }
+        n = parent;
     }
+    return true;
+}
 
-    else {
-        bool mustResize = false;
-        auto it = n->children.begin();
-        while (it != n->children.end()) {
-            auto entries = removeHelper((*it), obj);
-            if (entries.size() > 0) {
-                entriesToReinsert = entries;
+/**
+ * Appends the handle index of every object stored in a subtree to a vector,
+ * and records that they are no longer in the tree.
+ *
+ * @param n The root of the subtree.
+ * @param res Vector to append the handle indices to.
+ */
+void RTree::collectObjects(const RTreeNode &n, std::vector<uint32_t> &res) {
+    for (uint32_t i = 0; i < n.numChildren; ++i) {
+        const RTreeNode &child = arena[n.firstChild + i];
+        if (n.level == 0) {
+            res.push_back(child.handle);
+            arena.clearEntry(child.handle);
+        } else {
+            collectObjects(child, res);
+        }
+    }
+}
 
-                // Erase the current child from the vector and obtain the iterator to
-                // the next element
-                it = n->children.erase(it);
-                mustResize = true;
-            } else {
-                ++it;
-            }
+/**
+ * Returns the blocks of every descendant of a node to the arena.
+ *
+ * @param n The root of the subtree.
+ */
+void RTree::releaseSubtree(const RTreeNode &n) {
+    if (n.level > 0) {
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+            releaseSubtree(arena[n.firstChild + i]);
         }
+    }
+    arena.release(n.firstChild);
+}
 
-        if (mustResize) {
-            Rect newBBox = n->children[0]->rect;
-            for (auto it = n->children.begin(); it != n->children.end(); ++it) {
-                newBBox += (*it)->rect;
-            }
-            n->rect = newBBox;
+/**
+ * Replaces the bounding box of an object in place.
+ *
+ * Without growing, this only succeeds if the new bounding box still fits
+ * inside the leaf node that holds the object. Growing enlarges the nodes on
+ * the path to the object until they contain the new bounding box, which keeps
+ * searches correct without restructuring the tree, at the cost of looser
+ * nodes.
+ *
+ * @param slot The handle index of the object.
+ * @param newBBox The new bounding box of the object.
+ * @param grow Whether to enlarge the nodes above the object.
+ * @return Whether the bounding box was replaced.
+ */
+bool RTree::refitEntry(uint32_t slot, const Rect &newBBox, bool grow) {
+    uint32_t entry = arena.entryOf(slot);
+    uint32_t leaf = arena.parentOf(entry);
+    if (!grow && !arena[leaf].rect.contains(newBBox)) {
+        return false;
+    }
+
+    arena[entry].rect = newBBox;
+    arena.syncBounds(entry);
+    slots[slot].bbox = newBBox;
+    if (grow) {
+        // The root spans the whole RTree and is never tested
+        for (uint32_t n = leaf; n != root; n = arena.parentOf(n)) {
+            arena[n].rect += newBBox;
+            arena.syncBounds(n);
         }
     }
+    return true;
+}
+
+/**
+ * Returns the bounding box of an object padded for the padding mode.
+ *
+ * @param state The bookkeeping of the object.
+ * @return The padded bounding box.
+ */
+Rect RTree::paddedRect(const ObjectState &state) const {
+    const Rect &objRect = state.obj->rect;
+    if (paddingMode == PaddingMode::Fixed) {
+        return Rect(objRect.getMinX() - bufferSize, objRect.getMinY() - bufferSize,
+                    objRect.size.width + bufferSize * 2,
+                    objRect.size.height + bufferSize * 2);
+    }
+
+    // Sweep the rect along the velocity, so only the leading side grows
+    Vec2 sweep = state.velocity * paddingFrames;
+    float minX = objRect.getMinX() - minPadding + std::min(sweep.x, 0.0f);
+    float minY = objRect.getMinY() - minPadding + std::min(sweep.y, 0.0f);
+    float maxX = objRect.getMaxX() + minPadding + std::max(sweep.x, 0.0f);
+    float maxY = objRect.getMaxY() + minPadding + std::max(sweep.y, 0.0f);
+    return Rect(minX, minY, maxX - minX, maxY - minY);
+}
 
-    return entriesToReinsert;
+/**
+ * Creates an empty root node spanning the bounding box of the RTree.
+ *
+ * @param level The level of the new root.
+ * @return The id of the new root.
+ */
+uint32_t RTree::createRoot(int level) {
+    uint32_t id = arena.allocate();
+    RTreeNode node(rect, level);
+    node.firstChild = arena.allocate();
+    arena.store(id, node);
+    return id;
 }
 
 /**
  * Partition a list of child nodes into a certain amount of new parent nodes.
  *
+ * The children of each new parent are written into their own block of the
+ * arena. Large levels are sorted and packed across the build threads.
+ *
  * @param nodes Vector of nodes to be partitioned
- * @return Vector of the new children nodes
- */
-std::vector<std::shared_ptr<RTreeNode>> RTree::strSplit(
-        std::vector<std::shared_ptr<RTreeNode>> &nodes, int level) {
-    std::vector<std::shared_ptr<RTreeNode>> parents;
-    std::sort(nodes.begin(), nodes.end(),
-                        [](const std::shared_ptr<RTreeNode> &a,
-                             const std::shared_ptr<RTreeNode> &b) {
-                            return a->rect.getMidX() < b->rect.getMidX();
-                        });
-
-    int numLeafNodes = std::ceil(nodes.size() / (float)maxPerLevel);
-    int numSlices = std::ceil(std::sqrt(numLeafNodes));
-    int nodesPerSlice = numSlices * maxPerLevel;
-
-    for (int i = 0; i < numSlices; ++i) {
-        std::vector<std::shared_ptr<RTreeNode>> sliceNodes;
-
-        for (int j = i * nodesPerSlice;
-                 j < std::min((i + 1) * nodesPerSlice, (int)nodes.size()); ++j) {
-            sliceNodes.push_back(nodes[j]);
-        }
-
-        std::sort(sliceNodes.begin(), sliceNodes.end(),
-                            [](const std::shared_ptr<RTreeNode> &a,
-                                 const std::shared_ptr<RTreeNode> &b) {
-                                return a->rect.getMidY() < b->rect.getMidY();
-                            });
-
-        auto it = sliceNodes.begin();
-        while (it != sliceNodes.end()) {
-            auto end = std::next(it, maxPerLevel);
-            if (std::distance(it, sliceNodes.end()) < maxPerLevel) {
-                end = sliceNodes.end();
+ * @param level The level of the new parent nodes
+ * @param parents Vector to fill with the new parent nodes
+ */
+void RTree::strSplit(RTreeNodeArena &target, std::vector<RTreeNode> &nodes,
+        int level, std::vector<RTreeNode> &parents) {
+    RTreeThreadPool *pool = nodes.size() >= PARALLEL_BUILD_MIN ? buildPool.get() : nullptr;
+    if (pool) {
+        pool->sort(nodes.begin(), nodes.end(), lessOnX);
+    } else {
+        std::sort(nodes.begin(), nodes.end(), lessOnX);
+    }
+
+    size_t numLeafNodes = std::ceil(nodes.size() / (float)maxPerLevel);
+    size_t numSlices = std::ceil(std::sqrt(numLeafNodes));
+    size_t nodesPerSlice = numSlices * maxPerLevel;
+    numSlices = (nodes.size() + nodesPerSlice - 1) / nodesPerSlice;
+
+    // Hand out the blocks in order first, so that the tree does not depend on
+    // which thread packs which slice
+    parents.assign((nodes.size() + maxPerLevel - 1) / maxPerLevel, RTreeNode(Rect(), level));
+    for (RTreeNode &parent : parents) {
+        parent.firstChild = target.allocate();
+    }
+
+    // Every slice but the last holds a multiple of maxPerLevel nodes, so the
+    // parents of a slice start at its first node divided by maxPerLevel
+    auto packSlice = [&](size_t slice) {
+        size_t start = slice * nodesPerSlice;
+        size_t end = std::min(start + nodesPerSlice, nodes.size());
+        std::sort(nodes.begin() + start, nodes.begin() + end, lessOnY);
+
+        for (size_t i = start; i < end; i += maxPerLevel) {
+            RTreeNode &parent = parents[i / maxPerLevel];
+            parent.rect = nodes[i].rect;
+            for (size_t j = i; j < std::min<size_t>(i + maxPerLevel, end); ++j) {
+                target.store(parent.firstChild + parent.numChildren, nodes[j]);
+                parent.numChildren += 1;
+                parent.rect += nodes[j].rect;
             }
-            std::vector<std::shared_ptr<RTreeNode>> children(it, end);
-            std::shared_ptr<RTreeNode> parent =
-                    std::make_shared<RTreeNode>(children, level);
-            parents.push_back(parent);
-            it = end;
+        }
+    };
+    if (pool) {
+        pool->run(numSlices, packSlice);
+    } else {
+        for (size_t slice = 0; slice < numSlices; ++slice) {
+            packSlice(slice);
         }
     }
-
-    return parents;
 }
 
 /**
@@ -382,23 +702,119 @@ std::vector<std::shared_ptr<RTreeNode>> RTree::strSplit(
  *
  * Precondition: nodes is non-empty.
  *
+ * @param target The arena to build the tree in.
  * @param nodes The list of nodes to be bulk inserted into the RTree.
- * @return The root node of the new RTree.
+ * @return The id of the root node of the new RTree.
  */
-std::shared_ptr<RTreeNode> RTree::sortTileRecursive(
-        std::vector<std::shared_ptr<RTreeNode>> &nodes) {
-    std::vector<std::shared_ptr<RTreeNode>> parents = strSplit(nodes, 0);
+uint32_t RTree::sortTileRecursive(RTreeNodeArena &target, std::vector<RTreeNode> &nodes) {
+    strSplit(target, nodes, 0, buildParents);
 
     int level = 1;
-    while (parents.size() > 1) {
-        parents = strSplit(parents, level);
+    while (buildParents.size() > 1) {
+        nodes.swap(buildParents);
+        strSplit(target, nodes, level, buildParents);
+        level += 1;
+    }
+
+    uint32_t newRoot = target.allocate();
+    target.store(newRoot, buildParents[0]);
+
+    return newRoot;
+}
+
+/**
+ * Build an R-Tree from the bottom up by packing nodes in Hilbert order.
+ *
+ * Each node gets the Hilbert key of its center within the bounding box of
+ * all nodes. If the nodes are nearly in key order already, they are
+ * insertion sorted, and otherwise radix sorted. Runs of maxPerLevel
+ * consecutive nodes then become parents, level by level.
+ *
+ * Precondition: nodes is non-empty.
+ *
+ * @param target The arena to build the tree in.
+ * @param nodes The list of nodes to be bulk inserted into the RTree.
+ * @return The id of the root node of the new RTree.
+ */
+uint32_t RTree::hilbertPack(RTreeNodeArena &target, std::vector<RTreeNode> &nodes) {
+    float minX = nodes[0].rect.getMidX();
+    float minY = nodes[0].rect.getMidY();
+    float maxX = minX;
+    float maxY = minY;
+    for (const RTreeNode &node : nodes) {
+        minX = std::min(minX, node.rect.getMidX());
+        minY = std::min(minY, node.rect.getMidY());
+        maxX = std::max(maxX, node.rect.getMidX());
+        maxY = std::max(maxY, node.rect.getMidY());
+    }
+    float scaleX = maxX > minX ? (HILBERT_SIDE - 1) / (maxX - minX) : 0;
+    float scaleY = maxY > minY ? (HILBERT_SIDE - 1) / (maxY - minY) : 0;
+
+    size_t descents = 0;
+    hilbertKeys.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        uint32_t x = std::min<uint32_t>((nodes[i].rect.getMidX() - minX) * scaleX, HILBERT_SIDE - 1);
+        uint32_t y = std::min<uint32_t>((nodes[i].rect.getMidY() - minY) * scaleY, HILBERT_SIDE - 1);
+        hilbertKeys[i].key = hilbertKey(x, y);
+        hilbertKeys[i].index = i;
+        descents += i > 0 && hilbertKeys[i].key < hilbertKeys[i - 1].key;
+    }
+
+    // A tree rebuilt after small moves yields its leaves nearly in order
+    bool sorted = false;
+    if (descents <= nodes.size() / 8) {
+        sorted = insertionSortWithin(hilbertKeys, 8 * nodes.size());
+    }
+    if (!sorted) {
+        radixSort(hilbertKeys, hilbertScratch);
+    }
+
+    buildParents.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        buildParents[i] = nodes[hilbertKeys[i].index];
+    }
+    nodes.swap(buildParents);
+
+    int level = 0;
+    while (true) {
+        buildParents.clear();
+        for (size_t i = 0; i < nodes.size(); i += maxPerLevel) {
+            RTreeNode parent(nodes[i].rect, level);
+            parent.firstChild = target.allocate();
+            for (size_t j = i; j < std::min<size_t>(i + maxPerLevel, nodes.size()); ++j) {
+                target.store(parent.firstChild + parent.numChildren, nodes[j]);
+                parent.numChildren += 1;
+                parent.rect += nodes[j].rect;
+            }
+            buildParents.push_back(parent);
+        }
+        if (buildParents.size() == 1) {
+            break;
+        }
+        nodes.swap(buildParents);
         level += 1;
     }
 
-    std::shared_ptr<RTreeNode> newRoot = parents[0];
-    newRoot->rect = root->rect;
+    uint32_t newRoot = target.allocate();
+    target.store(newRoot, buildParents[0]);
+
+    return newRoot;
+}
 
-    return parents[0];
+/**
+ * Build an R-Tree from the bottom up with the bulk loader of this tree.
+ *
+ * Precondition: nodes is non-empty.
+ *
+ * @param target The arena to build the tree in.
+ * @param nodes The list of nodes to be bulk inserted into the RTree.
+ * @return The id of the root node of the new RTree.
+ */
+uint32_t RTree::bulkLoad(RTreeNodeArena &target, std::vector<RTreeNode> &nodes) {
+    if (bulkLoader == BulkLoader::Hilbert) {
+        return hilbertPack(target, nodes);
+    }
+    return sortTileRecursive(target, nodes);
 }
 
 /**
@@ -411,29 +827,83 @@ std::shared_ptr<RTreeNode> RTree::sortTileRecursive(
  * rectangle.
  * @param height The y-coordinate of the upper-right corner of the root
  * rectangle.
- * @param maxChildren Maximum number of children per node (default is 5).
+ * @param maxChildren Maximum number of children per node (default is 5). This
+ * is clamped to RTreeNodeArena::CHUNK_SIZE (512), since the children of a
+ * node share one block of the arena.
  * @param minChildren Minimum number of children per node (default is 2).
- * @param buffer The amount of padding on each side of the bounding box of each object.
+ * @param buffer The amount of padding on each side of the bounding box of each object
+ * under fixed padding.
  */
 RTree::RTree(float x, float y, float width, float height,
                          unsigned int maxChildren, unsigned int minChildren,
                          float buffer)
         : rect(Rect(x, y, width, height)),
-            maxPerLevel(maxChildren),
+            maxPerLevel(std::min<unsigned int>(maxChildren, RTreeNodeArena::CHUNK_SIZE)),
             minPerLevel(minChildren),
             bufferSize(buffer),
-            root(std::make_shared<RTreeNode>(
-                    x, y, width, height, std::vector<std::shared_ptr<RTreeNode>>{}, 0)),
-            objectToBBox(){};
+            rebuildThreshold(0.25f),
+            rebuildPolicy(RebuildPolicy::Threshold),
+            degradation(1.5f),
+            qualityInterval(30),
+            updatesSinceCheck(0),
+            rebuildNs(0),
+            fixNs(0),
+            baselineOverlap(-1),
+            baselineCost(-1),
+            checkedCandidates(0),
+            checkedQueries(0),
+            simdQueries(true),
+            arena(maxPerLevel),
+            slots(),
+            freeSlots(),
+            objectToHandle(),
+            paddingMode(PaddingMode::Fixed),
+            paddingFrames(10),
+            minPadding(1),
+            escapeChecks(0),
+            escapeCount(0),
+            leafCandidates(0),
+            leafFalsePositives(0),
+            leafQueries(0),
+#ifdef RTREE_STATS
+            statNodes(0),
+            statLeaves(0),
+            statHits(0),
+            statFalsePositives(0),
+            statSplits(0),
+            statReinsertions(0),
+            statRebuilds(0),
+            statRebuildNs(0),
+            statMaxRebuildNs(0),
+            pendingRebuildNs(0),
+#endif
+            buildThreads(1),
+            backgroundRebuild(false),
+            backArena(maxPerLevel),
+            insertStrategy(InsertStrategy::Linear),
+            splitPolicy(SplitPolicy::Quadratic),
+            reinsertedLevels(0),
+            bulkLoader(BulkLoader::STR),
+            hilbertOrdered(false) {
+    root = createRoot(0);
+}
+
+/**
+ * Destroys this RTree, waiting for a pending background rebuild.
+ */
+RTree::~RTree() {
+    discardRebuild();
+}
 
 /**
  * Resets to an empty RTree.
  */
 void RTree::clear() {
-    root->deleteChildren();
-    root = std::make_shared<RTreeNode>(
-            rect.getMinX(), rect.getMinY(), rect.getMaxX(), rect.getMaxY(),
-            std::vector<std::shared_ptr<RTreeNode>>{}, 0);
+    discardRebuild();
+    arena.reset();
+    releaseSlots();
+    hilbertOrdered = false;
+    root = createRoot(0);
 }
 
 /**
@@ -444,111 +914,1263 @@ void RTree::clear() {
  * @return A vector of shared pointers to RTreeObject instances intersecting
  * the search area.
  */
-std::vector<std::shared_ptr<RTreeObject>> RTree::search(const Vec2 center, float radius) {
+std::vector<std::shared_ptr<RTreeObject>> RTree::search(const Vec2 center, float radius) const {
     std::vector<std::shared_ptr<RTreeObject>> res;
-    findIntersections(*root, center, radius, res);
+    LeafTests tests;
+    findIntersections(arena[root], center, radius, res, tests);
+    recordLeafTests(tests);
     return res;
 }
 
 /**
- * Inserts an object into the R-Tree.
+ * Searches for objects that intersect a given rectangular area.
  *
- * @param obj Shared pointer to the RTreeObject to be inserted.
- * @param buffer Optional buffer value to expand the object's bounding box
- * (default is 20).
- */
-void RTree::insert(std::shared_ptr<RTreeObject> obj) {
-    insertHelper(*root, obj);
-    if (root->children.size() > maxPerLevel) {
-        std::shared_ptr<RTreeNode> newRoot = std::make_shared<RTreeNode>(
-                root->rect, std::vector<std::shared_ptr<RTreeNode>>{}, root->level + 1);
-        std::pair<std::shared_ptr<RTreeNode>, std::shared_ptr<RTreeNode>> nodes =
-                linearSplit(*root);
-        newRoot->addChild(nodes.first);
-        newRoot->addChild(nodes.second);
-        root = newRoot;
-    }
+ * @param area The rectangle to search.
+ * @return A vector of shared pointers to RTreeObject instances intersecting
+ * the search area.
+ */
+std::vector<std::shared_ptr<RTreeObject>> RTree::search(const Rect &area) const {
+    std::vector<std::shared_ptr<RTreeObject>> res;
+    query(RTreeIntersects(area), [&res](RTreeObject &obj) {
+        res.push_back(obj.shared_from_this());
+    });
+    return res;
 }
 
 /**
- * Removes an object from this RTree.
+ * Searches for objects that lie entirely inside a given rectangular area.
  *
- * @param obj Shared pointer to the RTreeObject to be removed.
+ * @param area The rectangle to search.
+ * @return A vector of shared pointers to RTreeObject instances contained in
+ * the search area.
  */
-void RTree::remove(std::shared_ptr<RTreeObject> obj) {
-    std::vector<std::shared_ptr<RTreeObject>> toReinsert =
-            removeHelper(root, obj);
-    for (auto it = toReinsert.begin(); it != toReinsert.end(); ++it) {
-        insert(*it);
-    }
-
-    if (root->children.size() == 1 && root->level > 0) {
-        Rect prevBBox = root->rect;
-        root = root->children[0];
-        root->rect = prevBBox;
-    }
-
-    objectToBBox.erase(obj);
+std::vector<std::shared_ptr<RTreeObject>> RTree::searchInside(const Rect &area) const {
+    std::vector<std::shared_ptr<RTreeObject>> res;
+    query(RTreeInside(area), [&res](RTreeObject &obj) {
+        res.push_back(obj.shared_from_this());
+    });
+    return res;
 }
 
 /**
- * Bulk inserts a vector of objects.
+ * Searches for the objects within each of a batch of circular areas.
  *
- * @param objects List of objects to insert.
+ * @param queries The circles to search.
+ * @param results Cleared and filled with the objects found by each query.
  */
-void RTree::bulkInsert(std::vector<std::shared_ptr<RTreeObject>> objects) {
-    std::vector<std::shared_ptr<RTreeNode>> nodes;
-    std::unordered_map<std::shared_ptr<RTreeObject>, Rect> newMap;
-    objectToBBox.swap(newMap);
-    for (auto it = objects.begin(); it != objects.end(); ++it) {
-        auto obj = *it;
-        Rect containerRect =
-                Rect(obj->rect.getMinX() - bufferSize, obj->rect.getMinY() - bufferSize,
-                         obj->rect.size.width + bufferSize * 2,
-                         obj->rect.size.height + bufferSize * 2);
-        std::vector<std::shared_ptr<RTreeNode>> emptyVector;
-        std::shared_ptr<RTreeNode> containerNode =
-                std::make_shared<RTreeNode>(containerRect, emptyVector, -1);
-        containerNode->obj = obj;
-        nodes.push_back(containerNode);
-        objectToBBox.insert(std::make_pair(obj, containerRect));
+void RTree::searchBatch(const std::vector<Query> &queries, BatchResults &results) const {
+    results.offsets.assign(queries.size() + 1, 0);
+    results.objects.clear();
+    if (queries.empty()) {
+        return;
     }
 
-    std::shared_ptr<RTreeNode> newRoot = sortTileRecursive(nodes);
+    // Queries close together on the curve descend into the same subtrees
+    float scaleX = rect.size.width > 0 ? (HILBERT_SIDE - 1) / rect.size.width : 0;
+    float scaleY = rect.size.height > 0 ? (HILBERT_SIDE - 1) / rect.size.height : 0;
+    results.keys.resize(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        float x = (queries[i].center.x - rect.getMinX()) * scaleX;
+        float y = (queries[i].center.y - rect.getMinY()) * scaleY;
+        x = std::min(std::max(x, 0.0f), (float)(HILBERT_SIDE - 1));
+        y = std::min(std::max(y, 0.0f), (float)(HILBERT_SIDE - 1));
+        results.keys[i].key = hilbertKey((uint32_t)x, (uint32_t)y);
+        results.keys[i].index = i;
+    }
+    radixSort(results.keys, results.keyScratch);
 
-    root = newRoot;
-}
+    size_t packets = (queries.size() + 31) / 32;
+    std::unique_lock<std::mutex> lock(queryPoolMutex, std::defer_lock);
+    RTreeThreadPool *pool = nullptr;
+    if (queryPool && packets > 1 && lock.try_lock()) {
+        pool = queryPool.get();
+    }
+    unsigned int threads = pool != nullptr ? pool->size() : 1;
+    results.threadHits.resize(std::max<size_t>(results.threadHits.size(), threads));
+    for (unsigned int t = 0; t < threads; ++t) {
+        results.threadHits[t].clear();
+    }
 
-/**
- * Reconstructs this RTree using all of its existing points.
- */
-void RTree::reconstruct() {
-    root->deleteChildren();
-    std::vector<std::shared_ptr<RTreeObject>> objects;
-    for (auto it = objectToBBox.begin(); it != objectToBBox.end(); ++it) {
-        objects.push_back(it->first);
+    // Each query belongs to one packet, so threads write disjoint offsets
+    auto searchOne = [&](unsigned int thread, size_t packet) {
+        size_t start = packet * 32;
+        uint32_t count = std::min<size_t>(queries.size() - start, 32);
+        uint32_t active = count == 32 ? ~0u : (1u << count) - 1;
+        uint32_t counts[32] = {0};
+        LeafTests tests;
+        tests.queries = count;
+        searchPacket(arena[root], queries, &results.keys[start], active,
+                     results.threadHits[thread], counts, tests);
+        for (uint32_t q = 0; q < count; ++q) {
+            results.offsets[results.keys[start + q].index + 1] = counts[q];
+        }
+        recordLeafTests(tests);
+    };
+    if (pool != nullptr) {
+        pool->runStealing(packets, searchOne);
+    } else {
+        for (size_t packet = 0; packet < packets; ++packet) {
+            searchOne(0, packet);
+        }
+    }
+
+    // Group the hits by query, leaving offsets[i] at the end of query i,
+    // then shift the offsets so they mark the starts. The hits of a query
+    // are all in the list of one thread, so the lists are copied in parallel.
+    for (size_t i = 1; i < results.offsets.size(); ++i) {
+        results.offsets[i] += results.offsets[i - 1];
+    }
+    results.objects.resize(results.offsets.back());
+    auto group = [&results](size_t thread) {
+        for (const BatchResults::Hit &hit : results.threadHits[thread]) {
+            results.objects[results.offsets[hit.query]++] = hit.obj;
+        }
+    };
+    if (pool != nullptr) {
+        pool->run(threads, group);
+    } else {
+        group(0);
     }
-    bulkInsert(objects);
+    for (size_t i = queries.size(); i > 0; --i) {
+        results.offsets[i] = results.offsets[i - 1];
+    }
+    results.offsets[0] = 0;
 }
 
 /**
- * Updates this RTree depending on the state of its objects.
+ * Finds the objects in a subtree that intersect the circles of a packet of up
+ * to 32 queries, reading each node once for the whole packet.
  *
- * If one of the objects in the RTree is no longer contained in its bounding
- * box, the RTree is reconstructed.
+ * @param n The root of the subtree.
+ * @param queries The queries of the batch.
+ * @param packet The keys of the queries in the packet.
+ * @param active Bit i is set if query packet[i] meets the subtree.
+ * @param hits The list to add the objects found to.
+ * @param counts Entry i is increased by the number of objects found by query
+ * packet[i].
+ * @param tests Counts of the leaf entries tested, added to.
  */
-void RTree::update() {
-    for (auto it = objectToBBox.begin(); it != objectToBBox.end(); ++it) {
-        Rect objectRect = it->first->rect;
-        Rect bboxRect = it->second;
+void RTree::searchPacket(const RTreeNode &n, const std::vector<Query> &queries,
+        const BatchResults::QueryKey *packet, uint32_t active,
+        std::vector<BatchResults::Hit> &hits, uint32_t *counts,
+        LeafTests &tests) const {
+    RTREE_COUNT(tests.nodes += 1);
+    RTREE_COUNT(tests.leaves += n.level == 0);
+    for (uint32_t base = 0; base < n.numChildren; base += 32) {
+        uint32_t first = n.firstChild + base;
+        uint32_t count = std::min(n.numChildren - base, 32u);
 
-        if (!objectRect.inside(bboxRect)) {
-            reconstruct();
-            break;
+        // Turn the children met by each query into the queries meeting each child
+        uint32_t meets[32];
+        std::fill(meets, meets + count, 0);
+        uint32_t touched = 0;
+        for (uint32_t left = active; left != 0; left &= left - 1) {
+            uint32_t q = lowestBit(left);
+            const Query &query = queries[packet[q].index];
+            uint32_t mask = arena.circleMask(first, count, query.center, query.radius);
+            touched |= mask;
+            for (; mask != 0; mask &= mask - 1) {
+                meets[lowestBit(mask)] |= 1u << q;
+            }
+        }
+
+        for (; touched != 0; touched &= touched - 1) {
+            uint32_t i = lowestBit(touched);
+            const RTreeNode &child = arena[first + i];
+            if (n.level > 0) {
+                searchPacket(child, queries, packet, meets[i], hits, counts, tests);
+                continue;
+            }
+
+            for (uint32_t left = meets[i]; left != 0; left &= left - 1) {
+                uint32_t q = lowestBit(left);
+                const Query &query = queries[packet[q].index];
+                tests.candidates += 1;
+                if (child.obj->rect.doesIntersect(query.center, query.radius)) {
+                    BatchResults::Hit hit = {packet[q].index, child.obj};
+                    hits.push_back(hit);
+                    counts[q] += 1;
+                    RTREE_COUNT(tests.hits += 1);
+                } else {
+                    tests.falsePositives += 1;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Finds the objects closest to a point, nearest first.
+ *
+ * @param p The point to search from.
+ * @param k The maximum number of objects to return.
+ * @param maxDist The maximum distance of a returned object from p. Nothing
+ * is returned if it is negative.
+ * @return A vector of shared pointers to the closest RTreeObject instances.
+ */
+std::vector<std::shared_ptr<RTreeObject>> RTree::nearest(const Vec2 p, size_t k,
+        float maxDist) {
+    std::vector<std::shared_ptr<RTreeObject>> res;
+    nearest(p, k, maxDist, res);
+    return res;
+}
+
+/**
+ * Finds the objects closest to a point, nearest first.
+ *
+ * @param p The point to search from.
+ * @param k The maximum number of objects to return.
+ * @param maxDist The maximum distance of a returned object from p. Nothing
+ * is returned if it is negative.
+ * @param res Vector cleared and filled with the closest objects.
+ */
+void RTree::nearest(const Vec2 p, size_t k, float maxDist,
+        std::vector<std::shared_ptr<RTreeObject>> &res) {
+    res.clear();
+    nearestHeap.clear();
+    // Squaring would turn a negative distance into a positive radius
+    if (maxDist < 0) {
+        return;
+    }
+    auto farther = [](const NearestEntry &a, const NearestEntry &b) {
+        return a.distSquared > b.distSquared;
+    };
+
+    // Read through a const arena, which never copies chunks shared with snapshots
+    const RTreeNodeArena &nodes = arena;
+    float maxDistSquared = maxDist * maxDist;
+    NearestEntry start = {0, root};
+    nearestHeap.push_back(start);
+    // Nearest searches test no padded boxes, so leave them out of the search cost
+    RTREE_COUNT(LeafTests tests);
+    RTREE_COUNT(tests.queries = 0);
+    while (!nearestHeap.empty() && res.size() < k) {
+        std::pop_heap(nearestHeap.begin(), nearestHeap.end(), farther);
+        const RTreeNode &n = nodes[nearestHeap.back().id];
+        nearestHeap.pop_back();
+
+        // Objects are queued with their exact distance, so once one reaches
+        // the front nothing left in the queue can be closer
+        if (n.level < 0) {
+            RTREE_COUNT(tests.hits += 1);
+            res.push_back(n.obj->shared_from_this());
+            continue;
+        }
+
+        RTREE_COUNT(tests.nodes += 1);
+        RTREE_COUNT(tests.leaves += n.level == 0);
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+            const RTreeNode &child = nodes[n.firstChild + i];
+            float d = distanceSquared(n.level == 0 ? child.obj->rect : child.rect, p);
+            if (d <= maxDistSquared) {
+                NearestEntry entry = {d, n.firstChild + i};
+                nearestHeap.push_back(entry);
+                std::push_heap(nearestHeap.begin(), nearestHeap.end(), farther);
+            }
+        }
+    }
+    RTREE_COUNT(recordLeafTests(tests));
+}
+
+/**
+ * Inserts an object into the R-Tree.
+ *
+ * @param obj Shared pointer to the RTreeObject to be inserted.
+ * @return The handle of the object, or its existing handle if it is already
+ * in the tree.
+ */
+RTree::Handle RTree::insert(std::shared_ptr<RTreeObject> obj) {
+    Handle handle = getHandle(obj);
+    if (contains(handle)) {
+        return handle;
+    }
+
+    handle.index = allocateSlot(obj);
+    handle.generation = slots[handle.index].generation;
+    place(handle.index);
+    return handle;
+}
+
+/**
+ * Hands out a free slot for an object.
+ *
+ * @param obj The object.
+ * @return The index of the slot.
+ */
+uint32_t RTree::allocateSlot(const std::shared_ptr<RTreeObject> &obj) {
+    uint32_t slot;
+    if (freeSlots.empty()) {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+        slots.back().generation = 0;
+    } else {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    recordDelta(slot);
+
+    ObjectState &state = slots[slot];
+    state.obj = obj;
+    state.lastOrigin = obj->rect.origin;
+    state.velocity = Vec2(0, 0);
+    state.expectedVelocity = false;
+    objectToHandle[obj.get()] = slot;
+    return slot;
+}
+
+/**
+ * Frees every slot, making all handles stale.
+ */
+void RTree::releaseSlots() {
+    freeSlots.clear();
+    for (size_t i = slots.size(); i > 0; --i) {
+        ObjectState &state = slots[i - 1];
+        if (state.obj) {
+            releaseObject(state);
+            state.generation += 1;
+        }
+        freeSlots.push_back(static_cast<uint32_t>(i - 1));
+    }
+    objectToHandle.clear();
+}
+
+/**
+ * Releases the object of a slot, keeping it alive for the published snapshots
+ * that may still hold it.
+ *
+ * @param state The bookkeeping of the object.
+ */
+void RTree::releaseObject(ObjectState &state) {
+    if (epochs.hasPublished()) {
+        removedObjects.push_back(std::move(state.obj));
+    }
+    state.obj.reset();
+}
+
+/**
+ * Inserts a leaf for an object that has bookkeeping but is not in the tree.
+ *
+ * @param slot The handle index of the object.
+ */
+void RTree::place(uint32_t slot) {
+    // Objects moved by condensing a node get a new bounding box too
+    recordDelta(slot);
+    ObjectState &state = slots[slot];
+    state.bbox = paddedRect(state);
+    RTreeNode entry(state.bbox, -1);
+    entry.obj = state.obj.get();
+    entry.handle = slot;
+
+    arena.reserveEntries(slots.size());
+    reinsertedLevels = 0;
+    insertEntry(entry);
+    while (!reinsertQueue.empty()) {
+        RTreeNode next = reinsertQueue.back();
+        reinsertQueue.pop_back();
+        insertEntry(next);
+    }
+}
+
+/**
+ * Inserts a node into the tree, growing a new root if the root splits.
+ *
+ * @param entry The leaf node holding the object to insert, or an inner
+ * node being reinserted.
+ */
+void RTree::insertEntry(const RTreeNode &entry) {
+    RTreeNode sibling;
+    if (insertHelper(root, entry, sibling)) {
+        // The root sits alone at the start of its block, so the block can
+        // become the children of the new root without moving the old root
+        uint32_t newRoot = arena.allocate();
+        RTreeNode newRootNode(rect, arena[root].level + 1);
+        newRootNode.firstChild = root;
+        newRootNode.numChildren = 2;
+        arena.store(newRoot, newRootNode);
+        arena.store(root + 1, sibling);
+        root = newRoot;
+    }
+}
+
+/**
+ * Removes an object from this RTree.
+ *
+ * @param obj Shared pointer to the RTreeObject to be removed.
+ */
+void RTree::remove(std::shared_ptr<RTreeObject> obj) {
+    remove(getHandle(obj));
+}
+
+/**
+ * Removes an object from this RTree by its handle.
+ *
+ * This walks up from the leaf of the object instead of searching for it, so
+ * it takes time proportional to the height of the tree.
+ *
+ * @param handle The handle of the object. Stale handles are ignored.
+ */
+void RTree::remove(Handle handle) {
+    if (!contains(handle)) {
+        return;
+    }
+
+    recordDelta(handle.index);
+    detach(handle.index);
+
+    ObjectState &state = slots[handle.index];
+    objectToHandle.erase(state.obj.get());
+    releaseObject(state);
+    state.generation += 1;
+    freeSlots.push_back(handle.index);
+}
+
+/**
+ * Moves an object to a new rect.
+ *
+ * The rect of the object is set and, if it left its bounding box, its leaf
+ * is refit or reinserted right away, walking up from the leaf instead of
+ * searching for it.
+ *
+ * @param handle The handle of the object. Stale handles are ignored.
+ * @param rect The new rect of the object.
+ */
+void RTree::move(Handle handle, const Rect &rect) {
+    if (!contains(handle)) {
+        return;
+    }
+
+    ObjectState &state = slots[handle.index];
+    state.obj->rect = rect;
+    if (rect.inside(state.bbox)) {
+        return;
+    }
+
+    recordDelta(handle.index);
+    Rect newBBox = paddedRect(state);
+    if (pendingRoot.valid()) {
+        refitEntry(handle.index, newBBox, true);
+    } else if (!refitEntry(handle.index, newBBox, false)) {
+        detach(handle.index);
+        place(handle.index);
+    }
+}
+
+/**
+ * Returns the handle of an object in this RTree.
+ *
+ * @param obj The object.
+ * @return The handle of the object, or a stale handle if it is not in this
+ * RTree.
+ */
+RTree::Handle RTree::getHandle(const std::shared_ptr<RTreeObject> &obj) const {
+    Handle handle;
+    auto found = objectToHandle.find(obj.get());
+    if (found != objectToHandle.end()) {
+        handle.index = found->second;
+        handle.generation = slots[found->second].generation;
+    }
+    return handle;
+}
+
+/**
+ * Removes the leaf of an object from the tree, keeping its bookkeeping.
+ *
+ * @param slot The handle index of the object.
+ */
+void RTree::detach(uint32_t slot) {
+    std::vector<uint32_t> toReinsert;
+    removeEntry(slot, toReinsert);
+    trimRoot();
+
+    for (auto it = toReinsert.begin(); it != toReinsert.end(); ++it) {
+        place(*it);
+    }
+    trimRoot();
+}
+
+/**
+ * Bulk inserts a vector of objects.
+ *
+ * This replaces any objects already in the RTree, making their handles stale.
+ *
+ * @param objects List of objects to insert.
+ */
+void RTree::bulkInsert(std::vector<std::shared_ptr<RTreeObject>> objects) {
+    discardRebuild();
+    releaseSlots();
+    for (auto it = objects.begin(); it != objects.end(); ++it) {
+        if (objectToHandle.count(it->get()) == 0) {
+            allocateSlot(*it);
+        }
+    }
+
+    // The old tree no longer holds the objects, so its order is useless
+    hilbertOrdered = false;
+    reconstruct();
+}
+
+/**
+ * Reconstructs this RTree using all of its existing points.
+ */
+void RTree::reconstruct() {
+    discardRebuild();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (ObjectState &state : slots) {
+        if (state.obj) {
+            state.bbox = paddedRect(state);
+        }
+    }
+    gatherEntries(true);
+
+    arena.reset();
+    arena.reserveEntries(slots.size());
+    if (buildNodes.empty()) {
+        root = createRoot(0);
+    } else {
+        root = bulkLoad(arena, buildNodes);
+    }
+    hilbertOrdered = bulkLoader == BulkLoader::Hilbert;
+
+    rebuildNs = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+    baselineOverlap = -1;
+    baselineCost = -1;
+}
+
+/**
+ * Fills the bulk load scratch space with a leaf node for every object.
+ *
+ * @param refresh Whether to give each leaf the current padded bounding box
+ * of its object instead of the one stored in the tree.
+ */
+void RTree::gatherEntries(bool refresh) {
+    buildNodes.clear();
+    if (bulkLoader == BulkLoader::Hilbert && hilbertOrdered) {
+        collectEntries(std::as_const(arena)[root], refresh);
+        return;
+    }
+
+    for (size_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].obj) {
+            RTreeNode entry(slots[i].bbox, -1);
+            entry.obj = slots[i].obj.get();
+            entry.handle = static_cast<uint32_t>(i);
+            buildNodes.push_back(entry);
+        }
+    }
+}
+
+/**
+ * Appends the leaf nodes of a subtree to the bulk load scratch space, from
+ * left to right.
+ *
+ * @param n The root of the subtree.
+ * @param refresh Whether to give each leaf the current padded bounding box
+ * of its object instead of the one stored in the tree.
+ */
+void RTree::collectEntries(const RTreeNode &n, bool refresh) {
+    for (uint32_t i = 0; i < n.numChildren; ++i) {
+        const RTreeNode &child = std::as_const(arena)[n.firstChild + i];
+        if (n.level > 0) {
+            collectEntries(child, refresh);
+        } else if (refresh) {
+            RTreeNode entry = child;
+            entry.rect = slots[child.handle].bbox;
+            buildNodes.push_back(entry);
+        } else {
+            buildNodes.push_back(child);
+        }
+    }
+}
+
+/**
+ * Replaces a root with no children by an empty leaf root, and removes
+ * roots with a single child.
+ */
+void RTree::trimRoot() {
+    const RTreeNodeArena &nodes = arena;
+    if (nodes[root].numChildren == 0 && nodes[root].level > 0) {
+        arena.release(nodes[root].firstChild);
+        arena.release(root);
+        root = createRoot(0);
+    }
+
+    while (nodes[root].numChildren == 1 && nodes[root].level > 0) {
+        uint32_t child = nodes[root].firstChild;
+        arena.release(root);
+        root = child;
+    }
+}
+
+/**
+ * Records whether a slot was in the tree when the pending rebuild started, the
+ * first time its object changes during the rebuild.
+ *
+ * @param slot The handle index of the object about to change.
+ */
+void RTree::recordDelta(uint32_t slot) {
+    if (!pendingRoot.valid() || rebuildDelta.count(slot) != 0) {
+        return;
+    }
+    rebuildDelta[slot] = slot < slots.size() && slots[slot].obj != nullptr;
+}
+
+/**
+ * Starts rebuilding the tree on a worker thread from the current bounding
+ * boxes of its objects.
+ */
+void RTree::startRebuild() {
+    gatherEntries(false);
+    if (buildNodes.empty()) {
+        return;
+    }
+
+    // The worker only touches the back arena and the build scratch space,
+    // which the main thread leaves alone until the rebuild is swapped in
+    backArena.reset();
+    backArena.reserveEntries(slots.size());
+    pendingRoot = std::async(std::launch::async, [this]() {
+#ifdef RTREE_STATS
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint32_t built = bulkLoad(backArena, buildNodes);
+        pendingRebuildNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        return built;
+#else
+        return bulkLoad(backArena, buildNodes);
+#endif
+    });
+}
+
+/**
+ * Waits for the pending rebuild, swaps the rebuilt tree in, and patches in
+ * the objects that changed since the rebuild started.
+ */
+void RTree::swapRebuild() {
+    root = pendingRoot.get();
+    RTREE_COUNT(recordRebuild(pendingRebuildNs));
+    baselineOverlap = -1;
+    baselineCost = -1;
+    std::swap(arena, backArena);
+    hilbertOrdered = bulkLoader == BulkLoader::Hilbert;
+
+    // Take out every changed object first, so that objects moved by condensing
+    // a node are not found twice
+    std::vector<uint32_t> toReinsert;
+    for (auto it = rebuildDelta.begin(); it != rebuildDelta.end(); ++it) {
+        if (it->second) {
+            removeEntry(it->first, toReinsert);
+        }
+    }
+    trimRoot();
+
+    for (auto it = toReinsert.begin(); it != toReinsert.end(); ++it) {
+        if (rebuildDelta.count(*it) == 0) {
+            place(*it);
+        }
+    }
+    for (auto it = rebuildDelta.begin(); it != rebuildDelta.end(); ++it) {
+        if (slots[it->first].obj) {
+            place(it->first);
+        }
+    }
+    trimRoot();
+
+    rebuildDelta.clear();
+}
+
+/**
+ * Waits for the pending rebuild, if any, and throws its result away
+ * without counting it in the statistics.
+ */
+void RTree::discardRebuild() {
+    if (pendingRoot.valid()) {
+        pendingRoot.get();
+    }
+    rebuildDelta.clear();
+}
+
+#ifdef RTREE_STATS
+/**
+ * Adds a rebuild started by update() or updateMany() to the statistics.
+ *
+ * @param ns The nanoseconds the rebuild took.
+ */
+void RTree::recordRebuild(uint64_t ns) {
+    statRebuilds += 1;
+    statRebuildNs += ns;
+    statMaxRebuildNs = std::max(statMaxRebuildNs, ns);
+}
+#endif
+
+/**
+ * Sets the fraction of objects that may escape their bounding boxes in a
+ * single update before the RTree is reconstructed.
+ *
+ * @param threshold The escaped fraction in [0, 1] (default is 0.25).
+ */
+void RTree::setRebuildThreshold(float threshold) {
+    rebuildThreshold = threshold;
+}
+
+/**
+ * Sets how update() chooses between fixing escaped objects in place and
+ * rebuilding the tree.
+ *
+ * @param policy The rebuild policy (default is Threshold).
+ * @param degradation The factor by which the overlap and the search cost must
+ * grow for the adaptive policy to rebuild (default is 1.5).
+ * @param interval The number of updates between checks of the quality of the
+ * tree (default is 30).
+ */
+void RTree::setRebuildPolicy(RebuildPolicy policy, float degradation,
+        unsigned int interval) {
+    rebuildPolicy = policy;
+    this->degradation = degradation;
+    qualityInterval = std::max(interval, 1u);
+    updatesSinceCheck = 0;
+    baselineOverlap = -1;
+    baselineCost = -1;
+}
+
+/**
+ * Returns measures of the shape of this tree.
+ *
+ * @return The measures of the tree as it is now.
+ */
+RTree::Quality RTree::quality() const {
+    Quality res;
+    const RTreeNode &top = arena[root];
+    res.height = top.level + 1;
+    res.levels.resize(res.height);
+    measureNode(top, res);
+
+    // Each level holds its total number of children in fill until here
+    double children = 0;
+    for (Quality::Level &level : res.levels) {
+        res.nodes += level.nodes;
+        res.area += level.area;
+        res.overlap += level.overlap;
+        res.deadSpace += level.deadSpace;
+        children += level.fill;
+        level.fill /= (double)level.nodes * maxPerLevel;
+    }
+    res.fill = res.nodes == 1 ? res.levels.back().fill
+                              : (children - top.numChildren) / ((res.nodes - 1.0) * maxPerLevel);
+    return res;
+}
+
+/**
+ * Adds the measures of a subtree to the levels of a Quality.
+ *
+ * @param n The root of the subtree.
+ * @param quality The measures to add to.
+ */
+void RTree::measureNode(const RTreeNode &n, Quality &quality) const {
+    Quality::Level &level = quality.levels[n.level];
+    level.nodes += 1;
+    level.fill += n.numChildren;
+
+    double covered = 0;
+    double overlap = 0;
+    for (uint32_t i = 0; i < n.numChildren; ++i) {
+        const Rect &child = arena[n.firstChild + i].rect;
+        covered += area(child);
+        for (uint32_t j = i + 1; j < n.numChildren; ++j) {
+            overlap += overlapArea(child, arena[n.firstChild + j].rect);
+        }
+    }
+
+    // Objects overlapping each other is not a fault of the tree
+    if (n.level > 0) {
+        quality.levels[n.level - 1].overlap += overlap;
+    }
+    if (&n != &arena[root]) {
+        // Pairwise overlaps correct the covered area for all but triple overlaps
+        level.area += area(n.rect);
+        level.deadSpace += std::max(0.0, area(n.rect) - (covered - overlap));
+        quality.underfull += n.numChildren < minPerLevel;
+    }
+
+    if (n.level > 0) {
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+            measureNode(arena[n.firstChild + i], quality);
+        }
+    }
+}
+
+/**
+ * Sets whether circular searches test all children of a node at once
+ * against the structure-of-arrays copy of their bounding boxes.
+ *
+ * @param enabled Whether to use the SIMD child test (default is true).
+ */
+void RTree::setSimdQueries(bool enabled) {
+    simdQueries = enabled;
+}
+
+/**
+ * Sets the number of threads used by bulkInsert and reconstruct.
+ *
+ * @param threads The number of threads, including the calling thread
+ * (default is 1).
+ */
+void RTree::setBuildThreads(unsigned int threads) {
+    discardRebuild();
+    buildThreads = std::max(threads, 1u);
+    if (buildThreads == 1) {
+        buildPool.reset();
+    } else if (!buildPool || buildPool->size() != buildThreads) {
+        buildPool.reset(new RTreeThreadPool(buildThreads));
+    }
+}
+
+/**
+ * Publishes the current state of this tree as the snapshot returned by read().
+ */
+void RTree::publish() {
+    std::unique_ptr<RTreeSnapshot> snapshot(new RTreeSnapshot(arena.share(), root));
+    epochs.publish(std::move(snapshot), removedObjects);
+}
+
+/**
+ * Sets the number of threads used by searchBatch.
+ *
+ * @param threads The number of threads, including the calling thread
+ * (default is 1).
+ */
+void RTree::setQueryThreads(unsigned int threads) {
+    threads = std::max(threads, 1u);
+    if (threads == 1) {
+        queryPool.reset();
+    } else if (!queryPool || queryPool->size() != threads) {
+        queryPool.reset(new RTreeThreadPool(threads));
+    }
+}
+
+/**
+ * Sets the algorithm used by insert.
+ *
+ * This also selects the split policy that goes with the strategy,
+ * Quadratic for Linear and RStar for RStar, which setSplitPolicy can
+ * change afterwards.
+ *
+ * @param strategy The insertion algorithm (default is Linear).
+ */
+void RTree::setInsertStrategy(InsertStrategy strategy) {
+    insertStrategy = strategy;
+    splitPolicy = strategy == InsertStrategy::RStar ? SplitPolicy::RStar
+                                                  : SplitPolicy::Quadratic;
+}
+
+/**
+ * Sets the algorithm used to split nodes that overflow during insert.
+ *
+ * @param policy The split algorithm (default is Quadratic).
+ */
+void RTree::setSplitPolicy(SplitPolicy policy) {
+    splitPolicy = policy;
+}
+
+/**
+ * Sets the algorithm used by bulkInsert and reconstruct.
+ *
+ * @param loader The bulk loading algorithm (default is STR).
+ */
+void RTree::setBulkLoader(BulkLoader loader) {
+    discardRebuild();
+    bulkLoader = loader;
+}
+
+/**
+ * Sets how the bounding box of each object is padded.
+ *
+ * @param mode The padding mode (default is Fixed).
+ * @param frames The number of updates a velocity-padded box should stay
+ * valid (default is 10).
+ * @param padding The padding on each side of a velocity-padded box
+ * (default is 1).
+ */
+void RTree::setPaddingMode(PaddingMode mode, float frames, float padding) {
+    paddingMode = mode;
+    paddingFrames = frames;
+    minPadding = padding;
+}
+
+/**
+ * Sets the expected movement of an object per update, used instead of an
+ * estimate by velocity padding.
+ *
+ * @param obj An object in this RTree.
+ * @param velocity The expected movement per update.
+ */
+void RTree::setVelocity(const std::shared_ptr<RTreeObject> &obj, const Vec2 &velocity) {
+    Handle handle = getHandle(obj);
+    if (contains(handle)) {
+        slots[handle.index].velocity = velocity;
+        slots[handle.index].expectedVelocity = true;
+    }
+}
+
+/**
+ * Goes back to estimating the velocity of an object from its movement.
+ *
+ * @param obj An object in this RTree.
+ */
+void RTree::clearVelocity(const std::shared_ptr<RTreeObject> &obj) {
+    Handle handle = getHandle(obj);
+    if (contains(handle)) {
+        slots[handle.index].expectedVelocity = false;
+    }
+}
+
+/**
+ * Returns the counters for tuning the padding of bounding boxes.
+ *
+ * @return The counters since the RTree was created or last reset.
+ */
+RTree::PaddingStats RTree::getPaddingStats() const {
+    PaddingStats stats;
+    stats.checks = escapeChecks;
+    stats.escapes = escapeCount;
+    stats.candidates = leafCandidates.load(std::memory_order_relaxed);
+    stats.falsePositives = leafFalsePositives.load(std::memory_order_relaxed);
+    return stats;
+}
+
+/**
+ * Resets the counters for tuning the padding of bounding boxes.
+ */
+void RTree::resetPaddingStats() {
+    escapeChecks = 0;
+    escapeCount = 0;
+    leafCandidates.store(0, std::memory_order_relaxed);
+    leafFalsePositives.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Returns the counters of the work done by searches and updates.
+ *
+ * @return The counters since the RTree was created or last reset, or zeros
+ * without RTREE_STATS.
+ */
+RTree::Stats RTree::stats() const {
+    Stats res = {};
+#ifdef RTREE_STATS
+    res.nodesVisited = statNodes.load(std::memory_order_relaxed);
+    res.leavesTested = statLeaves.load(std::memory_order_relaxed);
+    res.hits = statHits.load(std::memory_order_relaxed);
+    res.falsePositives = statFalsePositives.load(std::memory_order_relaxed);
+    res.splits = statSplits;
+    res.reinsertions = statReinsertions;
+    res.rebuilds = statRebuilds;
+    res.rebuildNs = statRebuildNs;
+    res.maxRebuildNs = statMaxRebuildNs;
+#endif
+    return res;
+}
+
+/**
+ * Resets the counters of the work done by searches and updates.
+ */
+void RTree::resetStats() {
+#ifdef RTREE_STATS
+    statNodes.store(0, std::memory_order_relaxed);
+    statLeaves.store(0, std::memory_order_relaxed);
+    statHits.store(0, std::memory_order_relaxed);
+    statFalsePositives.store(0, std::memory_order_relaxed);
+    statSplits = 0;
+    statReinsertions = 0;
+    statRebuilds = 0;
+    statRebuildNs = 0;
+    statMaxRebuildNs = 0;
+#endif
+}
+
+/**
+ * Sets whether update() rebuilds the tree on a worker thread.
+ *
+ * @param enabled Whether to rebuild in the background (default is false).
+ */
+void RTree::setBackgroundRebuild(bool enabled) {
+    if (!enabled) {
+        finishRebuild();
+    }
+    backgroundRebuild = enabled;
+}
+
+/**
+ * Waits for a pending background rebuild, if any, and swaps it in.
+ */
+void RTree::finishRebuild() {
+    if (pendingRoot.valid()) {
+        swapRebuild();
+    }
+}
+
+/**
+ * Updates this RTree depending on the state of its objects.
+ *
+ * Objects that are no longer contained in their bounding boxes are refit in
+ * their leaf if their new bounding box still fits it, and otherwise removed
+ * and reinserted. If the rebuild policy finds a rebuild cheaper, or
+ * finds that the tree has degraded, the RTree is reconstructed instead, or
+ * rebuilt on a worker thread if background rebuilds are enabled.
+ */
+void RTree::update() {
+    if (pendingRoot.valid() &&
+            pendingRoot.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        swapRebuild();
+    }
+
+    std::vector<uint32_t> escaped;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        ObjectState &state = slots[i];
+        if (!state.obj) {
+            continue;
+        }
+        trackMotion(state);
+        if (!state.obj->rect.inside(state.bbox)) {
+            escaped.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    escapeChecks += objectToHandle.size();
+    escapeCount += escaped.size();
+    refitEscaped(escaped);
+    checkQuality();
+}
+
+/**
+ * Moves a batch of objects to new rects.
+ *
+ * Only the objects in the batch are checked against their bounding boxes, so
+ * this takes time in proportion to the batch rather than the tree. Escaped
+ * objects are handled as in update(), grouped by leaf so that each leaf and
+ * its ancestors are refit once per batch.
+ *
+ * @param moves The handle of each object and its new rect. Stale handles are
+ * ignored.
+ */
+void RTree::updateMany(const std::vector<std::pair<Handle, Rect>> &moves) {
+    if (pendingRoot.valid() &&
+            pendingRoot.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        swapRebuild();
+    }
+
+    std::vector<uint32_t> escaped;
+    for (const std::pair<Handle, Rect> &move : moves) {
+        if (!contains(move.first)) {
+            continue;
+        }
+        ObjectState &state = slots[move.first.index];
+        state.obj->rect = move.second;
+        trackMotion(state);
+        escapeChecks += 1;
+        if (!move.second.inside(state.bbox)) {
+            escaped.push_back(move.first.index);
+        }
+    }
+    escapeCount += escaped.size();
+    refitEscaped(escaped);
+    checkQuality();
+}
+
+/**
+ * Updates the motion of an object from its rect, for velocity padding.
+ *
+ * @param state The bookkeeping of the object.
+ */
+void RTree::trackMotion(ObjectState &state) {
+    // Smooth the estimate, since objects rarely move the same every update
+    Vec2 origin = state.obj->rect.origin;
+    if (paddingMode == PaddingMode::Velocity && !state.expectedVelocity) {
+        Vec2 moved = origin - state.lastOrigin;
+        state.velocity = (state.velocity + moved) * 0.5f;
+    }
+    state.lastOrigin = origin;
+}
+
+/**
+ * Gives new bounding boxes to objects that escaped their old ones.
+ *
+ * The objects are grouped by leaf, so that each leaf and its ancestors are
+ * enlarged at most once, and only the objects that no longer fit their leaf
+ * are reinserted. If the rebuild policy finds a rebuild cheaper, the RTree is
+ * reconstructed or rebuilt instead.
+ *
+ * @param escaped The handle indices of the objects. This is overwritten.
+ */
+void RTree::refitEscaped(std::vector<uint32_t> &escaped) {
+    if (escaped.empty()) {
+        return;
+    }
+    bool rebuild = shouldRebuild(escaped.size());
+    if (rebuild && !backgroundRebuild) {
+        reconstruct();
+        RTREE_COUNT(recordRebuild(static_cast<uint64_t>(rebuildNs)));
+        return;
+    }
+
+    // Until the background rebuild is swapped in, keep the current tree
+    // correct as cheaply as possible by enlarging nodes instead of reinserting
+    bool grow = rebuild || pendingRoot.valid();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t fixed = escaped.size();
+    leafMoves.clear();
+    for (uint32_t slot : escaped) {
+        recordDelta(slot);
+        LeafMove move;
+        move.leaf = arena.parentOf(arena.entryOf(slot));
+        move.slot = slot;
+        leafMoves.push_back(move);
+    }
+    std::sort(leafMoves.begin(), leafMoves.end(),
+              [](const LeafMove &a, const LeafMove &b) { return a.leaf < b.leaf; });
+
+    // Refitting in place moves no nodes, so every leaf found above stays valid
+    escaped.clear();
+    for (size_t i = 0; i < leafMoves.size();) {
+        uint32_t leaf = leafMoves[i].leaf;
+        Rect grown;
+        bool refit = false;
+        for (; i < leafMoves.size() && leafMoves[i].leaf == leaf; ++i) {
+            uint32_t slot = leafMoves[i].slot;
+            Rect newBBox = paddedRect(slots[slot]);
+            if (!grow && !arena[leaf].rect.contains(newBBox)) {
+                escaped.push_back(slot);
+                continue;
+            }
+
+            uint32_t entry = arena.entryOf(slot);
+            arena[entry].rect = newBBox;
+            arena.syncBounds(entry);
+            slots[slot].bbox = newBBox;
+            if (refit) {
+                grown += newBBox;
+            } else {
+                grown = newBBox;
+                refit = true;
+            }
+        }
+
+        // The root spans the whole RTree and is never tested
+        if (grow && refit) {
+            for (uint32_t n = leaf; n != root; n = arena.parentOf(n)) {
+                arena[n].rect += grown;
+                arena.syncBounds(n);
+            }
         }
     }
+
+    for (uint32_t slot : escaped) {
+        detach(slot);
+        place(slot);
+    }
+
+    // Enlarging nodes is cheaper than fixing them properly, so only time the latter
+    if (!grow) {
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count() / fixed;
+        fixNs = fixNs == 0 ? ns : 0.75 * fixNs + 0.25 * ns;
+    }
+    if (grow && !pendingRoot.valid()) {
+        startRebuild();
+    }
 }
 
-void RTree::draw(const std::shared_ptr<SpriteBatch> &batch) {
-    root->draw(batch);
+/**
+ * Returns whether update() should rebuild the tree instead of fixing the
+ * objects that escaped their bounding boxes.
+ *
+ * @param escaped The number of objects that escaped.
+ * @return Whether to rebuild.
+ */
+bool RTree::shouldRebuild(size_t escaped) const {
+    if (rebuildPolicy == RebuildPolicy::Threshold) {
+        return escaped > rebuildThreshold * objectToHandle.size();
+    }
+
+    // Fix the objects once to learn what fixing costs, unless most escaped
+    if (fixNs == 0 || rebuildNs == 0) {
+        return escaped > objectToHandle.size() / 2;
+    }
+    return escaped * fixNs > rebuildNs;
+}
+
+/**
+ * Rebuilds the tree for the adaptive policy if both its overlap and the cost
+ * of the searches since the last check have degraded.
+ */
+void RTree::checkQuality() {
+    if (rebuildPolicy != RebuildPolicy::Adaptive || pendingRoot.valid() ||
+            ++updatesSinceCheck < qualityInterval) {
+        return;
+    }
+    updatesSinceCheck = 0;
+
+    // Measure the searches since the last check by the leaf entries each
+    // tested, skipping intervals without searches, without candidates or
+    // with reset counters, so that a zero cost never becomes the baseline
+    uint64_t candidates = leafCandidates.load(std::memory_order_relaxed);
+    uint64_t queries = leafQueries.load(std::memory_order_relaxed);
+    bool measured = candidates > checkedCandidates && queries > checkedQueries;
+    double cost = measured ? (double)(candidates - checkedCandidates) /
+                             (queries - checkedQueries) : 0;
+    checkedCandidates = candidates;
+    checkedQueries = queries;
+    if (!measured) {
+        return;
+    }
+
+    // The first interval after a rebuild sets the baseline
+    if (baselineCost < 0) {
+        baselineCost = cost;
+        baselineOverlap = quality().overlapRatio();
+        return;
+    }
+    if (cost <= baselineCost * degradation ||
+            quality().overlapRatio() <= baselineOverlap * degradation) {
+        return;
+    }
+
+    if (backgroundRebuild) {
+        startRebuild();
+    } else {
+        reconstruct();
+        RTREE_COUNT(recordRebuild(static_cast<uint64_t>(rebuildNs)));
+    }
+}
+
+/**
+ * Appends a string representation of a subtree to a string.
+ *
+ * @param n The root of the subtree.
+ * @param height The height of the tree.
+ * @param res The string to append to.
+ */
+void RTree::printNode(const RTreeNode &n, int height, std::string &res) const {
+    std::string indentation = "";
+    for (int i = 0; i < height - n.level; ++i) {
+        indentation += " ";
+    }
+    res += indentation + "[(" + std::to_string(n.rect.getMinX()) +
+           ", " + std::to_string(n.rect.getMinY()) + "), (" +
+           std::to_string(n.rect.getMaxX()) + ", " +
+           std::to_string(n.rect.getMaxY()) + ")]\n";
+    if (n.level >= 0) {
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+            printNode(arena[n.firstChild + i], height, res);
+        }
+    }
+}
+
+/**
+ * Returns a string representation of this tree.
+ *
+ * @return std::string
+ */
+std::string RTree::print() const {
+    std::string res = "";
+    printNode(arena[root], arena[root].level, res);
+    return res;
 }
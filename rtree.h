@@ -1,25 +1,334 @@
 #ifndef RTREE_H
 #define RTREE_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "rtreearena.h"
+#include "rtreegeometry.h"
 #include "rtreenode.h"
 #include "rtreeobject.h"
+#include "rtreepool.h"
+#include "rtreeshape.h"
+#include "rtreesimd.h"
+#include "rtreesnapshot.h"
+#include "rtreesplit.h"
 
-#include <cugl/cugl.h>
-
-using namespace cugl;
+// Define RTREE_STATS to count the work done by searches and updates for
+// RTree::stats(). Otherwise the counting statements compile to nothing.
+#ifdef RTREE_STATS
+#define RTREE_COUNT(statement) statement
+#else
+#define RTREE_COUNT(statement)
+#endif
 
 /**
  * Class representing an R-tree, a type of height-balanced tree used for
  * range queries. This specification also includes bounding boxes of a certain
  * buffer size around leaf nodes. Leaf nodes point to objects contained within
  * the tree.
+ *
+ * All nodes are stored in an RTreeNodeArena, with the children of each node
+ * stored next to each other. Searches test all children of a node against the
+ * query at once using the arena's structure-of-arrays bounding boxes.
+ *
+ * Any number of threads may call the const search methods (search,
+ * searchInside, query, searchBatch, overlappingPairs and join) at once, as
+ * long as no thread modifies the tree meanwhile. They only read the nodes and
+ * objects, and the search statistics are atomic. search() and searchInside()
+ * copy a shared_ptr for every object found, which is race free but makes
+ * threads contend on the reference counts of popular objects, so concurrent
+ * callers should prefer query() or searchBatch(), which return raw pointers.
+ * nearest() reuses a queue owned by the tree and is not safe to call from
+ * several threads. A background rebuild only writes to its own arena, so
+ * searches may run while it is pending.
+ *
+ * Threads that search while another thread modifies the tree use snapshots
+ * instead. The writer calls publish(), and readers call read() to pin the
+ * latest published snapshot without locking. A snapshot never changes, and
+ * shares its nodes with the tree until the tree writes to them.
  */
 class RTree {
+public:
+    /** The bounding boxes compared when looking for overlapping objects. */
+    enum class PairTest {
+        /** Compare the padded bounding boxes that the tree stores. */
+        Buffered,
+        /** Compare the exact rects of the objects. */
+        Tight
+    };
+
+    /** The algorithm used to insert single objects. */
+    enum class InsertStrategy {
+        /** Guttman's least area enlargement, splitting with the quadratic split. */
+        Linear,
+        /**
+         * The R*-tree algorithm: least overlap enlargement above the leaves,
+         * forced reinsertion on the first overflow of each level, and the
+         * margin and overlap minimizing split.
+         */
+        RStar
+    };
+
+    /** The algorithm used to split overflowing nodes. */
+    enum class SplitPolicy {
+        /** Guttman's linear split (RTreeLinearSplit). */
+        Linear,
+        /** Guttman's quadratic split (RTreeQuadraticSplit). */
+        Quadratic,
+        /** The sort-based split of the R*-tree (RTreeRStarSplit). */
+        RStar
+    };
+
+    /** The algorithm used by bulkInsert and reconstruct. */
+    enum class BulkLoader {
+        /** Sort-Tile-Recursive: sort into vertical slices, then within them. */
+        STR,
+        /** Sort by the Hilbert key of each object center and pack in order. */
+        Hilbert
+    };
+
+    /** How the bounding box of each object is padded. */
+    enum class PaddingMode {
+        /** Pad every side of every object by the buffer size. */
+        Fixed,
+        /**
+         * Stretch each box along the velocity of its object so that it stays
+         * valid for a number of updates, plus a small padding on every side.
+         */
+        Velocity
+    };
+
+    /** How update() chooses between fixing escaped objects and a rebuild. */
+    enum class RebuildPolicy {
+        /** Rebuild when more than the rebuild threshold of objects escaped. */
+        Threshold,
+        /**
+         * Rebuild when fixing the escaped objects one at a time is measured to
+         * cost more than the last rebuild did, or when both the overlap of
+         * the nodes and the cost of recent searches have degraded since the
+         * last rebuild.
+         */
+        Adaptive
+    };
+
+    /** Counters for tuning the padding of bounding boxes. */
+    struct PaddingStats {
+        /** The number of object checks made by update(). */
+        uint64_t checks;
+        /** The number of checks that found an object outside its bounding box. */
+        uint64_t escapes;
+        /** The number of objects whose padded bounding box matched a search. */
+        uint64_t candidates;
+        /** The number of candidates whose exact rect did not match the search. */
+        uint64_t falsePositives;
+
+        /**
+         * Returns the fraction of checks that found an escaped object.
+         *
+         * @return The escape rate, or 0 if nothing was checked.
+         */
+        double escapeRate() const { return checks == 0 ? 0 : (double)escapes / checks; }
+
+        /**
+         * Returns the fraction of candidates that did not match their search.
+         *
+         * @return The false positive rate, or 0 if there were no candidates.
+         */
+        double falsePositiveRate() const {
+            return candidates == 0 ? 0 : (double)falsePositives / candidates;
+        }
+    };
+
+    /**
+     * Counters of the work done by searches and updates, for finding out why
+     * they are slow.
+     *
+     * The counters are only kept when the tree is built with RTREE_STATS
+     * defined, and are all zero otherwise.
+     */
+    struct Stats {
+        /** The nodes whose children searches tested. */
+        uint64_t nodesVisited;
+        /** The leaves whose objects searches tested. */
+        uint64_t leavesTested;
+        /** The objects found by searches. */
+        uint64_t hits;
+        /**
+         * The objects whose padded bounding box matched a search but whose
+         * exact rect did not, counted where the padded boxes are tested.
+         */
+        uint64_t falsePositives;
+        /** The nodes split by insertions. */
+        uint64_t splits;
+        /** The objects and nodes reinserted after condensing or overflowing a node. */
+        uint64_t reinsertions;
+        /** The times update() or updateMany() rebuilt the tree. */
+        uint64_t rebuilds;
+        /** The nanoseconds spent in those rebuilds, in total. */
+        uint64_t rebuildNs;
+        /** The nanoseconds spent in the longest of those rebuilds. */
+        uint64_t maxRebuildNs;
+    };
+
+    /**
+     * Measures of the shape of an RTree, returned by quality().
+     *
+     * Areas are those of the padded bounding boxes of the nodes. The root is
+     * left out of the areas and dead space, since it always spans the whole
+     * tree, and out of the fill unless it is the only node.
+     */
+    struct Quality {
+        /** The measures of the nodes of one level. */
+        struct Level {
+            /** The number of nodes. */
+            size_t nodes = 0;
+            /** The total area of the nodes. */
+            double area = 0;
+            /** The total area shared by pairs of nodes with the same parent. */
+            double overlap = 0;
+            /** The total area of the nodes not covered by any of their children. */
+            double deadSpace = 0;
+            /** The mean number of children per node over the maximum. */
+            double fill = 0;
+        };
+
+        /** The number of levels of nodes, which is 1 when the root is a leaf. */
+        int height = 0;
+        /** The number of nodes. */
+        size_t nodes = 0;
+        /** The number of nodes other than the root with too few children. */
+        size_t underfull = 0;
+        /** The total area of the nodes. */
+        double area = 0;
+        /** The total area shared by pairs of nodes with the same parent. */
+        double overlap = 0;
+        /** The total area of the nodes not covered by any of their children. */
+        double deadSpace = 0;
+        /** The mean number of children per node over the maximum. */
+        double fill = 0;
+        /** The measures of each level, from the leaves at 0 up to the root. */
+        std::vector<Level> levels;
+
+        /**
+         * Returns the overlap of the nodes as a fraction of their area.
+         *
+         * @return The overlap ratio, or 0 if the nodes have no area.
+         */
+        double overlapRatio() const { return area > 0 ? overlap / area : 0; }
+    };
+
+    /**
+     * Handle of an object in an RTree, returned by insert().
+     *
+     * A handle finds the leaf of its object without hashing or searching the
+     * tree. It goes stale when its object is removed, even if the index is
+     * reused by another object.
+     */
+    struct Handle {
+        /** The index of the slot of the object. */
+        uint32_t index = UINT32_MAX;
+        /** The number of objects that held the slot before this one. */
+        uint32_t generation = 0;
+    };
+
+    /** A circular search in a batch of searches. */
+    struct Query {
+        /** The center of the circle to search. */
+        Vec2 center;
+        /** The radius of the circle to search. */
+        float radius;
+    };
+
+    /**
+     * The results of a batch of searches, stored flat.
+     *
+     * The objects found by query i are objects[offsets[i]] up to but not
+     * including objects[offsets[i + 1]], in no particular order. Reusing the
+     * same results across batches avoids allocating once they have grown to
+     * size.
+     */
+    class BatchResults {
+    public:
+        /** Where the objects of each query start, followed by the total count. */
+        std::vector<size_t> offsets;
+        /** The objects found by every query, grouped by query. */
+        std::vector<RTreeObject *> objects;
+
+        /**
+         * Returns the number of queries in the batch.
+         *
+         * @return The number of queries.
+         */
+        size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+        /**
+         * Returns the number of objects found by a query.
+         *
+         * @param i The index of the query in the batch.
+         * @return The number of objects it found.
+         */
+        size_t count(size_t i) const { return offsets[i + 1] - offsets[i]; }
+
+        /**
+         * Returns the first object found by a query.
+         *
+         * @param i The index of the query in the batch.
+         * @return A pointer to its first object, followed by count(i) - 1 more.
+         */
+        RTreeObject *const *begin(size_t i) const { return objects.data() + offsets[i]; }
+
+        /**
+         * Returns the end of the objects found by a query.
+         *
+         * @param i The index of the query in the batch.
+         * @return A pointer past its last object.
+         */
+        RTreeObject *const *end(size_t i) const { return objects.data() + offsets[i + 1]; }
+
+    private:
+        friend class RTree;
+
+        /** The Hilbert key of the center of a query. */
+        struct QueryKey {
+            /** The position of the center along the Hilbert curve. */
+            uint32_t key;
+            /** The index of the query in the batch. */
+            uint32_t index;
+        };
+
+        /** An object found by a query, before the objects are grouped. */
+        struct Hit {
+            /** The index of the query in the batch. */
+            uint32_t query;
+            /** The object. */
+            RTreeObject *obj;
+        };
+
+        /** The queries in Hilbert order of their centers. */
+        std::vector<QueryKey> keys;
+
+        /** Scratch space for the radix sort of the keys. */
+        std::vector<QueryKey> keyScratch;
+
+        /**
+         * The objects found by each thread of the search, in the order its
+         * traversal found them.
+         */
+        std::vector<std::vector<Hit>> threadHits;
+    };
+
 private:
     /** The bounding box of the entire RTree. */
     Rect rect;
@@ -33,8 +342,268 @@ private:
     /** The amount of padding on each side of the bounding box of each object. */
     unsigned int bufferSize;
 
-    /** Map with objects as keys and the corresponding bounding boxes as values. */
-    std::unordered_map<std::shared_ptr<RTreeObject>, Rect> objectToBBox;
+    /**
+     * The fraction of objects that may escape their bounding boxes in a single
+     * update before the RTree is reconstructed instead of patched incrementally.
+     */
+    float rebuildThreshold;
+
+    /** How update() chooses between fixing escaped objects and a rebuild. */
+    RebuildPolicy rebuildPolicy;
+
+    /**
+     * How many times the overlap ratio and the search cost must grow over
+     * their values after the last rebuild for the adaptive policy to rebuild.
+     */
+    float degradation;
+
+    /** The updates between checks of the quality of the tree by the adaptive policy. */
+    unsigned int qualityInterval;
+
+    /** The updates since the adaptive policy last checked the quality of the tree. */
+    unsigned int updatesSinceCheck;
+
+    /** The nanoseconds the last reconstruct took, or 0 before the first. */
+    double rebuildNs;
+
+    /** The smoothed nanoseconds per escaped object fixed in place, or 0 before the first. */
+    double fixNs;
+
+    /** The overlap ratio after the last rebuild, or -1 until it is measured. */
+    double baselineOverlap;
+
+    /** The leaf entries tested per search after the last rebuild, or -1 until measured. */
+    double baselineCost;
+
+    /** The leaf candidates counted when the quality was last checked. */
+    uint64_t checkedCandidates;
+
+    /** The searches counted when the quality was last checked. */
+    uint64_t checkedQueries;
+
+    /** Whether searches use the SIMD test of all children of a node at once. */
+    bool simdQueries;
+
+    /** The storage for every node of this RTree. */
+    RTreeNodeArena arena;
+
+    /** The id of the root node of this RTree. */
+    uint32_t root;
+
+    /** The bookkeeping for an object in the RTree. */
+    struct ObjectState {
+        /** The object, kept alive while it is in the RTree, or null if the slot is free. */
+        std::shared_ptr<RTreeObject> obj;
+        /** The generation of the handle of the current or next object in the slot. */
+        uint32_t generation;
+        /** The padded bounding box of the object in the RTree. */
+        Rect bbox;
+        /** The origin of the object at the last update. */
+        Vec2 lastOrigin;
+        /** The expected or estimated movement of the object per update. */
+        Vec2 velocity;
+        /** Whether the velocity was supplied by the caller. */
+        bool expectedVelocity;
+    };
+
+    /** The bookkeeping of each object, indexed by the index of its handle. */
+    std::vector<ObjectState> slots;
+
+    /** The indices of free slots, reused before the slots grow. */
+    std::vector<uint32_t> freeSlots;
+
+    /** Map with objects as keys and the indices of their handles as values. */
+    std::unordered_map<const RTreeObject *, uint32_t> objectToHandle;
+
+    /** How the bounding box of each object is padded. */
+    PaddingMode paddingMode;
+
+    /** The number of updates a velocity-padded bounding box should stay valid. */
+    float paddingFrames;
+
+    /** The padding on each side of a velocity-padded bounding box. */
+    float minPadding;
+
+    /** The number of object checks made by update(). */
+    uint64_t escapeChecks;
+
+    /** The number of checks that found an object outside its bounding box. */
+    uint64_t escapeCount;
+
+    /** The number of objects whose padded bounding box matched a search. */
+    mutable std::atomic<uint64_t> leafCandidates;
+
+    /** The number of candidates whose exact rect did not match the search. */
+    mutable std::atomic<uint64_t> leafFalsePositives;
+
+    /** The number of searches that counted their leaf tests, for the rebuild policy. */
+    mutable std::atomic<uint64_t> leafQueries;
+
+    /** Counts of the leaf entries tested by a single search. */
+    struct LeafTests {
+        /** The number of searches counted, more than one for a packet of a batch. */
+        uint64_t queries = 1;
+        /** The entries whose padded bounding box matched the search. */
+        uint64_t candidates = 0;
+        /** The entries whose exact rect then did not match. */
+        uint64_t falsePositives = 0;
+#ifdef RTREE_STATS
+        /** The nodes whose children were tested. */
+        uint64_t nodes = 0;
+        /** The leaves whose entries were tested. */
+        uint64_t leaves = 0;
+        /** The objects found. */
+        uint64_t hits = 0;
+#endif
+    };
+
+#ifdef RTREE_STATS
+    /** The nodes whose children searches tested. */
+    mutable std::atomic<uint64_t> statNodes;
+
+    /** The leaves whose objects searches tested. */
+    mutable std::atomic<uint64_t> statLeaves;
+
+    /** The objects found by searches. */
+    mutable std::atomic<uint64_t> statHits;
+
+    /** The candidates found by searches whose exact rect did not match. */
+    mutable std::atomic<uint64_t> statFalsePositives;
+
+    /** The nodes split by insertions. */
+    uint64_t statSplits;
+
+    /** The objects and nodes reinserted after condensing or overflowing a node. */
+    uint64_t statReinsertions;
+
+    /** The times update() or updateMany() rebuilt the tree. */
+    uint64_t statRebuilds;
+
+    /** The nanoseconds spent in rebuilds, in total. */
+    uint64_t statRebuildNs;
+
+    /** The nanoseconds spent in the longest rebuild. */
+    uint64_t statMaxRebuildNs;
+
+    /** The nanoseconds the pending background rebuild took, set by its worker. */
+    uint64_t pendingRebuildNs;
+#endif
+
+    /** Scratch space for the nodes of the level being built by a bulk insertion. */
+    std::vector<RTreeNode> buildNodes;
+
+    /** Scratch space for the parents of the level being built by a bulk insertion. */
+    std::vector<RTreeNode> buildParents;
+
+    /** The number of threads used to bulk load. */
+    unsigned int buildThreads;
+
+    /** The threads used to bulk load, created when more than one is used. */
+    std::unique_ptr<RTreeThreadPool> buildPool;
+
+    /** The threads used by searchBatch, created when more than one is used. */
+    std::unique_ptr<RTreeThreadPool> queryPool;
+
+    /**
+     * Held by the searchBatch using the query pool. Other batches running at
+     * the same time search on their own thread instead.
+     */
+    mutable std::mutex queryPoolMutex;
+
+    /** The snapshots published to readers. */
+    RTreeEpochs epochs;
+
+    /**
+     * Objects removed since the last snapshot was published, kept alive until
+     * that snapshot is freed.
+     */
+    std::vector<std::shared_ptr<RTreeObject>> removedObjects;
+
+    /**
+     * Whether update() rebuilds the tree on a worker thread instead of
+     * reconstructing it in place.
+     */
+    bool backgroundRebuild;
+
+    /** The storage of the tree being rebuilt on a worker thread. */
+    RTreeNodeArena backArena;
+
+    /**
+     * The slots whose objects were inserted, removed or moved since the
+     * rebuild started, to be patched into the rebuilt tree when it is swapped
+     * in, and whether each slot was in the tree when the rebuild started.
+     */
+    std::unordered_map<uint32_t, bool> rebuildDelta;
+
+    /** The root of the tree being rebuilt, once the worker finishes. */
+    std::future<uint32_t> pendingRoot;
+
+    /** The algorithm used to insert single objects. */
+    InsertStrategy insertStrategy;
+
+    /** The algorithm used to split overflowing nodes. */
+    SplitPolicy splitPolicy;
+
+    /**
+     * Bit i is set once a node at level i has had entries forced out for
+     * reinsertion during the current R* insertion.
+     */
+    uint64_t reinsertedLevels;
+
+    /** Entries forced out of their nodes and waiting to be reinserted. */
+    std::vector<RTreeNode> reinsertQueue;
+
+    /** The algorithm used by bulkInsert and reconstruct. */
+    BulkLoader bulkLoader;
+
+    /**
+     * Whether the entries of the tree, read from left to right, are in nearly
+     * sorted Hilbert order because the tree was last built by the Hilbert
+     * loader.
+     */
+    bool hilbertOrdered;
+
+    /** The Hilbert key of a node being bulk loaded. */
+    struct HilbertKey {
+        /** The position of the center of the node along the Hilbert curve. */
+        uint32_t key;
+        /** The index of the node in the list being loaded. */
+        uint32_t index;
+    };
+
+    /** Scratch space for the keys of a Hilbert bulk load. */
+    std::vector<HilbertKey> hilbertKeys;
+
+    /** Scratch space for the radix sort of a Hilbert bulk load. */
+    std::vector<HilbertKey> hilbertScratch;
+
+    /** Scratch space for the children of a node being split. */
+    std::vector<RTreeNode> splitEntries;
+
+    /** An escaped object and the leaf node holding it. */
+    struct LeafMove {
+        /** The id of the leaf node. */
+        uint32_t leaf;
+        /** The handle index of the object. */
+        uint32_t slot;
+    };
+
+    /** Scratch space for the escaped objects of an update, sorted by leaf. */
+    std::vector<LeafMove> leafMoves;
+
+    /** An entry in the priority queue of a nearest-neighbor search. */
+    struct NearestEntry {
+        /** The squared distance from the query point to the node. */
+        float distSquared;
+        /** The id of the node. */
+        uint32_t id;
+    };
+
+    /**
+     * The priority queue of nearest-neighbor searches, kept between searches so
+     * that its storage is reused.
+     */
+    std::vector<NearestEntry> nearestHeap;
 
     /**
      * Fills a vector with objects in a subtree that intersect with a given
@@ -44,168 +613,1324 @@ private:
      * @param center The center of the circle.
      * @param radius The radius of the circle.
      * @param res Vector containing objects that intersect the area.
+     * @param tests Counts of the leaf entries tested, added to.
      */
-    void findIntersections(RTreeNode &n,
+    void findIntersections(const RTreeNode &n,
         const Vec2 center, float radius,
-            std::vector<std::shared_ptr<RTreeObject>> &res);
+            std::vector<std::shared_ptr<RTreeObject>> &res, LeafTests &tests) const;
+
+    /**
+     * Calls a visitor with every object in a subtree that matches a shape.
+     *
+     * Children are tested against the shape all at once. Subtrees whose
+     * bounding boxes lie entirely inside the shape are visited whole, without
+     * testing their nodes. Their objects are still tested exactly, since an
+     * object may have left its padded box since the last update.
+     *
+     * @param n The root of the subtree.
+     * @param shape The query shape.
+     * @param visitor The visitor to call with each matching object.
+     * @param tests Counts of the leaf entries tested, added to.
+     * @return false if the visitor stopped the query, and true otherwise.
+     */
+    template <typename Shape, typename Visitor>
+    bool visitNode(const RTreeNode &n, const Shape &shape, Visitor &visitor,
+        LeafTests &tests) const;
+
+    /**
+     * Adds the leaf tests of a search to the padding statistics.
+     *
+     * @param tests Counts of the leaf entries tested by the search.
+     */
+    void recordLeafTests(const LeafTests &tests) const {
+        leafCandidates.fetch_add(tests.candidates, std::memory_order_relaxed);
+        leafFalsePositives.fetch_add(tests.falsePositives, std::memory_order_relaxed);
+        leafQueries.fetch_add(tests.queries, std::memory_order_relaxed);
+#ifdef RTREE_STATS
+        statNodes.fetch_add(tests.nodes, std::memory_order_relaxed);
+        statLeaves.fetch_add(tests.leaves, std::memory_order_relaxed);
+        statHits.fetch_add(tests.hits, std::memory_order_relaxed);
+        statFalsePositives.fetch_add(tests.falsePositives, std::memory_order_relaxed);
+#endif
+    }
+
+    /**
+     * Calls a visitor with every object in a subtree that lies inside a query
+     * shape and matches it exactly.
+     *
+     * @param n The root of the subtree.
+     * @param shape The query shape.
+     * @param visitor The visitor to call with each matching object.
+     * @param tests Counts of the nodes visited and leaf entries tested, added
+     * to.
+     * @return false if the visitor stopped the query, and true otherwise.
+     */
+    template <typename Shape, typename Visitor>
+    bool visitSubtree(const RTreeNode &n, const Shape &shape, Visitor &visitor,
+        LeafTests &tests) const;
+
+    /**
+     * Finds the objects in a subtree that intersect the circles of a packet
+     * of up to 32 queries, reading each node once for the whole packet.
+     *
+     * @param n The root of the subtree.
+     * @param queries The queries of the batch.
+     * @param packet The keys of the queries in the packet.
+     * @param active Bit i is set if query packet[i] meets the subtree.
+     * @param hits The list to add the objects found to.
+     * @param counts Entry i is increased by the number of objects found by
+     * query packet[i].
+     * @param tests Counts of the leaf entries tested, added to.
+     */
+    void searchPacket(const RTreeNode &n, const std::vector<Query> &queries,
+        const BatchResults::QueryKey *packet, uint32_t active,
+        std::vector<BatchResults::Hit> &hits, uint32_t *counts,
+        LeafTests &tests) const;
+
+    /**
+     * Calls a visitor with one or more objects.
+     *
+     * Visitors that return nothing never stop the query.
+     *
+     * @param visitor The visitor to call.
+     * @param objs The objects to visit.
+     * @return false if the visitor stopped the query, and true otherwise.
+     */
+    template <typename Visitor, typename... Objects>
+    static bool callVisitor(Visitor &visitor, Objects &... objs);
+
+    /**
+     * Reports every overlapping pair of objects within a subtree once.
+     *
+     * @param n The root of the subtree.
+     * @param test Which bounding boxes of the objects must overlap.
+     * @param callback The callback to call with each pair.
+     * @return false if the callback stopped the join, and true otherwise.
+     */
+    template <typename Callback>
+    bool selfJoin(const RTreeNode &n, PairTest test, Callback &callback) const;
+
+    /**
+     * Reports every overlapping pair of objects with one object in each of two
+     * disjoint subtrees of the same height.
+     *
+     * @param a The root of the first subtree.
+     * @param b The root of the second subtree.
+     * @param test Which bounding boxes of the objects must overlap.
+     * @param callback The callback to call with each pair.
+     * @return false if the callback stopped the join, and true otherwise.
+     */
+    template <typename Callback>
+    bool joinNodes(const RTreeNode &a, const RTreeNode &b, PairTest test,
+        Callback &callback) const;
+
+    /**
+     * Reports every overlapping pair of objects with one object in a subtree
+     * of one tree and the other in a subtree of another tree.
+     *
+     * The subtrees may have different heights. The bounding boxes of the two
+     * subtrees must already be known to overlap.
+     *
+     * @param ta The tree containing a.
+     * @param a The root of the first subtree.
+     * @param tb The tree containing b.
+     * @param b The root of the second subtree.
+     * @param test Which bounding boxes of the objects must overlap.
+     * @param callback The callback to call with each pair.
+     * @return false if the callback stopped the join, and true otherwise.
+     */
+    template <typename Callback>
+    static bool crossJoin(const RTree &ta, const RTreeNode &a, const RTree &tb,
+        const RTreeNode &b, PairTest test, Callback &callback);
+
+    /**
+     * Tests two leaf nodes and reports their objects if they overlap.
+     *
+     * @param a The first leaf node.
+     * @param b The second leaf node.
+     * @param test Which bounding boxes of the objects must overlap.
+     * @param callback The callback to call with the pair.
+     * @return false if the callback stopped the join, and true otherwise.
+     */
+    template <typename Callback>
+    static bool reportPair(const RTreeNode &a, const RTreeNode &b, PairTest test,
+        Callback &callback);
+
+    /**
+     * Splits an overflowing node into two nodes using the split policy.
+     *
+     * The first group of children is written back into the block of the node,
+     * and the second group into a newly allocated block.
+     *
+     * @param n The id of the node to be split.
+     * @param entries The children of the node, including the one that overflowed it.
+     * @return The new sibling of the node, holding the second group.
+     */
+    RTreeNode splitNode(uint32_t n, std::vector<RTreeNode> &entries);
 
     /**
-     * Given a node to split, selects two children of the original node to become
-     * the first children of the two new nodes.
+     * Splits an overflowing node into two nodes using a split policy.
      *
-     * @param n The node to split
-     * @return Pair of RTreeNode shared pointers containing the first two elements of the two new nodes
+     * @param n The id of the node to be split.
+     * @param entries The children of the node, including the one that overflowed it.
+     * @return The new sibling of the node, holding the second group.
      */
-    std::pair <std::shared_ptr<RTreeNode>,
-    std::shared_ptr<RTreeNode>> pickSeeds(RTreeNode &n);
+    template <typename Policy>
+    RTreeNode splitWith(uint32_t n, std::vector<RTreeNode> &entries);
 
     /**
-     * Selects one remaining child of the node to be split to be added to a newly
-     * split node.
+     * Removes the children of an overflowing node that lie farthest from its
+     * center and queues them for reinsertion.
      *
-     * @param children Vector of children of the node to be split
-     * @param added Set of children already assigned to a new node
-     * @param bbox_1 The bounding box of the first new node
-     * @param bbox_2 The bounding box of the second new node
-     * @return RTreeNode* The next child to be added to a new node
+     * @param n The id of the overflowing node.
+     * @param entries The children of the node, including the one that overflowed it.
      */
-    std::shared_ptr<RTreeNode> pickNext(const std::vector<std::shared_ptr<RTreeNode>> &children,
-        const std::unordered_set <std::shared_ptr<RTreeNode>> &added, const Rect &bbox_1, const Rect &bbox_2);
+    void forceReinsert(uint32_t n, std::vector<RTreeNode> &entries);
 
     /**
-     * Splits an overflowing node into two nodes.
+     * Picks the child of a node to insert an entry into using the R*-tree
+     * criteria.
      *
-     * @param n The node to be split.
-     * @return The two resulting nodes from the split.
+     * If the children hold the level the entry is inserted at, the child whose
+     * overlap with its siblings grows least is chosen. Otherwise, the child
+     * whose area grows least is chosen. Ties go to the smaller child.
+     *
+     * @param n The parent of the candidate child nodes.
+     * @param entry The entry to insert.
+     * @return The id of the chosen child.
      */
-    std::pair <std::shared_ptr<RTreeNode>, std::shared_ptr<RTreeNode>> linearSplit(RTreeNode &n);
-    
+    uint32_t chooseSubtree(const RTreeNode &n, const RTreeNode &entry) const;
+
     /**
      * Given a rectangle, determine the child bounding box such that the union of the new rectangle and
      * child bounding box is minimal.
      *
      * @param n The parent of the candidate child nodes to be checked.
      * @param containerRect The bounding box of the object to be inserted
-     * @return The node that can expand to fit containerRect with minimal area increase.
+     * @return The id of the node that can expand to fit containerRect with minimal area increase.
      */
-    std::shared_ptr<RTreeNode> findBestBB(RTreeNode &n, const Rect &containerRect);
-    
+    uint32_t findBestBB(const RTreeNode &n, const Rect &containerRect) const;
+
     /**
-     * Inserts an object into a node.
+     * Adds a child to a node, splitting the node if it is already full.
      *
-     * @param n The node into which the object will be inserted.
-     * @param obj The object to insert.
+     * @param n The id of the node to add the child to.
+     * @param child The child to add.
+     * @param sibling Set to the new sibling of the node if it was split.
+     * @return Whether the node was split.
      */
-    void insertHelper(RTreeNode &n, std::shared_ptr<RTreeObject> &obj);
+    bool addChild(uint32_t n, const RTreeNode &child, RTreeNode &sibling);
 
     /**
-     * Searches for an object in a given node, and if it is found, removes it.
+     * Removes a child from a node by moving the last child into its place.
      *
-     * If removing the object causes the node to have too few children, the
-     * remaining children are removed and returned.
+     * @param n The id of the node to remove the child from.
+     * @param index The index of the child among the children of the node.
+     */
+    void removeChild(uint32_t n, uint32_t index);
+
+    /**
+     * Inserts a node into a subtree, at the level just below its own.
      *
-     * @param n The node to search.
-     * @param obj The object to be removed.
-     * @return A list of objects to reinsert into the tree.
+     * @param n The id of the node into which the entry will be inserted.
+     * @param entry The leaf node holding the object to insert, or an inner
+     * node being reinserted.
+     * @param sibling Set to the new sibling of the node if it was split.
+     * @return Whether the node was split.
      */
-    std::vector<std::shared_ptr<RTreeObject>> removeHelper(std::shared_ptr<RTreeNode> &n, std::shared_ptr<RTreeObject> &obj);
-    
+    bool insertHelper(uint32_t n, const RTreeNode &entry, RTreeNode &sibling);
+
     /**
-     * Partition a list of child nodes into a certain amount of new parent nodes.
+     * Inserts a node into the tree, growing a new root if the root splits.
      *
-     * @param nodes Vector of nodes to be partitioned
-     * @return Vector of the new children nodes
+     * @param entry The leaf node holding the object to insert, or an inner
+     * node being reinserted.
      */
-    std::vector<std::shared_ptr<RTreeNode>> strSplit(std::vector<std::shared_ptr<RTreeNode>> &nodes, int level);
-    
+    void insertEntry(const RTreeNode &entry);
+
     /**
-     * Build an R-Tree from the bottom up using a list of nodes.
+     * Removes the leaf node of an object, walking up from it to the root.
      *
-     * Uses the Sort-Tile-Recursive (STR) algorithm to build an rtree using a bulk
-     * insertion. This builds trees faster than inserting objects one-by-one and
-     * results in less overlaps between subtrees.
+     * If removing the object causes a node to have too few children, that
+     * node is removed and the objects beneath it are added to toReinsert.
+     * The bounding boxes of the other nodes on the path are shrunk.
      *
-     * Precondition: nodes is non-empty.
+     * @param slot The handle index of the object.
+     * @param toReinsert Vector of handle indices that must be reinserted.
+     * @return Whether the object was in the tree.
+     */
+    bool removeEntry(uint32_t slot, std::vector<uint32_t> &toReinsert);
+
+    /**
+     * Appends the handle index of every object stored in a subtree to a
+     * vector, and records that they are no longer in the tree.
      *
-     * @param nodes The list of nodes to be bulk inserted into the RTree.
-     * @return The root node of the new RTree.
+     * @param n The root of the subtree.
+     * @param res Vector to append the handle indices to.
      */
-    std::shared_ptr<RTreeNode> sortTileRecursive(std::vector<std::shared_ptr<RTreeNode>> &nodes);
+    void collectObjects(const RTreeNode &n, std::vector<uint32_t> &res);
 
-public:
-    /** The root node of this RTree. */
-    std::shared_ptr<RTreeNode> root;
+    /**
+     * Returns the blocks of every descendant of a node to the arena.
+     *
+     * @param n The root of the subtree.
+     */
+    void releaseSubtree(const RTreeNode &n);
 
     /**
-     * Resets to an empty RTree.
+     * Replaces the bounding box of an object in place.
+     *
+     * Without growing, this only succeeds if the new bounding box still fits
+     * inside the leaf node that holds the object. Growing enlarges the nodes
+     * on the path to the object until they contain the new bounding box,
+     * which keeps searches correct without restructuring the tree, at the
+     * cost of looser nodes.
+     *
+     * @param slot The handle index of the object.
+     * @param newBBox The new bounding box of the object.
+     * @param grow Whether to enlarge the nodes above the object.
+     * @return Whether the bounding box was replaced.
      */
-    void clear();
+    bool refitEntry(uint32_t slot, const Rect &newBBox, bool grow);
 
     /**
-     * Creates an RTree.
+     * Replaces a root with no children by an empty leaf root, and removes
+     * roots with a single child.
+     */
+    void trimRoot();
+
+    /**
+     * Updates the motion of an object from its rect, for velocity padding.
      *
-     * @param x The x-coordinate of the lower-left corner of the root rectangle.
-     * @param y The y-coordinate of the lower-left corner of the root
-     * rectangle.
-     * @param width The x-coordinate of the upper-right corner of the root
-     * rectangle.
-     * @param height The y-coordinate of the upper-right corner of the root
-     * rectangle.
-     * @param maxChildren Maximum number of children per node (default is 5).
-     * @param minChildren Minimum number of children per node (default is 2).
-     * @param buffer The amount of padding on each side of the bounding box of each object.
+     * @param state The bookkeeping of the object.
      */
-    RTree(float x, float y, float width, float height,
-                             unsigned int maxChildren = 5, unsigned int minChildren = 2,
-                             float buffer = 20);
+    void trackMotion(ObjectState &state);
 
     /**
-     * Searches for objects within a given circular area.
+     * Gives new bounding boxes to objects that escaped their old ones.
      *
-     * @param center The center of the circle to search.
-     * @param radius The radius of the circle to search.
-     * @return A vector of shared pointers to RTreeObject instances intersecting
-     * the search area.
+     * The objects are grouped by leaf, so that each leaf and its ancestors
+     * are enlarged at most once, and only the objects that no longer fit
+     * their leaf are reinserted. If the rebuild policy finds a rebuild
+     * cheaper, the RTree is reconstructed or rebuilt instead.
+     *
+     * @param escaped The handle indices of the objects. This is overwritten.
      */
-    std::vector<std::shared_ptr<RTreeObject>> search(const Vec2 center, float radius);
+    void refitEscaped(std::vector<uint32_t> &escaped);
 
     /**
-     * Inserts an object into the R-Tree.
+     * Records whether a slot was in the tree when the pending rebuild started,
+     * the first time its object changes during the rebuild.
      *
-     * @param obj Shared pointer to the RTreeObject to be inserted.
-     * @param buffer Optional buffer value to expand the object's bounding box
-     * (default is 20).
+     * @param slot The handle index of the object about to change.
      */
-    void insert(std::shared_ptr<RTreeObject> obj);
+    void recordDelta(uint32_t slot);
 
     /**
-     * Removes an object from this RTree.
+     * Starts rebuilding the tree on a worker thread from the current bounding
+     * boxes of its objects.
+     */
+    void startRebuild();
+
+    /**
+     * Waits for the pending rebuild, swaps the rebuilt tree in, and patches in
+     * the objects that changed since the rebuild started.
+     */
+    void swapRebuild();
+
+    /**
+     * Waits for the pending rebuild, if any, and throws its result away
+     * without counting it in the statistics.
+     */
+    void discardRebuild();
+
+#ifdef RTREE_STATS
+    /**
+     * Adds a rebuild started by update() or updateMany() to the statistics.
      *
-     * @param obj Shared pointer to the RTreeObject to be removed.
+     * @param ns The nanoseconds the rebuild took.
      */
-    void remove(std::shared_ptr<RTreeObject> obj);
-    
+    void recordRebuild(uint64_t ns);
+#endif
+
     /**
-     * Bulk inserts a vector of objects.
+     * Returns the bounding box of an object padded for the padding mode.
      *
-     * @param objects List of objects to insert.
+     * @param state The bookkeeping of the object.
+     * @return The padded bounding box.
      */
-    void bulkInsert(std::vector<std::shared_ptr<RTreeObject>> objects);
+    Rect paddedRect(const ObjectState &state) const;
 
     /**
-     * Reconstructs this RTree using all of its existing points.
+     * Removes the leaf of an object from the tree, keeping its bookkeeping.
+     *
+     * @param slot The handle index of the object.
      */
-    void reconstruct();
+    void detach(uint32_t slot);
 
     /**
-     * Updates this RTree depending on the state of its objects.
+     * Inserts a leaf for an object that has bookkeeping but is not in the tree.
      *
-     * If one of the objects in the RTree is no longer contained in its bounding
-     * box, the RTree is reconstructed.
+     * @param slot The handle index of the object.
      */
-    void update();
+    void place(uint32_t slot);
 
-    void draw(const std::shared_ptr<SpriteBatch> &batch);
-};
+    /**
+     * Hands out a free slot for an object.
+     *
+     * @param obj The object.
+     * @return The index of the slot.
+     */
+    uint32_t allocateSlot(const std::shared_ptr<RTreeObject> &obj);
+
+    /**
+     * Frees every slot, making all handles stale.
+     */
+    void releaseSlots();
+
+    /**
+     * Creates an empty root node spanning the bounding box of the RTree.
+     *
+     * @param level The level of the new root.
+     * @return The id of the new root.
+     */
+    uint32_t createRoot(int level);
+
+    /**
+     * Partition a list of child nodes into a certain amount of new parent nodes.
+     *
+     * The children of each new parent are written into their own block of the
+     * arena. Large levels are sorted and packed across the build threads.
+     *
+     * @param target The arena to write the children into.
+     * @param nodes Vector of nodes to be partitioned
+     * @param level The level of the new parent nodes
+     * @param parents Vector to fill with the new parent nodes
+     */
+    void strSplit(RTreeNodeArena &target, std::vector<RTreeNode> &nodes, int level,
+        std::vector<RTreeNode> &parents);
+
+    /**
+     * Build an R-Tree from the bottom up using a list of nodes.
+     *
+     * Uses the Sort-Tile-Recursive (STR) algorithm to build an rtree using a bulk
+     * insertion. This builds trees faster than inserting objects one-by-one and
+     * results in less overlaps between subtrees.
+     *
+     * Precondition: nodes is non-empty.
+     *
+     * @param target The arena to build the tree in.
+     * @param nodes The list of nodes to be bulk inserted into the RTree.
+     * @return The id of the root node of the new RTree.
+     */
+    uint32_t sortTileRecursive(RTreeNodeArena &target, std::vector<RTreeNode> &nodes);
+
+    /**
+     * Build an R-Tree from the bottom up by packing nodes in Hilbert order.
+     *
+     * Each node gets the Hilbert key of its center within the bounding box of
+     * all nodes. If the nodes are nearly in key order already, they are
+     * insertion sorted, and otherwise radix sorted. Runs of maxPerLevel
+     * consecutive nodes then become parents, level by level.
+     *
+     * Precondition: nodes is non-empty.
+     *
+     * @param target The arena to build the tree in.
+     * @param nodes The list of nodes to be bulk inserted into the RTree.
+     * @return The id of the root node of the new RTree.
+     */
+    uint32_t hilbertPack(RTreeNodeArena &target, std::vector<RTreeNode> &nodes);
+
+    /**
+     * Build an R-Tree from the bottom up with the bulk loader of this tree.
+     *
+     * Precondition: nodes is non-empty.
+     *
+     * @param target The arena to build the tree in.
+     * @param nodes The list of nodes to be bulk inserted into the RTree.
+     * @return The id of the root node of the new RTree.
+     */
+    uint32_t bulkLoad(RTreeNodeArena &target, std::vector<RTreeNode> &nodes);
+
+    /**
+     * Fills the bulk load scratch space with a leaf node for every object.
+     *
+     * If the tree is in Hilbert order, the leaves are collected from left to
+     * right so that a Hilbert rebuild starts from nearly sorted input.
+     *
+     * @param refresh Whether to give each leaf the current padded bounding box
+     * of its object instead of the one stored in the tree.
+     */
+    void gatherEntries(bool refresh);
+
+    /**
+     * Appends the leaf nodes of a subtree to the bulk load scratch space, from
+     * left to right.
+     *
+     * @param n The root of the subtree.
+     * @param refresh Whether to give each leaf the current padded bounding box
+     * of its object instead of the one stored in the tree.
+     */
+    void collectEntries(const RTreeNode &n, bool refresh);
+
+    /**
+     * Returns whether update() should rebuild the tree instead of fixing the
+     * objects that escaped their bounding boxes.
+     *
+     * @param escaped The number of objects that escaped.
+     * @return Whether to rebuild.
+     */
+    bool shouldRebuild(size_t escaped) const;
+
+    /**
+     * Rebuilds the tree for the adaptive policy if both its overlap and the
+     * cost of the searches since the last check have degraded.
+     */
+    void checkQuality();
+
+    /**
+     * Adds the measures of a subtree to the levels of a Quality.
+     *
+     * @param n The root of the subtree.
+     * @param quality The measures to add to.
+     */
+    void measureNode(const RTreeNode &n, Quality &quality) const;
+
+    /**
+     * Appends a string representation of a subtree to a string.
+     *
+     * @param n The root of the subtree.
+     * @param height The height of the tree.
+     * @param res The string to append to.
+     */
+    void printNode(const RTreeNode &n, int height, std::string &res) const;
+
+    /**
+     * Calls a callback with the bounding box and level of every node of a
+     * subtree, parents before their children.
+     *
+     * @param n The root of the subtree.
+     * @param callback The callback.
+     */
+    template <typename Callback>
+    void visitBoundsNode(const RTreeNode &n, Callback &callback) const;
+
+    /**
+     * Releases the object of a slot, keeping it alive for the published
+     * snapshots that may still hold it.
+     *
+     * @param state The bookkeeping of the object.
+     */
+    void releaseObject(ObjectState &state);
+
+public:
+    /**
+     * Resets to an empty RTree.
+     */
+    void clear();
+
+    /**
+     * Creates an RTree.
+     *
+     * @param x The x-coordinate of the lower-left corner of the root rectangle.
+     * @param y The y-coordinate of the lower-left corner of the root
+     * rectangle.
+     * @param width The x-coordinate of the upper-right corner of the root
+     * rectangle.
+     * @param height The y-coordinate of the upper-right corner of the root
+     * rectangle.
+     * @param maxChildren Maximum number of children per node (default is 5). This
+     * is clamped to RTreeNodeArena::CHUNK_SIZE (512), since the children of a
+     * node share one block of the arena.
+     * @param minChildren Minimum number of children per node (default is 2).
+     * @param buffer The amount of padding on each side of the bounding box of each object
+     * under fixed padding.
+     */
+    RTree(float x, float y, float width, float height,
+                             unsigned int maxChildren = 5, unsigned int minChildren = 2,
+                             float buffer = 20);
+
+    /**
+     * Destroys this RTree, waiting for a pending background rebuild.
+     */
+    ~RTree();
+
+    /**
+     * Searches for objects within a given circular area.
+     *
+     * @param center The center of the circle to search.
+     * @param radius The radius of the circle to search.
+     * @return A vector of shared pointers to RTreeObject instances intersecting
+     * the search area.
+     */
+    std::vector<std::shared_ptr<RTreeObject>> search(const Vec2 center, float radius) const;
+
+    /**
+     * Searches for objects that intersect a given rectangular area.
+     *
+     * @param area The rectangle to search.
+     * @return A vector of shared pointers to RTreeObject instances intersecting
+     * the search area.
+     */
+    std::vector<std::shared_ptr<RTreeObject>> search(const Rect &area) const;
+
+    /**
+     * Searches for objects that lie entirely inside a given rectangular area.
+     *
+     * @param area The rectangle to search.
+     * @return A vector of shared pointers to RTreeObject instances contained in
+     * the search area.
+     */
+    std::vector<std::shared_ptr<RTreeObject>> searchInside(const Rect &area) const;
+
+    /**
+     * Searches for the objects within each of a batch of circular areas.
+     *
+     * The queries are sorted along a Hilbert curve and traversed in packets
+     * of nearby queries, so each node is read once per packet instead of once
+     * per query and the upper levels of the tree stay in cache. The results
+     * are written flat into a caller-owned BatchResults, without allocating
+     * a vector per query. Each query finds the same objects as search() with
+     * the same circle.
+     *
+     * With more than one query thread, the packets are spread over the query
+     * pool with work stealing and each thread writes to its own list of
+     * results, which are then copied into place without locks. The pool runs
+     * one batch at a time, so a batch started while another is using it runs
+     * on its calling thread alone.
+     *
+     * @param queries The circles to search.
+     * @param results Cleared and filled with the objects found by each query.
+     */
+    void searchBatch(const std::vector<Query> &queries, BatchResults &results) const;
+
+    /**
+     * Calls a visitor with every object that matches a query shape.
+     *
+     * The shape is an RTreeCircle, RTreeIntersects or RTreeInside, or a Rect,
+     * which matches the objects intersecting it. The visitor is called with an
+     * RTreeObject& and may return false to stop the query early. Nothing is
+     * allocated and no reference counts are touched, so the cost per object
+     * found is close to that of a plain loop.
+     *
+     * @param shape The query shape.
+     * @param visitor The visitor to call with each matching object.
+     * @return false if the visitor stopped the query, and true otherwise.
+     */
+    template <typename Shape, typename Visitor>
+    bool query(const Shape &shape, Visitor &&visitor) const {
+        LeafTests tests;
+        bool finished = visitNode(arena[root], toQueryShape(shape), visitor, tests);
+        recordLeafTests(tests);
+        return finished;
+    }
+
+    /**
+     * Appends every object that matches a query shape to a caller-owned vector.
+     *
+     * Reusing the same vector across queries avoids allocating once it has
+     * grown to size.
+     *
+     * @param shape The query shape, as for query with a visitor.
+     * @param res The vector to append matching objects to.
+     */
+    template <typename Shape>
+    void query(const Shape &shape, std::vector<RTreeObject *> &res) const {
+        query(shape, [&res](RTreeObject &obj) { res.push_back(&obj); });
+    }
+
+    /**
+     * Calls a callback once with every pair of objects in this RTree whose
+     * bounding boxes overlap.
+     *
+     * The tree is joined with itself in a single simultaneous traversal, so
+     * each pair is reported exactly once, in no particular order. The callback
+     * is called with two RTreeObject& and may return false to stop early.
+     *
+     * @param callback The callback to call with each pair.
+     * @param test Which bounding boxes of the objects must overlap (default is
+     * their exact rects).
+     * @return false if the callback stopped the join, and true otherwise.
+     */
+    template <typename Callback>
+    bool overlappingPairs(Callback &&callback, PairTest test = PairTest::Tight) const {
+        return selfJoin(arena[root], test, callback);
+    }
+
+    /**
+     * Calls a callback with every pair of objects, one from each of two RTrees,
+     * whose bounding boxes overlap.
+     *
+     * Both hierarchies are descended together, always splitting the larger of
+     * the two current nodes, and pairs of nodes whose bounding boxes do not
+     * overlap are skipped. The trees may have different
+     * heights, fanouts and buffer sizes. The callback is called with an
+     * RTreeObject& from a and an RTreeObject& from b, and may return false to
+     * stop early.
+     *
+     * @param a The first tree.
+     * @param b The second tree.
+     * @param callback The callback to call with each pair.
+     * @param test Which bounding boxes of the objects must overlap (default is
+     * their exact rects).
+     * @return false if the callback stopped the join, and true otherwise.
+     */
+    template <typename Callback>
+    static bool join(const RTree &a, const RTree &b, Callback &&callback,
+            PairTest test = PairTest::Tight) {
+        // The roots span the whole area of their trees, so start one level down
+        const RTreeNode &rootA = a.arena[a.root];
+        const RTreeNode &rootB = b.arena[b.root];
+        for (uint32_t i = 0; i < rootA.numChildren; ++i) {
+            const RTreeNode &childA = a.arena[rootA.firstChild + i];
+            for (uint32_t base = 0; base < rootB.numChildren; base += 32) {
+                uint32_t first = rootB.firstChild + base;
+                uint32_t inside;
+                uint32_t mask = b.arena.rectMask(first, std::min(rootB.numChildren - base, 32u),
+                                                 childA.rect, inside);
+                while (mask != 0) {
+                    const RTreeNode &childB = b.arena[first + lowestBit(mask)];
+                    mask &= mask - 1;
+                    if (!crossJoin(a, childA, b, childB, test, callback)) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Finds the objects closest to a point, nearest first.
+     *
+     * Nodes are visited best-first in order of the distance from the point to
+     * their bounding boxes, and objects are ranked by the distance to their
+     * exact rect. Objects that contain the point are at distance 0.
+     *
+     * @param p The point to search from.
+     * @param k The maximum number of objects to return.
+     * @param maxDist The maximum distance of a returned object from p. Nothing
+     * is returned if it is negative.
+     * @return A vector of shared pointers to the closest RTreeObject instances.
+     */
+    std::vector<std::shared_ptr<RTreeObject>> nearest(const Vec2 p, size_t k,
+        float maxDist = std::numeric_limits<float>::infinity());
+
+    /**
+     * Finds the objects closest to a point, nearest first.
+     *
+     * This fills a caller-owned vector, so that repeated searches with the
+     * same vector do not allocate once it and the internal queue have grown
+     * to size.
+     *
+     * @param p The point to search from.
+     * @param k The maximum number of objects to return.
+     * @param maxDist The maximum distance of a returned object from p. Nothing
+     * is returned if it is negative.
+     * @param res Vector cleared and filled with the closest objects.
+     */
+    void nearest(const Vec2 p, size_t k, float maxDist,
+        std::vector<std::shared_ptr<RTreeObject>> &res);
+
+    /**
+     * Inserts an object into the R-Tree.
+     *
+     * @param obj Shared pointer to the RTreeObject to be inserted.
+     * @return The handle of the object, or its existing handle if it is
+     * already in the tree.
+     */
+    Handle insert(std::shared_ptr<RTreeObject> obj);
+
+    /**
+     * Removes an object from this RTree.
+     *
+     * @param obj Shared pointer to the RTreeObject to be removed.
+     */
+    void remove(std::shared_ptr<RTreeObject> obj);
+
+    /**
+     * Removes an object from this RTree by its handle.
+     *
+     * This walks up from the leaf of the object instead of searching for it,
+     * so it takes time proportional to the height of the tree.
+     *
+     * @param handle The handle of the object. Stale handles are ignored.
+     */
+    void remove(Handle handle);
+
+    /**
+     * Moves an object to a new rect.
+     *
+     * The rect of the object is set and, if it left its bounding box, its
+     * leaf is refit or reinserted right away, walking up from the leaf
+     * instead of searching for it.
+     *
+     * @param handle The handle of the object. Stale handles are ignored.
+     * @param rect The new rect of the object.
+     */
+    void move(Handle handle, const Rect &rect);
+
+    /**
+     * Returns whether a handle refers to an object in this RTree.
+     *
+     * @param handle The handle.
+     * @return Whether the handle is not stale.
+     */
+    bool contains(Handle handle) const {
+        return handle.index < slots.size() && slots[handle.index].obj &&
+               slots[handle.index].generation == handle.generation;
+    }
+
+    /**
+     * Returns the handle of an object in this RTree.
+     *
+     * @param obj The object.
+     * @return The handle of the object, or a stale handle if it is not in
+     * this RTree.
+     */
+    Handle getHandle(const std::shared_ptr<RTreeObject> &obj) const;
+
+    /**
+     * Bulk inserts a vector of objects.
+     *
+     * This replaces any objects already in the RTree, making their handles
+     * stale.
+     *
+     * @param objects List of objects to insert.
+     */
+    void bulkInsert(std::vector<std::shared_ptr<RTreeObject>> objects);
+
+    /**
+     * Reconstructs this RTree using all of its existing points.
+     */
+    void reconstruct();
+
+    /**
+     * Sets the fraction of objects that may escape their bounding boxes in a
+     * single update before the RTree is reconstructed.
+     *
+     * A threshold of 0 reconstructs the tree whenever any object escapes, and a
+     * threshold of 1 never reconstructs it from update().
+     *
+     * @param threshold The escaped fraction in [0, 1] (default is 0.25).
+     */
+    void setRebuildThreshold(float threshold);
+
+    /**
+     * Sets how update() chooses between fixing escaped objects in place and
+     * rebuilding the tree.
+     *
+     * The threshold policy rebuilds when more than the rebuild threshold of
+     * objects escaped in one update. The adaptive policy instead times the
+     * fixes and the rebuilds, and rebuilds when fixing the escaped objects
+     * would cost more than the last rebuild. Every interval updates it also
+     * compares the leaf entries tested per search since the last check, and
+     * the overlap ratio of the nodes, against their values after the last
+     * rebuild, and rebuilds if both grew by the degradation factor. Searches
+     * that stay cheap never cause a rebuild, however much the nodes overlap.
+     * Rebuilds run on a worker thread if background rebuilds are enabled.
+     *
+     * @param policy The rebuild policy (default is Threshold).
+     * @param degradation The factor by which the overlap and the search cost
+     * must grow for the adaptive policy to rebuild (default is 1.5).
+     * @param interval The number of updates between checks of the quality of
+     * the tree (default is 30).
+     */
+    void setRebuildPolicy(RebuildPolicy policy, float degradation = 1.5f,
+                          unsigned int interval = 30);
+
+    /**
+     * Returns measures of the shape of this tree: the area, overlap, dead
+     * space and fill of its nodes, in total and per level, and its height.
+     *
+     * This visits every node, testing each pair of siblings.
+     *
+     * @return The measures of the tree as it is now.
+     */
+    Quality quality() const;
+
+    /**
+     * Sets whether circular searches test all children of a node at once
+     * against the structure-of-arrays copy of their bounding boxes.
+     *
+     * The test uses AVX or SSE when the compiler targets them, and a scalar
+     * loop otherwise. When disabled, each child is tested on its own with
+     * Rect::doesIntersect. Both settings return the same objects. Rectangular
+     * searches always use the structure-of-arrays test.
+     *
+     * @param enabled Whether to use the SIMD child test (default is true).
+     */
+    void setSimdQueries(bool enabled);
+
+    /**
+     * Sets the number of threads used by bulkInsert and reconstruct.
+     *
+     * With more than one thread, the sort on X runs as a parallel merge sort,
+     * and the slices of each level are sorted on Y and packed into parents in
+     * parallel. The tree built is the same for any number of threads.
+     *
+     * @param threads The number of threads, including the calling thread
+     * (default is 1).
+     */
+    void setBuildThreads(unsigned int threads);
+
+    /**
+     * Sets the number of threads used by searchBatch.
+     *
+     * The results are the same for any number of threads. This must not be
+     * called while a batch is running.
+     *
+     * @param threads The number of threads, including the calling thread
+     * (default is 1).
+     */
+    void setQueryThreads(unsigned int threads);
+
+    /**
+     * Sets the algorithm used by insert.
+     *
+     * The R* strategy costs more per insertion but builds trees with much less
+     * overlap between nodes, so searches visit fewer of them. Bulk insertions
+     * and reconstructions always use Sort-Tile-Recursive.
+     *
+     * This also selects the split policy that goes with the strategy,
+     * Quadratic for Linear and RStar for RStar, which setSplitPolicy can
+     * change afterwards.
+     *
+     * @param strategy The insertion algorithm (default is Linear).
+     */
+    void setInsertStrategy(InsertStrategy strategy);
+
+    /**
+     * Sets the algorithm used to split nodes that overflow during insert.
+     *
+     * Linear splits are the cheapest, quadratic splits produce tighter nodes
+     * at O(n²) per split, and R* splits produce the least overlap at
+     * O(n log n) per split.
+     *
+     * @param policy The split algorithm (default is Quadratic).
+     */
+    void setSplitPolicy(SplitPolicy policy);
+
+    /**
+     * Sets the algorithm used by bulkInsert and reconstruct.
+     *
+     * The Hilbert loader builds faster than STR and keeps clustered objects in
+     * squarer nodes. A tree built by it stays in Hilbert order, so later
+     * reconstructions start from nearly sorted input and only need a cheap
+     * insertion sort when objects moved a little. Only STR uses the build
+     * threads.
+     *
+     * @param loader The bulk loading algorithm (default is STR).
+     */
+    void setBulkLoader(BulkLoader loader);
+
+    /**
+     * Sets how the bounding box of each object is padded.
+     *
+     * Fixed padding pads every side by the buffer size. Velocity padding
+     * stretches each box along the velocity of its object far enough to stay
+     * valid for the given number of updates, so static objects get tight
+     * boxes and fast objects escape less often. Velocities are supplied with
+     * setVelocity or estimated by update() from how far each object moved.
+     * Boxes take the new padding as objects escape or the tree is rebuilt.
+     *
+     * @param mode The padding mode (default is Fixed).
+     * @param frames The number of updates a velocity-padded box should stay
+     * valid (default is 10).
+     * @param padding The padding on each side of a velocity-padded box
+     * (default is 1).
+     */
+    void setPaddingMode(PaddingMode mode, float frames = 10, float padding = 1);
+
+    /**
+     * Sets the expected movement of an object per update, used instead of an
+     * estimate by velocity padding.
+     *
+     * @param obj An object in this RTree.
+     * @param velocity The expected movement per update.
+     */
+    void setVelocity(const std::shared_ptr<RTreeObject> &obj, const Vec2 &velocity);
+
+    /**
+     * Goes back to estimating the velocity of an object from its movement.
+     *
+     * @param obj An object in this RTree.
+     */
+    void clearVelocity(const std::shared_ptr<RTreeObject> &obj);
+
+    /**
+     * Returns the counters for tuning the padding of bounding boxes.
+     *
+     * Escapes are counted by update(). Candidates and false positives are
+     * counted by every search and query that tests exact rects.
+     *
+     * @return The counters since the RTree was created or last reset.
+     */
+    PaddingStats getPaddingStats() const;
+
+    /**
+     * Resets the counters for tuning the padding of bounding boxes.
+     */
+    void resetPaddingStats();
+
+    /**
+     * Returns the counters of the work done by searches and updates.
+     *
+     * Searches add to the counters from any thread. Each search counts into
+     * its own local counters, which are added to those of the tree once when
+     * it finishes, so counting costs a few increments per node and no shared
+     * writes on the way down. The counters of updates are only safe to read
+     * from the thread that modifies the tree. Without RTREE_STATS the
+     * counters are not kept and this returns zeros.
+     *
+     * @return The counters since the RTree was created or last reset.
+     */
+    Stats stats() const;
+
+    /**
+     * Resets the counters of the work done by searches and updates.
+     */
+    void resetStats();
+
+    /**
+     * Returns the root node of this tree.
+     *
+     * @return A read-only reference to the root.
+     */
+    const RTreeNode &getRoot() const { return arena[root]; }
+
+    /**
+     * Returns a child of a node of this tree.
+     *
+     * @param n The parent node.
+     * @param index The index of the child, less than n.numChildren.
+     * @return A read-only reference to the child.
+     */
+    const RTreeNode &getChild(const RTreeNode &n, uint32_t index) const {
+        return arena[n.firstChild + index];
+    }
+
+    /**
+     * Sets whether update() rebuilds the tree on a worker thread.
+     *
+     * When enabled and update() would reconstruct the tree, it instead copies
+     * the bounding boxes of the objects and rebuilds from them on a worker
+     * thread. Until the rebuilt tree is ready, searches use the current tree,
+     * and objects that escape their bounding boxes are patched into it by
+     * enlarging the nodes above them. The first call to update() after the
+     * rebuild finishes swaps the rebuilt tree in and reapplies the objects
+     * that were inserted, removed or moved since the rebuild started.
+     *
+     * Disabling waits for a pending rebuild and swaps it in.
+     *
+     * @param enabled Whether to rebuild in the background (default is false).
+     */
+    void setBackgroundRebuild(bool enabled);
+
+    /**
+     * Returns whether a background rebuild is pending.
+     *
+     * @return Whether a rebuilt tree is waiting to be swapped in.
+     */
+    bool isRebuilding() const { return pendingRoot.valid(); }
+
+    /**
+     * Waits for a pending background rebuild, if any, and swaps it in.
+     */
+    void finishRebuild();
+
+    /**
+     * Updates this RTree depending on the state of its objects.
+     *
+     * Objects that are no longer contained in their bounding boxes are refit in
+     * their leaf if their new bounding box still fits it, and otherwise removed
+     * and reinserted. If the rebuild policy finds a rebuild cheaper, or
+     * finds that the tree has degraded, the RTree is reconstructed instead, or
+     * rebuilt on a worker thread if background rebuilds are enabled.
+     */
+    void update();
+
+    /**
+     * Moves a batch of objects to new rects.
+     *
+     * Only the objects in the batch are checked against their bounding boxes,
+     * so this takes time in proportion to the batch rather than the tree.
+     * Escaped objects are handled as in update(), grouped by leaf so that
+     * each leaf and its ancestors are refit once per batch.
+     *
+     * @param moves The handle of each object and its new rect. Stale handles
+     * are ignored.
+     */
+    void updateMany(const std::vector<std::pair<Handle, Rect>> &moves);
+
+    /**
+     * Publishes the current state of this tree as the snapshot returned by
+     * read().
+     *
+     * Publishing copies the table of arena chunks rather than the nodes. Each
+     * chunk is then copied the first time the tree writes to it, so the cost
+     * of a publish followed by a frame of updates grows with the chunks the
+     * updates touch. Snapshots that no reader can see any more are freed.
+     * This must be called from the thread that modifies the tree.
+     */
+    void publish();
+
+    /**
+     * Pins the snapshot last published, for searching from any thread.
+     *
+     * This does not lock and may be called while another thread modifies the
+     * tree. Before the first publish() the snapshot is empty. Up to
+     * RTreeEpochs::READER_SLOTS guards may be held at once.
+     *
+     * @return A guard through which the snapshot is searched, which keeps it
+     * alive until destroyed.
+     */
+    RTreeReadGuard read() const { return RTreeReadGuard(epochs); }
+
+    /**
+     * Frees the published snapshots that no reader can see any more.
+     *
+     * publish() already does this, so it is only needed to free memory
+     * sooner. This must be called from the thread that modifies the tree.
+     *
+     * @return The number of replaced snapshots that readers still hold.
+     */
+    size_t reclaimSnapshots() { return epochs.reclaim(); }
+
+    /**
+     * Returns a string representation of this tree.
+     *
+     * @return std::string
+     */
+    std::string print() const;
+
+    /**
+     * Calls a callback with the bounding box and level of every node, parents
+     * before their children.
+     *
+     * Objects are reported at level -1 with their padded bounding boxes. This
+     * is meant for drawing and inspecting the tree, as drawRTree() in the
+     * optional CUGL adapter rtreedraw.h does.
+     *
+     * @param callback The callback, called with a const Rect& and an int.
+     */
+    template <typename Callback>
+    void visitBounds(Callback &&callback) const {
+        visitBoundsNode(arena[root], callback);
+    }
+};
+
+template <typename Shape, typename Visitor>
+bool RTree::visitNode(const RTreeNode &n, const Shape &shape, Visitor &visitor,
+        LeafTests &tests) const {
+    RTREE_COUNT(tests.nodes += 1);
+    RTREE_COUNT(tests.leaves += n.level == 0);
+    for (uint32_t base = 0; base < n.numChildren; base += 32) {
+        uint32_t first = n.firstChild + base;
+        uint32_t inside;
+        uint32_t mask = shape.mask(arena, first,
+                                   std::min(n.numChildren - base, 32u), inside);
+        while (mask != 0) {
+            uint32_t i = lowestBit(mask);
+            const RTreeNode &child = arena[first + i];
+            mask &= mask - 1;
+
+            if (n.level > 0) {
+                bool whole = (inside >> i) & 1;
+                if (!(whole ? visitSubtree(child, shape, visitor, tests)
+                            : visitNode(child, shape, visitor, tests))) {
+                    return false;
+                }
+                continue;
+            }
+
+            tests.candidates += 1;
+            if (shape.matches(child.obj->rect)) {
+                RTREE_COUNT(tests.hits += 1);
+                if (!callVisitor(visitor, *child.obj)) {
+                    return false;
+                }
+            } else {
+                tests.falsePositives += 1;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Shape, typename Visitor>
+bool RTree::visitSubtree(const RTreeNode &n, const Shape &shape, Visitor &visitor,
+        LeafTests &tests) const {
+    RTREE_COUNT(tests.nodes += 1);
+    RTREE_COUNT(tests.leaves += n.level == 0);
+    for (uint32_t i = 0; i < n.numChildren; ++i) {
+        const RTreeNode &child = arena[n.firstChild + i];
+        if (n.level > 0) {
+            if (!visitSubtree(child, shape, visitor, tests)) {
+                return false;
+            }
+            continue;
+        }
+
+        tests.candidates += 1;
+        if (shape.matches(child.obj->rect)) {
+            RTREE_COUNT(tests.hits += 1);
+            if (!callVisitor(visitor, *child.obj)) {
+                return false;
+            }
+        } else {
+            tests.falsePositives += 1;
+        }
+    }
+    return true;
+}
+
+template <typename Callback>
+void RTree::visitBoundsNode(const RTreeNode &n, Callback &callback) const {
+    callback(n.rect, n.level);
+    if (n.level >= 0) {
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+            visitBoundsNode(arena[n.firstChild + i], callback);
+        }
+    }
+}
+
+template <typename Visitor, typename... Objects>
+bool RTree::callVisitor(Visitor &visitor, Objects &... objs) {
+    if constexpr (std::is_void<decltype(visitor(objs...))>::value) {
+        visitor(objs...);
+        return true;
+    } else {
+        return visitor(objs...);
+    }
+}
+
+template <typename Callback>
+bool RTree::selfJoin(const RTreeNode &n, PairTest test, Callback &callback) const {
+    for (uint32_t i = 0; i < n.numChildren; ++i) {
+        const RTreeNode &child = arena[n.firstChild + i];
+        if (n.level > 0 && !selfJoin(child, test, callback)) {
+            return false;
+        }
+
+        // Pair the child with each later sibling that overlaps it
+        for (uint32_t base = i + 1; base < n.numChildren; base += 32) {
+            uint32_t first = n.firstChild + base;
+            uint32_t inside;
+            uint32_t mask = arena.rectMask(first, std::min(n.numChildren - base, 32u),
+                                           child.rect, inside);
+            while (mask != 0) {
+                const RTreeNode &sibling = arena[first + lowestBit(mask)];
+                mask &= mask - 1;
+                if (!(n.level > 0 ? joinNodes(child, sibling, test, callback)
+                                  : reportPair(child, sibling, test, callback))) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Callback>
+bool RTree::joinNodes(const RTreeNode &a, const RTreeNode &b, PairTest test,
+        Callback &callback) const {
+    for (uint32_t i = 0; i < a.numChildren; ++i) {
+        const RTreeNode &childA = arena[a.firstChild + i];
+        if (!childA.rect.doesIntersect(b.rect)) {
+            continue;
+        }
+
+        for (uint32_t base = 0; base < b.numChildren; base += 32) {
+            uint32_t first = b.firstChild + base;
+            uint32_t inside;
+            uint32_t mask = arena.rectMask(first, std::min(b.numChildren - base, 32u),
+                                           childA.rect, inside);
+            while (mask != 0) {
+                const RTreeNode &childB = arena[first + lowestBit(mask)];
+                mask &= mask - 1;
+                if (!(a.level > 0 ? joinNodes(childA, childB, test, callback)
+                                  : reportPair(childA, childB, test, callback))) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Policy>
+RTreeNode RTree::splitWith(uint32_t n, std::vector<RTreeNode> &entries) {
+    size_t minGroup = std::max<size_t>(1, std::min<size_t>(minPerLevel, entries.size() / 2));
+    size_t first = Policy::partition(entries, minGroup);
+
+    RTreeNode &node1 = arena[n];
+    RTreeNode node2(entries[first].rect, node1.level);
+    node2.firstChild = arena.allocate();
+    node1.rect = entries[0].rect;
+    node1.numChildren = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        RTreeNode &group = i < first ? node1 : node2;
+        arena.store(group.firstChild + group.numChildren, entries[i]);
+        group.numChildren += 1;
+        group.rect += entries[i].rect;
+    }
+    arena.syncBounds(n);
+    return node2;
+}
+
+template <typename Callback>
+bool RTree::crossJoin(const RTree &ta, const RTreeNode &a, const RTree &tb,
+        const RTreeNode &b, PairTest test, Callback &callback) {
+    if (a.level < 0 && b.level < 0) {
+        return reportPair(a, b, test, callback);
+    }
+
+    // Descend the larger node, which prunes more of the other tree. This also
+    // copes with trees of different heights, as a leaf is never descended.
+    float areaA = a.rect.size.width * a.rect.size.height;
+    float areaB = b.rect.size.width * b.rect.size.height;
+    if (a.level < 0 || (b.level >= 0 && areaB > areaA)) {
+        for (uint32_t base = 0; base < b.numChildren; base += 32) {
+            uint32_t first = b.firstChild + base;
+            uint32_t inside;
+            uint32_t mask = tb.arena.rectMask(first, std::min(b.numChildren - base, 32u),
+                                              a.rect, inside);
+            while (mask != 0) {
+                const RTreeNode &childB = tb.arena[first + lowestBit(mask)];
+                mask &= mask - 1;
+                if (!crossJoin(ta, a, tb, childB, test, callback)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    for (uint32_t base = 0; base < a.numChildren; base += 32) {
+        uint32_t first = a.firstChild + base;
+        uint32_t inside;
+        uint32_t mask = ta.arena.rectMask(first, std::min(a.numChildren - base, 32u),
+                                          b.rect, inside);
+        while (mask != 0) {
+            const RTreeNode &childA = ta.arena[first + lowestBit(mask)];
+            mask &= mask - 1;
+            if (!crossJoin(ta, childA, tb, b, test, callback)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Callback>
+bool RTree::reportPair(const RTreeNode &a, const RTreeNode &b, PairTest test,
+        Callback &callback) {
+    // The padded boxes of a and b already overlap, or they would not be paired
+    if (test == PairTest::Tight && !a.obj->rect.doesIntersect(b.obj->rect)) {
+        return true;
+    }
+    return callVisitor(callback, *a.obj, *b.obj);
+}
 
 #endif
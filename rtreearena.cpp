@@ -0,0 +1,106 @@
+#include "rtreearena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "rtreenode.h"
+
+/**
+ * Creates an empty arena.
+ *
+ * @param capacity The minimum number of nodes per block, at most
+ * CHUNK_SIZE. This is rounded up to a power of two.
+ */
+RTreeNodeArena::RTreeNodeArena(uint32_t capacity)
+    : blockSize(1), blockBits(0), nextBlock(0) {
+    // A block must hold every child of a node and must not straddle chunks
+    assert(capacity <= CHUNK_SIZE);
+    while (blockSize < capacity && blockSize < CHUNK_SIZE) {
+        blockSize <<= 1;
+        blockBits += 1;
+    }
+}
+
+/**
+ * Hands out a block of nodes.
+ *
+ * @return The id of the first node of the block.
+ */
+uint32_t RTreeNodeArena::allocate() {
+    if (!freeBlocks.empty()) {
+        uint32_t block = freeBlocks.back();
+        freeBlocks.pop_back();
+        return block;
+    }
+
+    // Blocks are aligned to their size, so a block never straddles two chunks
+    uint32_t block = nextBlock;
+    if ((block >> CHUNK_BITS) >= chunks.size()) {
+        Chunk chunk;
+        chunk.nodes.reset(new RTreeNode[CHUNK_SIZE]);
+        chunk.bounds.reset(new float[4 * BOUNDS_STRIDE]());
+        chunk.shared = false;
+        chunks.push_back(std::move(chunk));
+        owners.resize(chunks.size() << (CHUNK_BITS - blockBits), NONE);
+    }
+    nextBlock += blockSize;
+    return block;
+}
+
+/**
+ * Returns a block to the arena so that it can be handed out again.
+ *
+ * @param block The id of the first node of the block.
+ */
+void RTreeNodeArena::release(uint32_t block) {
+    freeBlocks.push_back(block);
+}
+
+/**
+ * Releases every block at once, keeping the chunks for reuse.
+ */
+void RTreeNodeArena::reset() {
+    nextBlock = 0;
+    freeBlocks.clear();
+    std::fill(handleEntries.begin(), handleEntries.end(), NONE);
+    for (Chunk &chunk : chunks) {
+        if (chunk.shared) {
+            chunk.nodes.reset(new RTreeNode[CHUNK_SIZE]);
+            chunk.bounds.reset(new float[4 * BOUNDS_STRIDE]());
+            chunk.shared = false;
+        }
+    }
+}
+
+/**
+ * Returns a read-only view of the nodes of this arena as they are now.
+ *
+ * @return The view.
+ */
+RTreeNodeArena RTreeNodeArena::share() {
+    RTreeNodeArena view(blockSize);
+    view.chunks = chunks;
+    for (Chunk &chunk : chunks) {
+        chunk.shared = true;
+    }
+    return view;
+}
+
+/**
+ * Replaces a shared chunk by a copy owned by this arena alone.
+ *
+ * @param chunk The chunk.
+ */
+void RTreeNodeArena::unshare(Chunk &chunk) {
+    std::shared_ptr<RTreeNode[]> nodes(new RTreeNode[CHUNK_SIZE]);
+    std::shared_ptr<float[]> bounds(new float[4 * BOUNDS_STRIDE]);
+    std::copy(chunk.nodes.get(), chunk.nodes.get() + CHUNK_SIZE, nodes.get());
+    std::copy(chunk.bounds.get(), chunk.bounds.get() + 4 * BOUNDS_STRIDE, bounds.get());
+    chunk.nodes = std::move(nodes);
+    chunk.bounds = std::move(bounds);
+    chunk.shared = false;
+}
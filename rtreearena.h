@@ -0,0 +1,303 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "rtreenode.h"
+#include "rtreesimd.h"
+
+/**
+ * Pool of RTreeNodes addressed by 32-bit ids.
+ *
+ * Nodes are handed out in fixed-size blocks, one block per inner node, so that
+ * the children of a node are stored next to each other. Blocks live in large
+ * chunks that are never moved or freed until the arena is destroyed, so
+ * references to nodes stay valid while new blocks are allocated, and resetting
+ * the arena to rebuild a tree does not touch the allocator.
+ *
+ * Alongside the nodes, each chunk mirrors the bounding boxes of its nodes as
+ * structure-of-arrays floats, so that all children of a node can be tested
+ * against a query at once. Nodes must be written through store() or followed
+ * by syncBounds() to keep the mirror up to date.
+ *
+ * store() also records which node owns each block, and which leaf node holds
+ * each object handle, so that the path from a leaf to the root can be walked
+ * without searching the tree. Nodes whose firstChild is assigned, or leaf
+ * nodes that are moved, must therefore always be written through store().
+ *
+ * share() returns a read-only view of the nodes that shares their chunks with
+ * this arena, for snapshots read by other threads. A shared chunk is copied
+ * the first time the arena writes to it afterwards, so the view never changes
+ * and the arena only pays for the chunks it touches. Every write, including
+ * through the non-const operator[], goes through this check.
+ */
+class RTreeNodeArena {
+public:
+    /**
+     * The number of bits of a node id that index into a chunk. Chunks are
+     * also the unit copied on write after share(), so they are kept small.
+     */
+    static constexpr uint32_t CHUNK_BITS = 9;
+
+    /** The number of nodes per chunk, which bounds the size of a block. */
+    static constexpr uint32_t CHUNK_SIZE = 1 << CHUNK_BITS;
+
+private:
+
+    /**
+     * The distance between the bounds arrays of a chunk. The padding lets the
+     * SIMD kernels read whole registers past the last node of a chunk.
+     */
+    static constexpr uint32_t BOUNDS_STRIDE = CHUNK_SIZE + 8;
+
+    /** A chunk of nodes and the mirror of their bounding boxes. */
+    struct Chunk {
+        /** The nodes of this chunk. */
+        std::shared_ptr<RTreeNode[]> nodes;
+        /** The minX, minY, maxX and maxY arrays, BOUNDS_STRIDE floats apart. */
+        std::shared_ptr<float[]> bounds;
+        /** Whether a view from share() may be reading this chunk. */
+        bool shared;
+    };
+
+    /** The chunks of nodes, allocated on demand. */
+    std::vector<Chunk> chunks;
+
+    /** The number of nodes per block. Always a power of two. */
+    uint32_t blockSize;
+
+    /** The base 2 logarithm of blockSize. */
+    uint32_t blockBits;
+
+    /** The id of the node whose children are in each block, by block index. */
+    std::vector<uint32_t> owners;
+
+    /** The id of the leaf node holding each handle index, or NONE. */
+    std::vector<uint32_t> handleEntries;
+
+    /** The id of the first block that has never been handed out. */
+    uint32_t nextBlock;
+
+    /** Blocks that were released and can be handed out again. */
+    std::vector<uint32_t> freeBlocks;
+
+    /**
+     * Replaces a shared chunk by a copy owned by this arena alone.
+     *
+     * @param chunk The chunk.
+     */
+    static void unshare(Chunk &chunk);
+
+    /**
+     * Returns the chunk holding a node, copying it first if it is shared.
+     *
+     * @param id The id of the node.
+     * @return The chunk, which may be written to.
+     */
+    Chunk &writable(uint32_t id) {
+        Chunk &chunk = chunks[id >> CHUNK_BITS];
+        if (chunk.shared) {
+            unshare(chunk);
+        }
+        return chunk;
+    }
+
+public:
+    /** Id representing the absence of a node. */
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    /**
+     * Creates an empty arena.
+     *
+     * @param capacity The minimum number of nodes per block, at most
+     * CHUNK_SIZE. This is rounded up to a power of two.
+     */
+    RTreeNodeArena(uint32_t capacity);
+
+    /**
+     * Hands out a block of nodes.
+     *
+     * @return The id of the first node of the block.
+     */
+    uint32_t allocate();
+
+    /**
+     * Returns a block to the arena so that it can be handed out again.
+     *
+     * @param block The id of the first node of the block.
+     */
+    void release(uint32_t block);
+
+    /**
+     * Releases every block at once, keeping the chunks for reuse.
+     *
+     * Shared chunks are replaced by fresh ones without copying, so that a
+     * bulk load may then write to the arena from several threads.
+     */
+    void reset();
+
+    /**
+     * Returns a read-only view of the nodes of this arena as they are now.
+     *
+     * The view shares the chunks of this arena, which are copied before this
+     * arena next writes to them. It does not record owners or handles, so
+     * only the const operator[] and the masks may be used on it.
+     *
+     * @return The view.
+     */
+    RTreeNodeArena share();
+
+    /**
+     * Returns the number of nodes per block.
+     *
+     * @return The block size.
+     */
+    uint32_t getBlockSize() const { return blockSize; }
+
+    /**
+     * Returns the parent of a node, which is the node stored last with its
+     * block as children. The root has no parent, so this must not be called
+     * on it.
+     *
+     * @param id The id of the node.
+     * @return The id of the parent.
+     */
+    uint32_t parentOf(uint32_t id) const { return owners[id >> blockBits]; }
+
+    /**
+     * Makes room to record the leaf nodes of handle indices below a count.
+     *
+     * This must happen before leaf nodes with those handles are stored, and
+     * not while other threads store nodes.
+     *
+     * @param count The number of handle indices.
+     */
+    void reserveEntries(size_t count) {
+        if (handleEntries.size() < count) {
+            handleEntries.resize(count, NONE);
+        }
+    }
+
+    /**
+     * Returns the leaf node holding a handle.
+     *
+     * @param handle The handle index.
+     * @return The id of the leaf node, or NONE if the handle is not in the tree.
+     */
+    uint32_t entryOf(uint32_t handle) const {
+        return handle < handleEntries.size() ? handleEntries[handle] : NONE;
+    }
+
+    /**
+     * Records that a handle is no longer in the tree.
+     *
+     * @param handle The handle index.
+     */
+    void clearEntry(uint32_t handle) {
+        if (handle < handleEntries.size()) {
+            handleEntries[handle] = NONE;
+        }
+    }
+
+    /**
+     * Returns the node with the given id.
+     *
+     * @param id The id of the node.
+     * @return A reference to the node.
+     */
+    RTreeNode &operator[](uint32_t id) {
+        return writable(id).nodes[id & (CHUNK_SIZE - 1)];
+    }
+
+    /**
+     * Returns the node with the given id.
+     *
+     * @param id The id of the node.
+     * @return A reference to the node.
+     */
+    const RTreeNode &operator[](uint32_t id) const {
+        return chunks[id >> CHUNK_BITS].nodes[id & (CHUNK_SIZE - 1)];
+    }
+
+    /**
+     * Copies the bounding box of a node into the structure-of-arrays mirror.
+     *
+     * @param id The id of the node.
+     */
+    void syncBounds(uint32_t id) {
+        Chunk &chunk = writable(id);
+        uint32_t offset = id & (CHUNK_SIZE - 1);
+        const Rect &r = chunk.nodes[offset].rect;
+        float *bounds = chunk.bounds.get() + offset;
+        bounds[0] = r.getMinX();
+        bounds[BOUNDS_STRIDE] = r.getMinY();
+        bounds[2 * BOUNDS_STRIDE] = r.getMaxX();
+        bounds[3 * BOUNDS_STRIDE] = r.getMaxY();
+    }
+
+    /**
+     * Writes a node and its bounding box into the arena.
+     *
+     * @param id The id of the node to overwrite.
+     * @param node The new value of the node.
+     */
+    void store(uint32_t id, const RTreeNode &node) {
+        (*this)[id] = node;
+        syncBounds(id);
+        if (node.level >= 0) {
+            if (node.firstChild != NONE) {
+                owners[node.firstChild >> blockBits] = id;
+            }
+        } else if (node.handle < handleEntries.size()) {
+            handleEntries[node.handle] = id;
+        }
+    }
+
+    /**
+     * Tests consecutive nodes against a circle using their mirrored bounding
+     * boxes.
+     *
+     * @param first The id of the first node to test.
+     * @param count The number of nodes to test, at most 32. They must all be
+     * in the same block.
+     * @param center The center of the circle.
+     * @param radius The radius of the circle.
+     * @return A mask with bit i set if node first + i intersects the circle.
+     */
+    uint32_t circleMask(uint32_t first, uint32_t count,
+            const Vec2 center, float radius) const {
+        const float *bounds = chunks[first >> CHUNK_BITS].bounds.get() +
+                              (first & (CHUNK_SIZE - 1));
+        return circleIntersectMask(bounds, bounds + BOUNDS_STRIDE,
+                                   bounds + 2 * BOUNDS_STRIDE,
+                                   bounds + 3 * BOUNDS_STRIDE, count,
+                                   center.x, center.y, radius);
+    }
+
+    /**
+     * Tests consecutive nodes against a rectangle using their mirrored
+     * bounding boxes.
+     *
+     * @param first The id of the first node to test.
+     * @param count The number of nodes to test, at most 32. They must all be
+     * in the same block.
+     * @param area The rectangle to test against.
+     * @param inside Set to a mask with bit i set if node first + i lies inside
+     * the rectangle.
+     * @return A mask with bit i set if node first + i intersects the rectangle.
+     */
+    uint32_t rectMask(uint32_t first, uint32_t count, const Rect &area,
+            uint32_t &inside) const {
+        const float *bounds = chunks[first >> CHUNK_BITS].bounds.get() +
+                              (first & (CHUNK_SIZE - 1));
+        return rectIntersectMask(bounds, bounds + BOUNDS_STRIDE,
+                                 bounds + 2 * BOUNDS_STRIDE,
+                                 bounds + 3 * BOUNDS_STRIDE, count,
+                                 area.getMinX(), area.getMinY(),
+                                 area.getMaxX(), area.getMaxY(), inside);
+    }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "rtreedraw.h"
+
+#include <memory>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Scales a rect of the world to the unit square that is drawn.
+ *
+ * @param r The rect in world coordinates.
+ * @return The rect to draw.
+ */
+static Rect toScreen(const Rect &r) {
+    return Rect(r.origin.x / 1024, r.origin.y / 576, r.size.width / 1024,
+                r.size.height / 576);
+}
+
+/**
+ * Draws the outlines of the bounding boxes of every node of a tree.
+ *
+ * @param tree The tree.
+ * @param batch The sprite batch to draw with.
+ */
+void drawRTree(const RTree &tree, const std::shared_ptr<SpriteBatch> &batch) {
+    tree.visitBounds([&batch](const Rect &rect, int) {
+        batch->outline(toScreen(rect));
+    });
+}
+
+/**
+ * Draws the outline of the rect of an object.
+ *
+ * @param obj The object.
+ * @param batch The sprite batch to draw with.
+ */
+void drawRTreeObject(const RTreeObject &obj, const std::shared_ptr<SpriteBatch> &batch) {
+    batch->outline(toScreen(obj.rect));
+}
@@ -0,0 +1,37 @@
+#ifndef DRAW_H
+#define DRAW_H
+
+#include <memory>
+
+#include "rtree.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+#ifndef RTREE_WITH_CUGL
+#error "rtreedraw.h draws with CUGL and needs RTREE_WITH_CUGL"
+#endif
+
+/*
+ * Optional CUGL adapter that draws trees and objects for debugging.
+ *
+ * The core of the tree does not depend on the engine, so this is only built
+ * along with it. Rects are drawn in a 1024 by 576 world scaled to [0, 1].
+ */
+
+/**
+ * Draws the outlines of the bounding boxes of every node of a tree.
+ *
+ * @param tree The tree.
+ * @param batch The sprite batch to draw with.
+ */
+void drawRTree(const RTree &tree, const std::shared_ptr<SpriteBatch> &batch);
+
+/**
+ * Draws the outline of the rect of an object.
+ *
+ * @param obj The object.
+ * @param batch The sprite batch to draw with.
+ */
+void drawRTreeObject(const RTreeObject &obj, const std::shared_ptr<SpriteBatch> &batch);
+
+#endif
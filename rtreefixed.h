@@ -0,0 +1,958 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+#include "rtreesimd.h"
+
+/**
+ * An axis-aligned box in any number of dimensions.
+ *
+ * The empty box has its lower corner at +infinity and its upper corner at
+ * -infinity, so that it meets nothing and merging a box into it gives that
+ * box.
+ */
+template <int Dims>
+struct RTreeBox {
+    /** The lowest coordinate along each axis. */
+    float min[Dims];
+    /** The highest coordinate along each axis. */
+    float max[Dims];
+
+    /**
+     * Returns the empty box.
+     *
+     * @return A box that meets nothing.
+     */
+    static RTreeBox empty() {
+        RTreeBox box;
+        for (int d = 0; d < Dims; ++d) {
+            box.min[d] = std::numeric_limits<float>::infinity();
+            box.max[d] = -std::numeric_limits<float>::infinity();
+        }
+        return box;
+    }
+
+    /**
+     * Returns whether this box meets another one. Touching boxes meet.
+     *
+     * @param other The other box.
+     * @return Whether the boxes intersect.
+     */
+    bool intersects(const RTreeBox &other) const {
+        bool hit = true;
+        for (int d = 0; d < Dims; ++d) {
+            hit = hit & (min[d] <= other.max[d]) & (max[d] >= other.min[d]);
+        }
+        return hit;
+    }
+
+    /**
+     * Returns whether another box lies entirely in this one.
+     *
+     * @param other The other box.
+     * @return Whether other lies in this box.
+     */
+    bool contains(const RTreeBox &other) const {
+        bool inside = true;
+        for (int d = 0; d < Dims; ++d) {
+            inside = inside & (min[d] <= other.min[d]) & (other.max[d] <= max[d]);
+        }
+        return inside;
+    }
+
+    /**
+     * Grows this box to the smallest one holding it and another.
+     *
+     * @param other The other box.
+     */
+    void merge(const RTreeBox &other) {
+        for (int d = 0; d < Dims; ++d) {
+            min[d] = std::min(min[d], other.min[d]);
+            max[d] = std::max(max[d], other.max[d]);
+        }
+    }
+
+    /**
+     * Returns the area, volume or hypervolume of this box.
+     *
+     * @return The product of the extents along every axis.
+     */
+    float volume() const {
+        float v = 1;
+        for (int d = 0; d < Dims; ++d) {
+            v *= max[d] - min[d];
+        }
+        return v;
+    }
+
+    /**
+     * Returns the squared distance from a point to the closest point of this
+     * box, which is 0 if the point is inside it.
+     *
+     * @param p The point.
+     * @return The squared distance.
+     */
+    float distanceSquared(const std::array<float, Dims> &p) const {
+        float sum = 0;
+        for (int d = 0; d < Dims; ++d) {
+            float delta = std::max(std::max(min[d] - p[d], p[d] - max[d]), 0.0f);
+            sum += delta * delta;
+        }
+        return sum;
+    }
+};
+
+/**
+ * Returns the box of a rect.
+ *
+ * @param r The rect.
+ * @return The 2D box covering the same area.
+ */
+inline RTreeBox<2> toBox(const Rect &r) {
+    RTreeBox<2> box;
+    box.min[0] = r.getMinX();
+    box.min[1] = r.getMinY();
+    box.max[0] = r.getMaxX();
+    box.max[1] = r.getMaxY();
+    return box;
+}
+
+/**
+ * An R-tree whose dimensions and fanout are fixed at compile time.
+ *
+ * Each node stores the boxes of its children inline as one array per side
+ * and axis, sized for MaxChildren, and is aligned to and padded out to whole
+ * cache lines. The child tests run over every slot of a node, with empty
+ * slots holding the empty box, so their loops have trip counts known to the
+ * compiler, which unrolls and vectorizes them. The masks they return are
+ * then cut to the slots in use. A node never points to separately allocated
+ * children.
+ *
+ * Unlike RTree, this tree keeps no padding, handles or bookkeeping per
+ * object. It stores the box given for each value, and a value that moves is
+ * removed and inserted again. It suits static or slowly changing data and
+ * dimensions other than 2, such as 3D volumes on a server, while RTree
+ * remains the tree for moving game objects with runtime settings.
+ *
+ * @tparam Dims The number of dimensions, at least 1.
+ * @tparam MaxChildren The most children per node, from 2 to 32.
+ * @tparam MinChildren The fewest children per node other than the root, from
+ * 1 to MaxChildren / 2.
+ * @tparam Value The type stored, compared with == when removing.
+ */
+template <int Dims, int MaxChildren, int MinChildren, typename Value = RTreeObject *>
+class RTreeFixed {
+    static_assert(Dims >= 1, "RTreeFixed needs at least one dimension");
+    static_assert(MaxChildren >= 2 && MaxChildren <= 32,
+                  "RTreeFixed tests children with a 32-bit mask");
+    static_assert(MinChildren >= 1 && MinChildren <= MaxChildren / 2,
+                  "both halves of a split must hold MinChildren");
+
+public:
+    /** A box of this tree. */
+    typedef RTreeBox<Dims> Box;
+
+    /** A point of this tree. */
+    typedef std::array<float, Dims> Point;
+
+private:
+    /** A node, with the boxes of its children stored by axis. */
+    struct alignas(64) Node {
+        /** The lowest coordinate of each child along each axis. */
+        float min[Dims][MaxChildren];
+        /** The highest coordinate of each child along each axis. */
+        float max[Dims][MaxChildren];
+        /** The id of each child node, or the index of each value in a leaf. */
+        uint32_t child[MaxChildren];
+        /** The number of children, which fill the first slots. */
+        uint32_t count;
+        /** The level of this node. Leaves holding values have a level of 0. */
+        int level;
+
+        /**
+         * Empties this node.
+         *
+         * @param level The new level of the node.
+         */
+        void reset(int level) {
+            for (int i = 0; i < MaxChildren; ++i) {
+                clear(i);
+                child[i] = 0;
+            }
+            count = 0;
+            this->level = level;
+        }
+
+        /**
+         * Returns the box of a child.
+         *
+         * @param i The slot of the child.
+         * @return The box.
+         */
+        Box box(uint32_t i) const {
+            Box b;
+            for (int d = 0; d < Dims; ++d) {
+                b.min[d] = min[d][i];
+                b.max[d] = max[d][i];
+            }
+            return b;
+        }
+
+        /**
+         * Sets the box of a child.
+         *
+         * @param i The slot of the child.
+         * @param b The box.
+         */
+        void setBox(uint32_t i, const Box &b) {
+            for (int d = 0; d < Dims; ++d) {
+                min[d][i] = b.min[d];
+                max[d][i] = b.max[d];
+            }
+        }
+
+        /**
+         * Puts the empty box in a slot, so that the child tests reject it for
+         * any finite query.
+         *
+         * @param i The slot.
+         */
+        void clear(uint32_t i) {
+            for (int d = 0; d < Dims; ++d) {
+                min[d][i] = std::numeric_limits<float>::infinity();
+                max[d][i] = -std::numeric_limits<float>::infinity();
+            }
+        }
+
+        /**
+         * Appends a child, which must fit.
+         *
+         * @param b The box of the child.
+         * @param id The id or value index of the child.
+         */
+        void add(const Box &b, uint32_t id) {
+            setBox(count, b);
+            child[count] = id;
+            count += 1;
+        }
+
+        /**
+         * Removes a child, moving the last child into its slot.
+         *
+         * @param i The slot of the child.
+         */
+        void removeSlot(uint32_t i) {
+            count -= 1;
+            setBox(i, box(count));
+            child[i] = child[count];
+            clear(count);
+        }
+
+        /**
+         * Returns the smallest box holding every child.
+         *
+         * @return The bounding box of this node.
+         */
+        Box bounds() const {
+            Box b = Box::empty();
+            for (uint32_t i = 0; i < count; ++i) {
+                b.merge(box(i));
+            }
+            return b;
+        }
+
+        /**
+         * Tests every slot against a box.
+         *
+         * @param q The box.
+         * @return Bit i is set if child i meets the box.
+         */
+        uint32_t meets(const Box &q) const {
+            bool hit[MaxChildren];
+            for (int i = 0; i < MaxChildren; ++i) {
+                hit[i] = true;
+            }
+            for (int d = 0; d < Dims; ++d) {
+                for (int i = 0; i < MaxChildren; ++i) {
+                    hit[i] = hit[i] & (min[d][i] <= q.max[d]) & (max[d][i] >= q.min[d]);
+                }
+            }
+            return toMask(hit);
+        }
+
+        /**
+         * Tests every slot against a sphere.
+         *
+         * @param center The center of the sphere.
+         * @param radiusSquared The square of the radius of the sphere.
+         * @return Bit i is set if child i meets the sphere.
+         */
+        uint32_t within(const Point &center, float radiusSquared) const {
+            float dist[MaxChildren];
+            for (int i = 0; i < MaxChildren; ++i) {
+                dist[i] = 0;
+            }
+            for (int d = 0; d < Dims; ++d) {
+                for (int i = 0; i < MaxChildren; ++i) {
+                    float delta = std::max(std::max(min[d][i] - center[d],
+                                                    center[d] - max[d][i]), 0.0f);
+                    dist[i] += delta * delta;
+                }
+            }
+            bool hit[MaxChildren];
+            for (int i = 0; i < MaxChildren; ++i) {
+                hit[i] = dist[i] <= radiusSquared;
+            }
+            return toMask(hit);
+        }
+
+        /**
+         * Packs one flag per slot into a mask.
+         *
+         * @param hit The flags.
+         * @return Bit i is set if hit[i] is.
+         */
+        static uint32_t toMask(const bool (&hit)[MaxChildren]) {
+            uint32_t mask = 0;
+            for (int i = 0; i < MaxChildren; ++i) {
+                mask |= uint32_t(hit[i]) << i;
+            }
+            return mask;
+        }
+    };
+
+    /** A child on its way into a node, during a split or a bulk load. */
+    struct Entry {
+        /** The box of the child. */
+        Box box;
+        /** The id or value index of the child. */
+        uint32_t id;
+    };
+
+    /** A child of a dissolved node, waiting to be inserted again. */
+    struct Orphan {
+        /** The child. */
+        Entry entry;
+        /** The level of the nodes the child belongs in. */
+        int level;
+    };
+
+    /** The nodes, indexed by id. */
+    std::vector<Node> nodes;
+
+    /** The ids of released nodes, reused before the node vector grows. */
+    std::vector<uint32_t> freeNodes;
+
+    /** The values, indexed from the leaves. */
+    std::vector<Value> values;
+
+    /** The indices of released values, reused before the value vector grows. */
+    std::vector<uint32_t> freeValues;
+
+    /** The children of dissolved nodes, while a removal runs. */
+    std::vector<Orphan> orphans;
+
+    /** The id of the root node. */
+    uint32_t root;
+
+    /** The number of values in the tree. */
+    size_t valueCount;
+
+    /**
+     * Takes a node from the free list or the end of the node vector.
+     *
+     * @param level The level of the new node.
+     * @return The id of the empty node.
+     */
+    uint32_t allocateNode(int level);
+
+    /**
+     * Stores a value.
+     *
+     * @param value The value.
+     * @return The index of the value.
+     */
+    uint32_t allocateValue(const Value &value);
+
+    /**
+     * Inserts a child into the nodes of a level, growing the tree if the
+     * root splits.
+     *
+     * @param entry The child.
+     * @param level The level of the nodes the child belongs in.
+     */
+    void insertEntry(const Entry &entry, int level);
+
+    /**
+     * Inserts a child into a subtree.
+     *
+     * @param n The root of the subtree.
+     * @param entry The child.
+     * @param level The level of the nodes the child belongs in.
+     * @param sibling Set to the new sibling of n if n split.
+     * @return Whether n split.
+     */
+    bool insertAt(uint32_t n, const Entry &entry, int level, Entry &sibling);
+
+    /**
+     * Adds a child to a node, splitting the node if it is full.
+     *
+     * @param n The node.
+     * @param entry The child.
+     * @param sibling Set to the new sibling of n if n split.
+     * @return Whether n split.
+     */
+    bool addChild(uint32_t n, const Entry &entry, Entry &sibling);
+
+    /**
+     * Returns the child of a node whose box grows least to hold a box,
+     * preferring the smallest child on ties.
+     *
+     * @param node The node.
+     * @param box The box.
+     * @return The slot of the child.
+     */
+    static uint32_t chooseChild(const Node &node, const Box &box);
+
+    /**
+     * Reorders the children of an overflowing node into two groups with
+     * Guttman's quadratic split.
+     *
+     * @param entries The MaxChildren + 1 children.
+     * @return The number of children in the first group.
+     */
+    static size_t quadraticSplit(Entry (&entries)[MaxChildren + 1]);
+
+    /**
+     * Removes a value from a subtree, dissolving nodes that become underfull
+     * into the orphans.
+     *
+     * @param n The root of the subtree.
+     * @param box The box the value was inserted with.
+     * @param value The value.
+     * @return Whether the value was found.
+     */
+    bool removeAt(uint32_t n, const Box &box, const Value &value);
+
+    /**
+     * Sorts children into tiles of nearby children, one axis after another,
+     * so that consecutive runs of MaxChildren make compact nodes.
+     *
+     * @param entries The children.
+     * @param first The first child to sort.
+     * @param last The child after the last one to sort.
+     * @param axis The axis to sort along.
+     */
+    static void tile(std::vector<Entry> &entries, size_t first, size_t last, int axis);
+
+    /**
+     * Calls a visitor with every value in a subtree whose box meets a shape.
+     *
+     * @param n The root of the subtree.
+     * @param test Returns the mask of the children of a node meeting the shape.
+     * @param visitor The visitor to call with each value.
+     * @return false if the visitor stopped the query, and true otherwise.
+     */
+    template <typename Test, typename Visitor>
+    bool visitNode(uint32_t n, const Test &test, Visitor &visitor) const;
+
+    /**
+     * Calls a visitor with a value, converting a void result to true.
+     *
+     * @param visitor The visitor.
+     * @param value The value.
+     * @return false if the visitor asked to stop, and true otherwise.
+     */
+    template <typename Visitor>
+    static bool callVisitor(Visitor &visitor, const Value &value) {
+        if constexpr (std::is_void<decltype(visitor(value))>::value) {
+            visitor(value);
+            return true;
+        } else {
+            return visitor(value);
+        }
+    }
+
+public:
+    /**
+     * Returns the size of a node, a whole number of 64-byte cache lines.
+     *
+     * @return The bytes per node.
+     */
+    static constexpr size_t nodeBytes() { return sizeof(Node); }
+
+    /**
+     * Creates an empty tree.
+     */
+    RTreeFixed() { clear(); }
+
+    /**
+     * Removes every value.
+     */
+    void clear();
+
+    /**
+     * Returns the number of values in this tree.
+     *
+     * @return The number of values.
+     */
+    size_t size() const { return valueCount; }
+
+    /**
+     * Returns the number of levels of nodes, which is 1 while the root is a
+     * leaf.
+     *
+     * @return The height.
+     */
+    int height() const { return nodes[root].level + 1; }
+
+    /**
+     * Inserts a value.
+     *
+     * @param box The box of the value.
+     * @param value The value.
+     */
+    void insert(const Box &box, const Value &value);
+
+    /**
+     * Removes a value.
+     *
+     * @param box The box the value was inserted with.
+     * @param value The value.
+     * @return Whether the value was found and removed.
+     */
+    bool remove(const Box &box, const Value &value);
+
+    /**
+     * Replaces the contents of this tree with a batch of values, packed with
+     * Sort-Tile-Recursive over every axis.
+     *
+     * @param items The box and value of each value.
+     */
+    void bulkLoad(const std::vector<std::pair<Box, Value>> &items);
+
+    /**
+     * Calls a visitor with every value whose box meets a box.
+     *
+     * The visitor is called with a const Value& and may return false to stop
+     * the query early.
+     *
+     * @param area The box to search.
+     * @param visitor The visitor to call with each value.
+     * @return false if the visitor stopped the query, and true otherwise.
+     */
+    template <typename Visitor>
+    bool query(const Box &area, Visitor &&visitor) const {
+        auto test = [&area](const Node &node) { return node.meets(area); };
+        return visitNode(root, test, visitor);
+    }
+
+    /**
+     * Calls a visitor with every value whose box meets a sphere, or a circle
+     * in 2D.
+     *
+     * @param center The center of the sphere.
+     * @param radius The radius of the sphere.
+     * @param visitor The visitor to call with each value, as for query.
+     * @return false if the visitor stopped the query, and true otherwise.
+     */
+    template <typename Visitor>
+    bool queryWithin(const Point &center, float radius, Visitor &&visitor) const {
+        float radiusSquared = radius * radius;
+        auto test = [&center, radiusSquared](const Node &node) {
+            return node.within(center, radiusSquared);
+        };
+        return visitNode(root, test, visitor);
+    }
+
+    /**
+     * Appends every value whose box meets a box to a caller-owned vector.
+     *
+     * @param area The box to search.
+     * @param res The vector to append the values to.
+     */
+    void search(const Box &area, std::vector<Value> &res) const {
+        query(area, [&res](const Value &value) { res.push_back(value); });
+    }
+};
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+void RTreeFixed<Dims, MaxChildren, MinChildren, Value>::clear() {
+    nodes.clear();
+    freeNodes.clear();
+    values.clear();
+    freeValues.clear();
+    valueCount = 0;
+    root = allocateNode(0);
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+uint32_t RTreeFixed<Dims, MaxChildren, MinChildren, Value>::allocateNode(int level) {
+    uint32_t id;
+    if (freeNodes.empty()) {
+        id = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    } else {
+        id = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    nodes[id].reset(level);
+    return id;
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+uint32_t RTreeFixed<Dims, MaxChildren, MinChildren, Value>::allocateValue(const Value &value) {
+    if (freeValues.empty()) {
+        values.push_back(value);
+        return static_cast<uint32_t>(values.size() - 1);
+    }
+    uint32_t index = freeValues.back();
+    freeValues.pop_back();
+    values[index] = value;
+    return index;
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+void RTreeFixed<Dims, MaxChildren, MinChildren, Value>::insert(const Box &box,
+        const Value &value) {
+    Entry entry = {box, allocateValue(value)};
+    insertEntry(entry, 0);
+    valueCount += 1;
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+void RTreeFixed<Dims, MaxChildren, MinChildren, Value>::insertEntry(const Entry &entry,
+        int level) {
+    Entry sibling;
+    if (insertAt(root, entry, level, sibling)) {
+        Entry old = {nodes[root].bounds(), root};
+        root = allocateNode(nodes[old.id].level + 1);
+        nodes[root].add(old.box, old.id);
+        nodes[root].add(sibling.box, sibling.id);
+    }
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+bool RTreeFixed<Dims, MaxChildren, MinChildren, Value>::insertAt(uint32_t n,
+        const Entry &entry, int level, Entry &sibling) {
+    if (nodes[n].level == level) {
+        return addChild(n, entry, sibling);
+    }
+
+    uint32_t i = chooseChild(nodes[n], entry.box);
+    uint32_t c = nodes[n].child[i];
+    Entry childSibling;
+    bool split = insertAt(c, entry, level, childSibling);
+
+    // Splits below may have moved the nodes, so look n up again
+    if (split) {
+        nodes[n].setBox(i, nodes[c].bounds());
+        return addChild(n, childSibling, sibling);
+    }
+    Box grown = nodes[n].box(i);
+    grown.merge(entry.box);
+    nodes[n].setBox(i, grown);
+    return false;
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+bool RTreeFixed<Dims, MaxChildren, MinChildren, Value>::addChild(uint32_t n,
+        const Entry &entry, Entry &sibling) {
+    if (nodes[n].count < MaxChildren) {
+        nodes[n].add(entry.box, entry.id);
+        return false;
+    }
+
+    Entry entries[MaxChildren + 1];
+    for (uint32_t i = 0; i < MaxChildren; ++i) {
+        entries[i].box = nodes[n].box(i);
+        entries[i].id = nodes[n].child[i];
+    }
+    entries[MaxChildren] = entry;
+    size_t first = quadraticSplit(entries);
+
+    // Allocating may move the nodes, so do it before taking references
+    int level = nodes[n].level;
+    sibling.id = allocateNode(level);
+    Node &node = nodes[n];
+    Node &other = nodes[sibling.id];
+    node.reset(level);
+    for (size_t i = 0; i < first; ++i) {
+        node.add(entries[i].box, entries[i].id);
+    }
+    for (size_t i = first; i <= MaxChildren; ++i) {
+        other.add(entries[i].box, entries[i].id);
+    }
+    sibling.box = other.bounds();
+    return true;
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+uint32_t RTreeFixed<Dims, MaxChildren, MinChildren, Value>::chooseChild(const Node &node,
+        const Box &box) {
+    uint32_t best = 0;
+    float bestGrowth = std::numeric_limits<float>::infinity();
+    float bestVolume = std::numeric_limits<float>::infinity();
+    for (uint32_t i = 0; i < node.count; ++i) {
+        Box child = node.box(i);
+        float volume = child.volume();
+        child.merge(box);
+        float growth = child.volume() - volume;
+        if (growth < bestGrowth || (growth == bestGrowth && volume < bestVolume)) {
+            best = i;
+            bestGrowth = growth;
+            bestVolume = volume;
+        }
+    }
+    return best;
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+size_t RTreeFixed<Dims, MaxChildren, MinChildren, Value>::quadraticSplit(
+        Entry (&entries)[MaxChildren + 1]) {
+    const int total = MaxChildren + 1;
+
+    // The seeds are the pair that would waste the most volume in one node
+    int seedA = 0;
+    int seedB = 1;
+    float worst = -std::numeric_limits<float>::infinity();
+    for (int i = 0; i < total; ++i) {
+        for (int j = i + 1; j < total; ++j) {
+            Box merged = entries[i].box;
+            merged.merge(entries[j].box);
+            float waste = merged.volume() - entries[i].box.volume() - entries[j].box.volume();
+            if (waste > worst) {
+                worst = waste;
+                seedA = i;
+                seedB = j;
+            }
+        }
+    }
+
+    // 0 while unassigned, then 1 for the first group and 2 for the second
+    int group[total] = {0};
+    group[seedA] = 1;
+    group[seedB] = 2;
+    Box boxA = entries[seedA].box;
+    Box boxB = entries[seedB].box;
+    int sizeA = 1;
+    int sizeB = 1;
+    for (int left = total - 2; left > 0; --left) {
+        // Give every remaining child to a group that needs them to reach the minimum
+        if (sizeA + left == MinChildren || sizeB + left == MinChildren) {
+            int target = sizeA + left == MinChildren ? 1 : 2;
+            for (int i = 0; i < total; ++i) {
+                if (group[i] == 0) {
+                    group[i] = target;
+                }
+            }
+            sizeA += target == 1 ? left : 0;
+            sizeB += target == 2 ? left : 0;
+            break;
+        }
+
+        // Assign the child with the strongest preference for one group
+        int pick = -1;
+        float growthA = 0;
+        float growthB = 0;
+        float strongest = -1;
+        for (int i = 0; i < total; ++i) {
+            if (group[i] != 0) {
+                continue;
+            }
+            Box withA = boxA;
+            withA.merge(entries[i].box);
+            Box withB = boxB;
+            withB.merge(entries[i].box);
+            float a = withA.volume() - boxA.volume();
+            float b = withB.volume() - boxB.volume();
+            if (std::fabs(a - b) > strongest) {
+                strongest = std::fabs(a - b);
+                pick = i;
+                growthA = a;
+                growthB = b;
+            }
+        }
+        bool toA = growthA < growthB ||
+                   (growthA == growthB && (boxA.volume() < boxB.volume() ||
+                                           (boxA.volume() == boxB.volume() && sizeA <= sizeB)));
+        group[pick] = toA ? 1 : 2;
+        if (toA) {
+            boxA.merge(entries[pick].box);
+            sizeA += 1;
+        } else {
+            boxB.merge(entries[pick].box);
+            sizeB += 1;
+        }
+    }
+
+    // Put the first group before the second, keeping the order within each
+    Entry sorted[total];
+    int next = 0;
+    for (int target = 1; target <= 2; ++target) {
+        for (int i = 0; i < total; ++i) {
+            if (group[i] == target) {
+                sorted[next++] = entries[i];
+            }
+        }
+    }
+    std::copy(sorted, sorted + total, entries);
+    return sizeA;
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+bool RTreeFixed<Dims, MaxChildren, MinChildren, Value>::remove(const Box &box,
+        const Value &value) {
+    orphans.clear();
+    if (!removeAt(root, box, value)) {
+        return false;
+    }
+    valueCount -= 1;
+
+    // The root keeps at least one child, so every orphan still has a level to go to
+    for (size_t i = 0; i < orphans.size(); ++i) {
+        insertEntry(orphans[i].entry, orphans[i].level);
+    }
+    while (nodes[root].level > 0 && nodes[root].count == 1) {
+        uint32_t old = root;
+        root = nodes[old].child[0];
+        freeNodes.push_back(old);
+    }
+    return true;
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+bool RTreeFixed<Dims, MaxChildren, MinChildren, Value>::removeAt(uint32_t n,
+        const Box &box, const Value &value) {
+    if (nodes[n].level == 0) {
+        Node &leaf = nodes[n];
+        for (uint32_t i = 0; i < leaf.count; ++i) {
+            if (values[leaf.child[i]] == value) {
+                freeValues.push_back(leaf.child[i]);
+                values[leaf.child[i]] = Value();
+                leaf.removeSlot(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nodes[n].count; ++i) {
+        if (!nodes[n].box(i).contains(box)) {
+            continue;
+        }
+        uint32_t c = nodes[n].child[i];
+        if (!removeAt(c, box, value)) {
+            continue;
+        }
+
+        Node &node = nodes[n];
+        const Node &child = nodes[c];
+        if (child.count < MinChildren) {
+            // Dissolve the underfull child and insert its children again later
+            for (uint32_t j = 0; j < child.count; ++j) {
+                Orphan orphan = {{child.box(j), child.child[j]}, child.level};
+                orphans.push_back(orphan);
+            }
+            freeNodes.push_back(c);
+            node.removeSlot(i);
+        } else {
+            node.setBox(i, child.bounds());
+        }
+        return true;
+    }
+    return false;
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+void RTreeFixed<Dims, MaxChildren, MinChildren, Value>::bulkLoad(
+        const std::vector<std::pair<Box, Value>> &items) {
+    clear();
+    std::vector<Entry> level;
+    level.reserve(items.size());
+    for (const std::pair<Box, Value> &item : items) {
+        Entry entry = {item.first, allocateValue(item.second)};
+        level.push_back(entry);
+    }
+    valueCount = items.size();
+
+    // Pack each level into nodes, spreading the children evenly so that no
+    // node but the root falls below the minimum
+    int height = 0;
+    std::vector<Entry> parents;
+    while (level.size() > MaxChildren) {
+        tile(level, 0, level.size(), 0);
+        size_t groups = (level.size() + MaxChildren - 1) / MaxChildren;
+        parents.clear();
+        for (size_t g = 0; g < groups; ++g) {
+            size_t first = level.size() * g / groups;
+            size_t last = level.size() * (g + 1) / groups;
+            uint32_t id = allocateNode(height);
+            for (size_t i = first; i < last; ++i) {
+                nodes[id].add(level[i].box, level[i].id);
+            }
+            Entry parent = {nodes[id].bounds(), id};
+            parents.push_back(parent);
+        }
+        level.swap(parents);
+        height += 1;
+    }
+
+    nodes[root].reset(height);
+    for (const Entry &entry : level) {
+        nodes[root].add(entry.box, entry.id);
+    }
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+void RTreeFixed<Dims, MaxChildren, MinChildren, Value>::tile(std::vector<Entry> &entries,
+        size_t first, size_t last, int axis) {
+    std::sort(entries.begin() + first, entries.begin() + last,
+              [axis](const Entry &a, const Entry &b) {
+                  return a.box.min[axis] + a.box.max[axis] < b.box.min[axis] + b.box.max[axis];
+              });
+    if (axis == Dims - 1) {
+        return;
+    }
+
+    // Cut into slabs of whole nodes, as many as the root of the node count
+    // taken over the axes left
+    size_t pages = (last - first + MaxChildren - 1) / MaxChildren;
+    size_t slabs = (size_t)std::ceil(std::pow((double)pages, 1.0 / (Dims - axis)));
+    size_t perSlab = (pages + slabs - 1) / slabs * MaxChildren;
+    for (size_t start = first; start < last; start += perSlab) {
+        tile(entries, start, std::min(start + perSlab, last), axis + 1);
+    }
+}
+
+template <int Dims, int MaxChildren, int MinChildren, typename Value>
+template <typename Test, typename Visitor>
+bool RTreeFixed<Dims, MaxChildren, MinChildren, Value>::visitNode(uint32_t n,
+        const Test &test, Visitor &visitor) const {
+    const Node &node = nodes[n];
+    // A box or sphere reaching infinity meets the empty box, so drop the empty slots
+    for (uint32_t mask = test(node) & lowBits(node.count); mask != 0; mask &= mask - 1) {
+        uint32_t i = lowestBit(mask);
+        if (node.level > 0) {
+            if (!visitNode(node.child[i], test, visitor)) {
+                return false;
+            }
+        } else if (!callVisitor(visitor, values[node.child[i]])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+/*
+ * The geometry types of the tree.
+ *
+ * When RTREE_WITH_CUGL is defined, these are the Rect and Vec2 of CUGL, so
+ * that games pass the rects of their objects straight to the tree. Otherwise
+ * they are small stand-ins with the same names, fields and behavior for the
+ * parts the tree uses, so that the tree builds without the engine, for
+ * example on a headless server. Every file of a program must agree on the
+ * choice, so it is made once for the whole build.
+ */
+
+#ifdef RTREE_WITH_CUGL
+
+#include <cugl/cugl.h>
+
+using namespace cugl;
+
+#else
+
+#include <algorithm>
+#include <cmath>
+
+namespace rtree {
+
+/**
+ * A 2D vector or point.
+ */
+struct Vec2 {
+    /** The x coordinate. */
+    float x;
+    /** The y coordinate. */
+    float y;
+
+    /**
+     * Creates the zero vector.
+     */
+    Vec2() : x(0), y(0) {}
+
+    /**
+     * Creates a vector from its coordinates.
+     *
+     * @param x The x coordinate.
+     * @param y The y coordinate.
+     */
+    Vec2(float x, float y) : x(x), y(y) {}
+
+    Vec2 operator+(const Vec2 &v) const { return Vec2(x + v.x, y + v.y); }
+    Vec2 operator-(const Vec2 &v) const { return Vec2(x - v.x, y - v.y); }
+    Vec2 operator*(float s) const { return Vec2(x * s, y * s); }
+    Vec2 &operator+=(const Vec2 &v) { x += v.x; y += v.y; return *this; }
+    Vec2 &operator-=(const Vec2 &v) { x -= v.x; y -= v.y; return *this; }
+    Vec2 &operator*=(float s) { x *= s; y *= s; return *this; }
+    bool operator==(const Vec2 &v) const { return x == v.x && y == v.y; }
+    bool operator!=(const Vec2 &v) const { return !(*this == v); }
+
+    /**
+     * Returns the squared distance to another point.
+     *
+     * @param v The other point.
+     * @return The squared distance.
+     */
+    float distanceSquared(const Vec2 &v) const {
+        return (x - v.x) * (x - v.x) + (y - v.y) * (y - v.y);
+    }
+
+    /**
+     * Returns the distance to another point.
+     *
+     * @param v The other point.
+     * @return The distance.
+     */
+    float distance(const Vec2 &v) const { return std::sqrt(distanceSquared(v)); }
+
+    /**
+     * Returns the length of this vector.
+     *
+     * @return The length.
+     */
+    float length() const { return std::sqrt(x * x + y * y); }
+};
+
+/**
+ * A 2D width and height.
+ */
+struct Size {
+    /** The width. */
+    float width;
+    /** The height. */
+    float height;
+
+    /**
+     * Creates an empty size.
+     */
+    Size() : width(0), height(0) {}
+
+    /**
+     * Creates a size.
+     *
+     * @param width The width.
+     * @param height The height.
+     */
+    Size(float width, float height) : width(width), height(height) {}
+
+    bool operator==(const Size &s) const { return width == s.width && height == s.height; }
+    bool operator!=(const Size &s) const { return !(*this == s); }
+};
+
+/**
+ * An axis-aligned rectangle given by its lower-left corner and its size.
+ *
+ * Edges are closed, so rectangles that only touch intersect.
+ */
+struct Rect {
+    /** The lower-left corner. */
+    Vec2 origin;
+    /** The width and height. */
+    Size size;
+
+    /**
+     * Creates an empty rectangle at the origin.
+     */
+    Rect() {}
+
+    /**
+     * Creates a rectangle.
+     *
+     * @param x The x coordinate of the lower-left corner.
+     * @param y The y coordinate of the lower-left corner.
+     * @param width The width.
+     * @param height The height.
+     */
+    Rect(float x, float y, float width, float height)
+        : origin(x, y), size(width, height) {}
+
+    /**
+     * Creates a rectangle.
+     *
+     * @param origin The lower-left corner.
+     * @param size The width and height.
+     */
+    Rect(const Vec2 &origin, const Size &size) : origin(origin), size(size) {}
+
+    float getMinX() const { return origin.x; }
+    float getMidX() const { return origin.x + size.width / 2; }
+    float getMaxX() const { return origin.x + size.width; }
+    float getMinY() const { return origin.y; }
+    float getMidY() const { return origin.y + size.height / 2; }
+    float getMaxY() const { return origin.y + size.height; }
+
+    bool operator==(const Rect &r) const { return origin == r.origin && size == r.size; }
+    bool operator!=(const Rect &r) const { return !(*this == r); }
+
+    /**
+     * Returns whether a point lies in this rectangle.
+     *
+     * @param p The point.
+     * @return Whether the point lies in this rectangle or on its edges.
+     */
+    bool contains(const Vec2 &p) const {
+        return p.x >= getMinX() && p.x <= getMaxX() && p.y >= getMinY() && p.y <= getMaxY();
+    }
+
+    /**
+     * Returns whether another rectangle lies entirely in this one.
+     *
+     * @param r The other rectangle.
+     * @return Whether r lies in this rectangle.
+     */
+    bool contains(const Rect &r) const {
+        return getMinX() <= r.getMinX() && r.getMaxX() <= getMaxX() &&
+               getMinY() <= r.getMinY() && r.getMaxY() <= getMaxY();
+    }
+
+    /**
+     * Returns whether this rectangle lies entirely in another one.
+     *
+     * @param r The other rectangle.
+     * @return Whether this rectangle lies in r.
+     */
+    bool inside(const Rect &r) const { return r.contains(*this); }
+
+    /**
+     * Returns whether this rectangle meets another one.
+     *
+     * @param r The other rectangle.
+     * @return Whether the rectangles intersect.
+     */
+    bool doesIntersect(const Rect &r) const {
+        return !(getMaxX() < r.getMinX() || r.getMaxX() < getMinX() ||
+                 getMaxY() < r.getMinY() || r.getMaxY() < getMinY());
+    }
+
+    /**
+     * Returns whether this rectangle meets a circle.
+     *
+     * @param center The center of the circle.
+     * @param radius The radius of the circle.
+     * @return Whether the rectangle and the circle intersect.
+     */
+    bool doesIntersect(const Vec2 center, float radius) const {
+        float w = size.width / 2;
+        float h = size.height / 2;
+        float dx = std::fabs(center.x - origin.x - w);
+        float dy = std::fabs(center.y - origin.y - h);
+        if (dx > radius + w || dy > radius + h) {
+            return false;
+        }
+        if (dx <= w || dy <= h) {
+            return true;
+        }
+        return (dx - w) * (dx - w) + (dy - h) * (dy - h) <= radius * radius;
+    }
+
+    /**
+     * Grows this rectangle to the smallest one holding it and another.
+     *
+     * @param r The other rectangle.
+     * @return This rectangle, after growing.
+     */
+    Rect &merge(const Rect &r) {
+        float minX = std::min(getMinX(), r.getMinX());
+        float minY = std::min(getMinY(), r.getMinY());
+        float maxX = std::max(getMaxX(), r.getMaxX());
+        float maxY = std::max(getMaxY(), r.getMaxY());
+        origin = Vec2(minX, minY);
+        size = Size(maxX - minX, maxY - minY);
+        return *this;
+    }
+
+    /**
+     * Returns the smallest rectangle holding this one and another.
+     *
+     * @param r The other rectangle.
+     * @return The merged rectangle.
+     */
+    Rect getMerge(const Rect &r) const {
+        Rect copy(*this);
+        return copy.merge(r);
+    }
+
+    /**
+     * Grows this rectangle to the smallest one holding it and another.
+     *
+     * @param r The other rectangle.
+     * @return This rectangle, after growing.
+     */
+    Rect &operator+=(const Rect &r) { return merge(r); }
+};
+
+} // namespace rtree
+
+using namespace rtree;
+
+#endif
+
+#endif
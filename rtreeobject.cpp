@@ -1,7 +1,5 @@
 #include "rtreeobject.h"
-#include <cugl/cugl.h>
-
-using namespace cugl;
+#include "rtreegeometry.h"
 
 RTreeObject::RTreeObject(float x, float y, float width, float height) {
     rect = Rect(x, y, width, height);
@@ -27,9 +25,3 @@ std::string RTreeObject::print() {
            std::to_string(rect.getMaxX()) + ", " +
            std::to_string(rect.getMaxY()) + ")]\n";
 }
-
-void RTreeObject::draw(const std::shared_ptr<SpriteBatch>& batch) {
-    Rect r = Rect((rect.origin.x) / 1024, (rect.origin.y) / 576,
-                  (rect.size.width) / 1024, (rect.size.height) / 576);
-    batch->outline(r);
-}
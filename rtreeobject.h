@@ -5,14 +5,15 @@
 #include <random>
 #include <string>
 #include <vector>
-#include <cugl/cugl.h>
-
-using namespace cugl;
+#include "rtreegeometry.h"
 
 /**
  * Container class for objects stored in the RTree that specifies its bounding box.
+ *
+ * Objects must be owned by a shared pointer, which the RTree recovers when it
+ * returns search results.
  */
-class RTreeObject {
+class RTreeObject : public std::enable_shared_from_this<RTreeObject> {
 public:
     /** The bounding box of this object. */
     Rect rect;
@@ -35,9 +36,6 @@ public:
 
     // REMOVE BEFORE SUBMITTING
     std::string print();
-    
-    // REMOVE BEFORE SUBMITTING
-    void draw(const std::shared_ptr<SpriteBatch>& batch);
 };
 
 #endif
@@ -0,0 +1,219 @@
+#include "rtreepool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * Creates a thread pool.
+ *
+ * @param threads The number of threads that run each loop, including the
+ * calling thread. Values below 1 are treated as 1.
+ */
+RTreeThreadPool::RTreeThreadPool(unsigned int threads)
+    : task(nullptr), stealingTask(nullptr), taskCount(0), next(0), finished(0),
+      generation(0), stopping(false) {
+    ranges.reset(new TaskRange[threads > 1 ? threads : 1]);
+    for (unsigned int i = 1; i < threads; ++i) {
+        workers.emplace_back(&RTreeThreadPool::workerLoop, this, i);
+    }
+}
+
+/**
+ * Stops and joins the worker threads.
+ */
+RTreeThreadPool::~RTreeThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Runs tasks of the current loop until none are left.
+ *
+ * @param thread The index of the calling thread in the pool.
+ */
+void RTreeThreadPool::drain(unsigned int thread) {
+    if (task != nullptr) {
+        for (size_t i = next.fetch_add(1); i < taskCount; i = next.fetch_add(1)) {
+            (*task)(i);
+        }
+        return;
+    }
+
+    // Every task sits in exactly one range until it is taken, and stolen
+    // tasks belong to the thief, so a thread may leave once no range it
+    // looks at has tasks left
+    unsigned int threads = size();
+    size_t index;
+    while (true) {
+        while (takeTask(thread, index)) {
+            (*stealingTask)(thread, index);
+        }
+        bool stole = false;
+        for (unsigned int k = 1; k < threads && !stole; ++k) {
+            stole = stealTasks((thread + k) % threads, thread);
+        }
+        if (!stole) {
+            return;
+        }
+    }
+}
+
+/**
+ * Takes the first task left in the range of a thread.
+ *
+ * @param thread The index of the thread.
+ * @param index Set to the index of the task taken.
+ * @return Whether a task was left.
+ */
+bool RTreeThreadPool::takeTask(unsigned int thread, size_t &index) {
+    std::atomic<uint64_t> &bounds = ranges[thread].bounds;
+    uint64_t current = bounds.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t first = current & 0xffffffff;
+        uint64_t end = current >> 32;
+        if (first >= end) {
+            return false;
+        }
+        if (bounds.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                         std::memory_order_relaxed)) {
+            index = first;
+            return true;
+        }
+    }
+}
+
+/**
+ * Moves the later half of the tasks left to one thread into the empty range
+ * of another.
+ *
+ * @param victim The index of the thread to steal from.
+ * @param thief The index of the thread stealing.
+ * @return Whether any tasks were stolen.
+ */
+bool RTreeThreadPool::stealTasks(unsigned int victim, unsigned int thief) {
+    std::atomic<uint64_t> &bounds = ranges[victim].bounds;
+    uint64_t current = bounds.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t first = current & 0xffffffff;
+        uint64_t end = current >> 32;
+        if (first >= end) {
+            return false;
+        }
+        uint64_t split = end - (end - first + 1) / 2;
+        if (bounds.compare_exchange_weak(current, first | split << 32,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_relaxed)) {
+            ranges[thief].bounds.store(split | end << 32, std::memory_order_release);
+            return true;
+        }
+    }
+}
+
+/**
+ * Waits for loops and works on them until the pool is destroyed.
+ *
+ * @param thread The index of the worker in the pool, from 1.
+ */
+void RTreeThreadPool::workerLoop(unsigned int thread) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) {
+            return;
+        }
+        seen = generation;
+
+        lock.unlock();
+        drain(thread);
+        lock.lock();
+
+        finished += 1;
+        if (finished == workers.size()) {
+            done.notify_one();
+        }
+    }
+}
+
+/**
+ * Starts the current loop on the workers, runs the calling thread's share of
+ * it, and waits for the workers to leave it.
+ */
+void RTreeThreadPool::runLoop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = 0;
+        generation += 1;
+    }
+    wake.notify_all();
+
+    drain(0);
+
+    // Workers read the task until they leave the loop, so wait for all of them
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return finished == workers.size(); });
+    task = nullptr;
+    stealingTask = nullptr;
+}
+
+/**
+ * Calls a task once for each index in [0, count) across the threads of
+ * the pool, and waits for every call to finish.
+ *
+ * @param count The number of tasks.
+ * @param fn The task, called with the index of each task.
+ */
+void RTreeThreadPool::run(size_t count, const std::function<void(size_t)> &fn) {
+    if (workers.empty() || count < 2) {
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &fn;
+        taskCount = count;
+        next = 0;
+    }
+    runLoop();
+}
+
+/**
+ * Calls a task once for each index in [0, count) across the threads of the
+ * pool with work stealing, and waits for every call to finish.
+ *
+ * @param count The number of tasks, less than 2^32.
+ * @param fn The task, called with the index of the thread and of the task.
+ */
+void RTreeThreadPool::runStealing(size_t count,
+        const std::function<void(unsigned int, size_t)> &fn) {
+    if (workers.empty() || count < 2) {
+        for (size_t i = 0; i < count; ++i) {
+            fn(0, i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stealingTask = &fn;
+        unsigned int threads = size();
+        for (unsigned int i = 0; i < threads; ++i) {
+            uint64_t first = count * i / threads;
+            uint64_t end = count * (i + 1) / threads;
+            ranges[i].bounds.store(first | end << 32, std::memory_order_relaxed);
+        }
+    }
+    runLoop();
+}
@@ -0,0 +1,203 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads that run the tasks of a parallel loop.
+ *
+ * The thread calling run() works on the loop alongside the workers and
+ * returns once every task has finished, so a pool of n threads starts n - 1
+ * workers. Tasks are handed out in order from a shared counter, or by
+ * runStealing() from per-thread ranges with work stealing. A pool runs one
+ * loop at a time and neither call may be made from inside a task.
+ */
+class RTreeThreadPool {
+private:
+    /** The worker threads. */
+    std::vector<std::thread> workers;
+
+    /** Guards every member below except next. */
+    std::mutex mutex;
+
+    /** Signaled when a loop starts or the pool is destroyed. */
+    std::condition_variable wake;
+
+    /** Signaled when the last worker leaves a loop. */
+    std::condition_variable done;
+
+    /** The task of the current loop, if it was started by run(). */
+    const std::function<void(size_t)> *task;
+
+    /** The task of the current loop, if it was started by runStealing(). */
+    const std::function<void(unsigned int, size_t)> *stealingTask;
+
+    /**
+     * The tasks left to a thread by runStealing(), with the first index in
+     * the low 32 bits and the end in the high 32 bits. Each range sits on its
+     * own cache line so that threads taking from their own ranges do not
+     * contend.
+     */
+    struct alignas(64) TaskRange {
+        std::atomic<uint64_t> bounds;
+    };
+
+    /** The range of tasks of each thread, the calling thread first. */
+    std::unique_ptr<TaskRange[]> ranges;
+
+    /** The number of tasks in the current loop. */
+    size_t taskCount;
+
+    /** The index of the next task to hand out. */
+    std::atomic<size_t> next;
+
+    /** The number of workers that have left the current loop. */
+    size_t finished;
+
+    /** Incremented each time a loop starts. */
+    uint64_t generation;
+
+    /** Whether the pool is being destroyed. */
+    bool stopping;
+
+    /**
+     * Runs tasks of the current loop until none are left.
+     *
+     * @param thread The index of the calling thread in the pool.
+     */
+    void drain(unsigned int thread);
+
+    /**
+     * Takes the first task left in the range of a thread.
+     *
+     * @param thread The index of the thread.
+     * @param index Set to the index of the task taken.
+     * @return Whether a task was left.
+     */
+    bool takeTask(unsigned int thread, size_t &index);
+
+    /**
+     * Moves the later half of the tasks left to one thread into the empty
+     * range of another.
+     *
+     * @param victim The index of the thread to steal from.
+     * @param thief The index of the thread stealing.
+     * @return Whether any tasks were stolen.
+     */
+    bool stealTasks(unsigned int victim, unsigned int thief);
+
+    /**
+     * Waits for loops and works on them until the pool is destroyed.
+     *
+     * @param thread The index of the worker in the pool, from 1.
+     */
+    void workerLoop(unsigned int thread);
+
+    /**
+     * Starts the current loop on the workers, runs the calling thread's share
+     * of it, and waits for the workers to leave it.
+     */
+    void runLoop();
+
+public:
+    /**
+     * Creates a thread pool.
+     *
+     * @param threads The number of threads that run each loop, including the
+     * calling thread. Values below 1 are treated as 1.
+     */
+    RTreeThreadPool(unsigned int threads);
+
+    /**
+     * Stops and joins the worker threads.
+     */
+    ~RTreeThreadPool();
+
+    RTreeThreadPool(const RTreeThreadPool &) = delete;
+    RTreeThreadPool &operator=(const RTreeThreadPool &) = delete;
+
+    /**
+     * Returns the number of threads that run each loop, including the calling
+     * thread.
+     *
+     * @return The number of threads.
+     */
+    unsigned int size() const { return (unsigned int)workers.size() + 1; }
+
+    /**
+     * Calls a task once for each index in [0, count) across the threads of
+     * the pool, and waits for every call to finish.
+     *
+     * @param count The number of tasks.
+     * @param fn The task, called with the index of each task.
+     */
+    void run(size_t count, const std::function<void(size_t)> &fn);
+
+    /**
+     * Calls a task once for each index in [0, count) across the threads of
+     * the pool with work stealing, and waits for every call to finish.
+     *
+     * Each thread starts with an even share of consecutive indices and runs
+     * them in order. A thread that runs out steals the later half of the
+     * indices left to another thread, so uneven tasks stay balanced while
+     * each thread still runs mostly neighboring indices. The task is also
+     * called with the index of the thread running it, from 0 for the calling
+     * thread to size() - 1, so it can write to storage of its own thread
+     * without locking.
+     *
+     * @param count The number of tasks, less than 2^32.
+     * @param fn The task, called with the index of the thread and of the task.
+     */
+    void runStealing(size_t count, const std::function<void(unsigned int, size_t)> &fn);
+
+    /**
+     * Sorts a range across the threads of the pool.
+     *
+     * The range is cut into one run per thread, the runs are sorted in
+     * parallel, and then merged pairwise in parallel. With a strict total
+     * order the result is the same as std::sort.
+     *
+     * @param begin The start of the range.
+     * @param end The end of the range.
+     * @param comp The comparison to sort by.
+     */
+    template <typename Iterator, typename Compare>
+    void sort(Iterator begin, Iterator end, Compare comp) {
+        size_t length = std::distance(begin, end);
+        size_t runs = std::min<size_t>(size(), length / 1024);
+        if (runs < 2) {
+            std::sort(begin, end, comp);
+            return;
+        }
+
+        std::vector<Iterator> bounds;
+        for (size_t i = 0; i <= runs; ++i) {
+            bounds.push_back(begin + length * i / runs);
+        }
+        run(runs, [&](size_t i) { std::sort(bounds[i], bounds[i + 1], comp); });
+
+        for (size_t width = 1; width < runs; width *= 2) {
+            size_t merges = (runs + 2 * width - 1) / (2 * width);
+            run(merges, [&](size_t i) {
+                size_t first = 2 * width * i;
+                size_t middle = std::min(first + width, runs);
+                size_t last = std::min(first + 2 * width, runs);
+                if (middle < last) {
+                    std::inplace_merge(bounds[first], bounds[middle], bounds[last], comp);
+                }
+            });
+        }
+    }
+};
+
+#endif
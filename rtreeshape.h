@@ -0,0 +1,98 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <cstdint>
+
+#include "rtreearena.h"
+#include "rtreegeometry.h"
+
+/*
+ * Query shapes accepted by RTree::query.
+ *
+ * A shape provides mask(), which tests consecutive nodes of the arena at once
+ * and also reports the nodes that lie entirely inside the shape, and matches(),
+ * which tests the exact rect of an object.
+ */
+
+/**
+ * A circular query area matching objects that intersect it.
+ */
+struct RTreeCircle {
+    /** The center of the circle. */
+    Vec2 center;
+    /** The radius of the circle. */
+    float radius;
+
+    RTreeCircle(const Vec2 center, float radius) : center(center), radius(radius) {}
+
+    uint32_t mask(const RTreeNodeArena &arena, uint32_t first, uint32_t count,
+            uint32_t &inside) const {
+        inside = 0;
+        return arena.circleMask(first, count, center, radius);
+    }
+
+    bool matches(const Rect &r) const {
+        return r.doesIntersect(center, radius);
+    }
+};
+
+/**
+ * A rectangular query area matching objects that intersect it.
+ */
+struct RTreeIntersects {
+    /** The query rectangle. */
+    Rect area;
+
+    explicit RTreeIntersects(const Rect &area) : area(area) {}
+
+    uint32_t mask(const RTreeNodeArena &arena, uint32_t first, uint32_t count,
+            uint32_t &inside) const {
+        return arena.rectMask(first, count, area, inside);
+    }
+
+    bool matches(const Rect &r) const {
+        return r.doesIntersect(area);
+    }
+};
+
+/**
+ * A rectangular query area matching objects that lie entirely inside it.
+ */
+struct RTreeInside {
+    /** The query rectangle. */
+    Rect area;
+
+    explicit RTreeInside(const Rect &area) : area(area) {}
+
+    uint32_t mask(const RTreeNodeArena &arena, uint32_t first, uint32_t count,
+            uint32_t &inside) const {
+        return arena.rectMask(first, count, area, inside);
+    }
+
+    bool matches(const Rect &r) const {
+        return r.inside(area);
+    }
+};
+
+/**
+ * Converts a rectangle to the shape that matches objects intersecting it.
+ *
+ * @param area The query rectangle.
+ * @return The query shape.
+ */
+inline RTreeIntersects toQueryShape(const Rect &area) {
+    return RTreeIntersects(area);
+}
+
+/**
+ * Returns a query shape unchanged.
+ *
+ * @param shape The query shape.
+ * @return The same shape.
+ */
+template <typename Shape>
+inline const Shape &toQueryShape(const Shape &shape) {
+    return shape;
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstdint>
+
+// Define RTREE_NO_SIMD to force the scalar kernels on any platform.
+#if !defined(RTREE_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define RTREE_AVX 1
+#elif !defined(RTREE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define RTREE_SSE 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * Returns the index of the lowest set bit of a non-zero mask.
+ *
+ * @param mask The mask to scan.
+ * @return The index of the lowest set bit.
+ */
+inline uint32_t lowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+/**
+ * Returns a mask with the lowest count bits set.
+ *
+ * @param count The number of bits to set, at most 32.
+ * @return The mask.
+ */
+inline uint32_t lowBits(uint32_t count) {
+    return count >= 32 ? UINT32_MAX : (1u << count) - 1;
+}
+
+/**
+ * Tests up to 32 boxes stored as structure-of-arrays against a circle.
+ *
+ * A box intersects the circle if its closest point to the center of the
+ * circle lies within the radius. The arrays are read in groups of up to eight
+ * floats, so they must stay readable up to count rounded up to a multiple of
+ * eight. The lanes past count are ignored.
+ *
+ * @param minX The minimum x-coordinates of the boxes.
+ * @param minY The minimum y-coordinates of the boxes.
+ * @param maxX The maximum x-coordinates of the boxes.
+ * @param maxY The maximum y-coordinates of the boxes.
+ * @param count The number of boxes to test, at most 32.
+ * @param cx The x-coordinate of the center of the circle.
+ * @param cy The y-coordinate of the center of the circle.
+ * @param radius The radius of the circle.
+ * @return A mask with bit i set if box i intersects the circle.
+ */
+inline uint32_t circleIntersectMask(const float *minX, const float *minY,
+        const float *maxX, const float *maxY, uint32_t count,
+        float cx, float cy, float radius) {
+    uint32_t mask = 0;
+    float radiusSquared = radius * radius;
+#if defined(RTREE_AVX)
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 x = _mm256_set1_ps(cx);
+    const __m256 y = _mm256_set1_ps(cy);
+    const __m256 r2 = _mm256_set1_ps(radiusSquared);
+    for (uint32_t i = 0; i < count; i += 8) {
+        __m256 dx = _mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(minX + i), x),
+                                  _mm256_sub_ps(x, _mm256_loadu_ps(maxX + i)));
+        __m256 dy = _mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(minY + i), y),
+                                  _mm256_sub_ps(y, _mm256_loadu_ps(maxY + i)));
+        dx = _mm256_max_ps(dx, zero);
+        dy = _mm256_max_ps(dy, zero);
+        __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        mask |= (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ)) << i;
+    }
+#elif defined(RTREE_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 x = _mm_set1_ps(cx);
+    const __m128 y = _mm_set1_ps(cy);
+    const __m128 r2 = _mm_set1_ps(radiusSquared);
+    for (uint32_t i = 0; i < count; i += 4) {
+        __m128 dx = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX + i), x),
+                               _mm_sub_ps(x, _mm_loadu_ps(maxX + i)));
+        __m128 dy = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minY + i), y),
+                               _mm_sub_ps(y, _mm_loadu_ps(maxY + i)));
+        dx = _mm_max_ps(dx, zero);
+        dy = _mm_max_ps(dy, zero);
+        __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        mask |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(d2, r2)) << i;
+    }
+#else
+    for (uint32_t i = 0; i < count; ++i) {
+        float dx = minX[i] - cx > cx - maxX[i] ? minX[i] - cx : cx - maxX[i];
+        float dy = minY[i] - cy > cy - maxY[i] ? minY[i] - cy : cy - maxY[i];
+        dx = dx > 0 ? dx : 0;
+        dy = dy > 0 ? dy : 0;
+        mask |= (uint32_t)(dx * dx + dy * dy <= radiusSquared) << i;
+    }
+#endif
+    return mask & lowBits(count);
+}
+
+/**
+ * Tests up to 32 boxes stored as structure-of-arrays against a query box.
+ *
+ * Boxes that only touch the query box count as intersecting it. The arrays
+ * have the same padding requirements as in circleIntersectMask.
+ *
+ * @param minX The minimum x-coordinates of the boxes.
+ * @param minY The minimum y-coordinates of the boxes.
+ * @param maxX The maximum x-coordinates of the boxes.
+ * @param maxY The maximum y-coordinates of the boxes.
+ * @param count The number of boxes to test, at most 32.
+ * @param qMinX The minimum x-coordinate of the query box.
+ * @param qMinY The minimum y-coordinate of the query box.
+ * @param qMaxX The maximum x-coordinate of the query box.
+ * @param qMaxY The maximum y-coordinate of the query box.
+ * @param inside Set to a mask with bit i set if box i lies inside the query box.
+ * @return A mask with bit i set if box i intersects the query box.
+ */
+inline uint32_t rectIntersectMask(const float *minX, const float *minY,
+        const float *maxX, const float *maxY, uint32_t count,
+        float qMinX, float qMinY, float qMaxX, float qMaxY, uint32_t &inside) {
+    uint32_t mask = 0;
+    inside = 0;
+#if defined(RTREE_AVX)
+    const __m256 lowX = _mm256_set1_ps(qMinX);
+    const __m256 lowY = _mm256_set1_ps(qMinY);
+    const __m256 highX = _mm256_set1_ps(qMaxX);
+    const __m256 highY = _mm256_set1_ps(qMaxY);
+    for (uint32_t i = 0; i < count; i += 8) {
+        __m256 x0 = _mm256_loadu_ps(minX + i);
+        __m256 y0 = _mm256_loadu_ps(minY + i);
+        __m256 x1 = _mm256_loadu_ps(maxX + i);
+        __m256 y1 = _mm256_loadu_ps(maxY + i);
+        __m256 meets = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(x1, lowX, _CMP_GE_OQ), _mm256_cmp_ps(x0, highX, _CMP_LE_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(y1, lowY, _CMP_GE_OQ), _mm256_cmp_ps(y0, highY, _CMP_LE_OQ)));
+        __m256 within = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(x0, lowX, _CMP_GE_OQ), _mm256_cmp_ps(x1, highX, _CMP_LE_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(y0, lowY, _CMP_GE_OQ), _mm256_cmp_ps(y1, highY, _CMP_LE_OQ)));
+        mask |= (uint32_t)_mm256_movemask_ps(meets) << i;
+        inside |= (uint32_t)_mm256_movemask_ps(within) << i;
+    }
+#elif defined(RTREE_SSE)
+    const __m128 lowX = _mm_set1_ps(qMinX);
+    const __m128 lowY = _mm_set1_ps(qMinY);
+    const __m128 highX = _mm_set1_ps(qMaxX);
+    const __m128 highY = _mm_set1_ps(qMaxY);
+    for (uint32_t i = 0; i < count; i += 4) {
+        __m128 x0 = _mm_loadu_ps(minX + i);
+        __m128 y0 = _mm_loadu_ps(minY + i);
+        __m128 x1 = _mm_loadu_ps(maxX + i);
+        __m128 y1 = _mm_loadu_ps(maxY + i);
+        __m128 meets = _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(x1, lowX), _mm_cmple_ps(x0, highX)),
+            _mm_and_ps(_mm_cmpge_ps(y1, lowY), _mm_cmple_ps(y0, highY)));
+        __m128 within = _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(x0, lowX), _mm_cmple_ps(x1, highX)),
+            _mm_and_ps(_mm_cmpge_ps(y0, lowY), _mm_cmple_ps(y1, highY)));
+        mask |= (uint32_t)_mm_movemask_ps(meets) << i;
+        inside |= (uint32_t)_mm_movemask_ps(within) << i;
+    }
+#else
+    for (uint32_t i = 0; i < count; ++i) {
+        bool meets = maxX[i] >= qMinX && minX[i] <= qMaxX &&
+                     maxY[i] >= qMinY && minY[i] <= qMaxY;
+        bool within = minX[i] >= qMinX && maxX[i] <= qMaxX &&
+                      minY[i] >= qMinY && maxY[i] <= qMaxY;
+        mask |= (uint32_t)meets << i;
+        inside |= (uint32_t)within << i;
+    }
+#endif
+    inside &= lowBits(count);
+    return mask & lowBits(count);
+}
+
+#endif
@@ -0,0 +1,140 @@
+#include "rtreesnapshot.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "rtreearena.h"
+#include "rtreeobject.h"
+#include "rtreeshape.h"
+
+/**
+ * Creates an empty snapshot.
+ */
+RTreeSnapshot::RTreeSnapshot() : nodes(1), root(RTreeNodeArena::NONE) {}
+
+/**
+ * Creates a snapshot of a tree.
+ *
+ * @param nodes A view of the arena of the tree from share().
+ * @param root The id of the root node of the tree.
+ */
+RTreeSnapshot::RTreeSnapshot(RTreeNodeArena &&nodes, uint32_t root)
+    : nodes(std::move(nodes)), root(root) {}
+
+/**
+ * Keeps objects alive for as long as this snapshot.
+ *
+ * @param objects The objects, moved out of the list.
+ */
+void RTreeSnapshot::retain(std::vector<std::shared_ptr<RTreeObject>> &objects) {
+    removed.insert(removed.end(), std::make_move_iterator(objects.begin()),
+                   std::make_move_iterator(objects.end()));
+    objects.clear();
+}
+
+/**
+ * Appends the objects whose bounding boxes meet a circle to a vector.
+ *
+ * @param center The center of the circle.
+ * @param radius The radius of the circle.
+ * @param res The vector to append the objects to.
+ */
+void RTreeSnapshot::search(const Vec2 center, float radius,
+        std::vector<RTreeObject *> &res) const {
+    query(RTreeCircle(center, radius), [&res](RTreeObject &obj) { res.push_back(&obj); });
+}
+
+/**
+ * Appends the objects whose bounding boxes meet a rectangle to a vector.
+ *
+ * @param area The rectangle.
+ * @param res The vector to append the objects to.
+ */
+void RTreeSnapshot::search(const Rect &area, std::vector<RTreeObject *> &res) const {
+    query(RTreeIntersects(area), [&res](RTreeObject &obj) { res.push_back(&obj); });
+}
+
+/**
+ * Creates the epochs of a tree, with an empty snapshot as current.
+ */
+RTreeEpochs::RTreeEpochs() : epoch(1), live(new RTreeSnapshot()), published(false) {
+    for (ReaderSlot &reader : readers) {
+        reader.epoch.store(0, std::memory_order_relaxed);
+    }
+    current.store(live.get());
+}
+
+/**
+ * Pins the current epoch and loads the current snapshot.
+ *
+ * @param slot Set to the slot pinned, to be passed to unpin().
+ * @return The snapshot, valid until the slot is unpinned.
+ */
+const RTreeSnapshot *RTreeEpochs::pin(size_t &slot) const {
+    // Start from a slot that depends on the thread, so that readers on
+    // different threads rarely try the same slots
+    size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+    while (true) {
+        for (size_t i = 0; i < READER_SLOTS; ++i) {
+            slot = (start + i) % READER_SLOTS;
+            uint64_t free = 0;
+            if (readers[slot].epoch.compare_exchange_strong(free, epoch.load())) {
+                // The writer makes a new snapshot current before advancing
+                // the epoch, so the snapshot loaded here is current at the
+                // pinned epoch or later, and is not freed while it is pinned
+                return current.load();
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * Makes a snapshot current and retires the previous one.
+ *
+ * @param snapshot The new snapshot.
+ * @param removed Objects removed from the tree since the previous snapshot
+ * was published, kept alive until that snapshot is freed.
+ */
+void RTreeEpochs::publish(std::unique_ptr<RTreeSnapshot> snapshot,
+        std::vector<std::shared_ptr<RTreeObject>> &removed) {
+    live->retain(removed);
+    current.store(snapshot.get());
+    Retired old;
+    old.snapshot = std::move(live);
+    old.epoch = epoch.fetch_add(1);
+    retired.push_back(std::move(old));
+    live = std::move(snapshot);
+    published = true;
+    reclaim();
+}
+
+/**
+ * Frees the retired snapshots that no reader can still see.
+ *
+ * @return The number of retired snapshots still waiting.
+ */
+size_t RTreeEpochs::reclaim() {
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot &reader : readers) {
+        uint64_t pinned = reader.epoch.load();
+        if (pinned != 0 && pinned < oldest) {
+            oldest = pinned;
+        }
+    }
+
+    // Snapshots are retired in order of epoch, so the freeable ones come first
+    size_t freed = 0;
+    while (freed < retired.size() && retired[freed].epoch < oldest) {
+        freed += 1;
+    }
+    retired.erase(retired.begin(), retired.begin() + freed);
+    return retired.size();
+}
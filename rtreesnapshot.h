@@ -0,0 +1,322 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "rtreearena.h"
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+#include "rtreeshape.h"
+#include "rtreesimd.h"
+
+/**
+ * Immutable picture of the nodes of an RTree, published by RTree::publish().
+ *
+ * A snapshot shares the chunks of the arena of its tree through
+ * RTreeNodeArena::share(), so publishing costs a copy of the chunk table, and
+ * the tree copies each chunk once the next time it writes to it.
+ *
+ * Searches test the bounding boxes stored in the snapshot and never read the
+ * rects of the objects, which the writer may be changing meanwhile. They find
+ * every object whose exact rect matched the search when the snapshot was
+ * published, along with some objects that only came near it. Objects removed
+ * from the tree after the snapshot was published are kept alive until the
+ * snapshot is freed.
+ */
+class RTreeSnapshot {
+private:
+    /** The nodes, shared with the arena of the tree. */
+    RTreeNodeArena nodes;
+
+    /** The id of the root node, or NONE if the snapshot is empty. */
+    uint32_t root;
+
+    /** Objects removed from the tree since this snapshot was published. */
+    std::vector<std::shared_ptr<RTreeObject>> removed;
+
+    /**
+     * Calls a visitor with every object in a subtree whose bounding box
+     * matches a shape.
+     *
+     * @param id The root of the subtree.
+     * @param shape The query shape.
+     * @param visitor The visitor to call with each matching object.
+     * @return false if the visitor stopped the query, and true otherwise.
+     */
+    template <typename Shape, typename Visitor>
+    bool visitNode(uint32_t id, const Shape &shape, Visitor &visitor) const;
+
+    /**
+     * Calls a visitor with an object, converting a void result to true.
+     *
+     * @param visitor The visitor.
+     * @param obj The object.
+     * @return false if the visitor asked to stop, and true otherwise.
+     */
+    template <typename Visitor>
+    static bool callVisitor(Visitor &visitor, RTreeObject &obj) {
+        if constexpr (std::is_void<decltype(visitor(obj))>::value) {
+            visitor(obj);
+            return true;
+        } else {
+            return visitor(obj);
+        }
+    }
+
+public:
+    /**
+     * Creates an empty snapshot.
+     */
+    RTreeSnapshot();
+
+    /**
+     * Creates a snapshot of a tree.
+     *
+     * @param nodes A view of the arena of the tree from share().
+     * @param root The id of the root node of the tree.
+     */
+    RTreeSnapshot(RTreeNodeArena &&nodes, uint32_t root);
+
+    /**
+     * Keeps objects alive for as long as this snapshot.
+     *
+     * @param objects The objects, moved out of the list.
+     */
+    void retain(std::vector<std::shared_ptr<RTreeObject>> &objects);
+
+    /**
+     * Calls a visitor with every object whose bounding box matches a query
+     * shape.
+     *
+     * The shape is an RTreeCircle, RTreeIntersects or RTreeInside, or a Rect,
+     * and is tested against the padded bounding boxes of the objects. The
+     * visitor is called with an RTreeObject& and may return false to stop the
+     * query early.
+     *
+     * @param shape The query shape.
+     * @param visitor The visitor to call with each matching object.
+     * @return false if the visitor stopped the query, and true otherwise.
+     */
+    template <typename Shape, typename Visitor>
+    bool query(const Shape &shape, Visitor &&visitor) const {
+        return root == RTreeNodeArena::NONE ||
+               visitNode(root, toQueryShape(shape), visitor);
+    }
+
+    /**
+     * Appends the objects whose bounding boxes meet a circle to a vector.
+     *
+     * @param center The center of the circle.
+     * @param radius The radius of the circle.
+     * @param res The vector to append the objects to.
+     */
+    void search(const Vec2 center, float radius, std::vector<RTreeObject *> &res) const;
+
+    /**
+     * Appends the objects whose bounding boxes meet a rectangle to a vector.
+     *
+     * @param area The rectangle.
+     * @param res The vector to append the objects to.
+     */
+    void search(const Rect &area, std::vector<RTreeObject *> &res) const;
+};
+
+/**
+ * Publishes snapshots of an RTree to reader threads, and frees them once no
+ * reader can still see them.
+ *
+ * Readers pin the current epoch in one of a fixed set of slots and then load
+ * the current snapshot, without locks. The writer replaces the snapshot,
+ * advances the epoch, and retires the old snapshot with the epoch it was
+ * replaced in. A retired snapshot is freed once every pinned slot holds a
+ * later epoch, since a reader that pinned a later epoch can only have loaded
+ * a newer snapshot. Only one thread may publish and reclaim.
+ */
+class RTreeEpochs {
+public:
+    /** The most readers that can be pinned at once. Others wait for a slot. */
+    static constexpr size_t READER_SLOTS = 64;
+
+private:
+    /** The epoch pinned by a reader, or 0 if the slot is free. */
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch;
+    };
+
+    /** A replaced snapshot waiting for its readers to leave. */
+    struct Retired {
+        /** The snapshot. */
+        std::unique_ptr<RTreeSnapshot> snapshot;
+        /** The epoch the snapshot was replaced in. */
+        uint64_t epoch;
+    };
+
+    /** The slots of the readers. */
+    mutable ReaderSlot readers[READER_SLOTS];
+
+    /** The current epoch, starting at 1. */
+    std::atomic<uint64_t> epoch;
+
+    /** The snapshot readers load. */
+    std::atomic<const RTreeSnapshot *> current;
+
+    /** The owner of the current snapshot. */
+    std::unique_ptr<RTreeSnapshot> live;
+
+    /** Replaced snapshots, oldest first. */
+    std::vector<Retired> retired;
+
+    /** Whether a snapshot was ever published. */
+    bool published;
+
+public:
+    /**
+     * Creates the epochs of a tree, with an empty snapshot as current.
+     */
+    RTreeEpochs();
+
+    /**
+     * Frees every snapshot. No reader may be pinned.
+     */
+    ~RTreeEpochs() = default;
+
+    RTreeEpochs(const RTreeEpochs &) = delete;
+    RTreeEpochs &operator=(const RTreeEpochs &) = delete;
+
+    /**
+     * Pins the current epoch and loads the current snapshot.
+     *
+     * @param slot Set to the slot pinned, to be passed to unpin().
+     * @return The snapshot, valid until the slot is unpinned.
+     */
+    const RTreeSnapshot *pin(size_t &slot) const;
+
+    /**
+     * Releases a slot pinned by pin().
+     *
+     * @param slot The slot.
+     */
+    void unpin(size_t slot) const {
+        readers[slot].epoch.store(0, std::memory_order_release);
+    }
+
+    /**
+     * Makes a snapshot current and retires the previous one.
+     *
+     * @param snapshot The new snapshot.
+     * @param removed Objects removed from the tree since the previous
+     * snapshot was published, kept alive until that snapshot is freed.
+     */
+    void publish(std::unique_ptr<RTreeSnapshot> snapshot,
+                 std::vector<std::shared_ptr<RTreeObject>> &removed);
+
+    /**
+     * Frees the retired snapshots that no reader can still see.
+     *
+     * @return The number of retired snapshots still waiting.
+     */
+    size_t reclaim();
+
+    /**
+     * Returns whether a snapshot was ever published.
+     *
+     * @return Whether readers may be seeing a snapshot of the tree.
+     */
+    bool hasPublished() const { return published; }
+};
+
+/**
+ * A pinned snapshot of an RTree, returned by RTree::read().
+ *
+ * The snapshot stays valid and unchanged for the lifetime of the guard, while
+ * the tree goes on changing. Guards should be short-lived, since the
+ * snapshots they pin and everything they share cannot be freed meanwhile, and
+ * must not outlive their tree.
+ */
+class RTreeReadGuard {
+private:
+    /** The epochs the snapshot was pinned in, or null once moved from. */
+    const RTreeEpochs *epochs;
+
+    /** The slot pinned. */
+    size_t slot;
+
+    /** The snapshot. */
+    const RTreeSnapshot *snapshot;
+
+public:
+    /**
+     * Pins the current snapshot of a tree.
+     *
+     * @param epochs The epochs of the tree.
+     */
+    explicit RTreeReadGuard(const RTreeEpochs &epochs) : epochs(&epochs), slot(0) {
+        snapshot = epochs.pin(slot);
+    }
+
+    /**
+     * Unpins the snapshot.
+     */
+    ~RTreeReadGuard() {
+        if (epochs != nullptr) {
+            epochs->unpin(slot);
+        }
+    }
+
+    RTreeReadGuard(RTreeReadGuard &&other)
+        : epochs(other.epochs), slot(other.slot), snapshot(other.snapshot) {
+        other.epochs = nullptr;
+    }
+
+    RTreeReadGuard(const RTreeReadGuard &) = delete;
+    RTreeReadGuard &operator=(const RTreeReadGuard &) = delete;
+    RTreeReadGuard &operator=(RTreeReadGuard &&) = delete;
+
+    /**
+     * Returns the snapshot.
+     *
+     * @return The pinned snapshot.
+     */
+    const RTreeSnapshot &operator*() const { return *snapshot; }
+
+    /**
+     * Returns the snapshot.
+     *
+     * @return The pinned snapshot.
+     */
+    const RTreeSnapshot *operator->() const { return snapshot; }
+};
+
+template <typename Shape, typename Visitor>
+bool RTreeSnapshot::visitNode(uint32_t id, const Shape &shape, Visitor &visitor) const {
+    const RTreeNode &n = nodes[id];
+    for (uint32_t base = 0; base < n.numChildren; base += 32) {
+        uint32_t first = n.firstChild + base;
+        uint32_t inside;
+        uint32_t mask = shape.mask(nodes, first, std::min(n.numChildren - base, 32u), inside);
+        while (mask != 0) {
+            uint32_t i = lowestBit(mask);
+            const RTreeNode &child = nodes[first + i];
+            mask &= mask - 1;
+
+            if (n.level > 0) {
+                if (!visitNode(first + i, shape, visitor)) {
+                    return false;
+                }
+            } else if (((inside >> i) & 1) || shape.matches(child.rect)) {
+                if (!callVisitor(visitor, *child.obj)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,331 @@
+#include "rtreesplit.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "rtreegeometry.h"
+#include "rtreenode.h"
+
+/**
+ * Returns the area of a rectangle.
+ *
+ * @param r The rectangle.
+ * @return The area.
+ */
+static float area(const Rect &r) {
+    return r.size.width * r.size.height;
+}
+
+/**
+ * Returns the area of the intersection of two rectangles, which is 0 if they
+ * do not intersect.
+ *
+ * @param a The first rectangle.
+ * @param b The second rectangle.
+ * @return The area of the intersection.
+ */
+static float overlapArea(const Rect &a, const Rect &b) {
+    float w = std::min(a.getMaxX(), b.getMaxX()) - std::max(a.getMinX(), b.getMinX());
+    float h = std::min(a.getMaxY(), b.getMaxY()) - std::max(a.getMinY(), b.getMinY());
+    return w > 0 && h > 0 ? w * h : 0;
+}
+
+/**
+ * Moves the children assigned to the first group to the front.
+ *
+ * @param entries The children being split.
+ * @param group The group of each child, 1 or 2, reordered along with them.
+ * @return The number of children in the first group.
+ */
+static size_t gatherFirstGroup(std::vector<RTreeNode> &entries,
+        std::vector<unsigned char> &group) {
+    size_t first = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (group[i] == 1) {
+            std::swap(entries[i], entries[first]);
+            std::swap(group[i], group[first]);
+            first += 1;
+        }
+    }
+    return first;
+}
+
+/**
+ * Returns the group that needs every remaining child to reach the minimum
+ * size, if any.
+ *
+ * @param size The number of children in each group.
+ * @param remaining The number of children not yet assigned.
+ * @param minGroup The fewest children either group may hold.
+ * @return 0 or 1 for the group that needs the remaining children, or -1.
+ */
+static int needyGroup(const size_t size[2], size_t remaining, size_t minGroup) {
+    if (size[0] + remaining <= minGroup) {
+        return 0;
+    }
+    if (size[1] + remaining <= minGroup) {
+        return 1;
+    }
+    return -1;
+}
+
+/**
+ * Returns the group whose bounding box grows least by adding a child,
+ * breaking ties by the smaller area and then the fewer children.
+ *
+ * @param bbox The bounding box of each group.
+ * @param size The number of children in each group.
+ * @param r The bounding box of the child.
+ * @return 0 or 1 for the preferred group.
+ */
+static int preferredGroup(const Rect bbox[2], const size_t size[2], const Rect &r) {
+    float growth0 = area(bbox[0].getMerge(r)) - area(bbox[0]);
+    float growth1 = area(bbox[1].getMerge(r)) - area(bbox[1]);
+    if (growth0 != growth1) {
+        return growth0 < growth1 ? 0 : 1;
+    }
+    if (area(bbox[0]) != area(bbox[1])) {
+        return area(bbox[0]) < area(bbox[1]) ? 0 : 1;
+    }
+    return size[0] <= size[1] ? 0 : 1;
+}
+
+/**
+ * Given the children of a node to split, selects the two that lie farthest
+ * apart along either axis, relative to the extent of all children.
+ *
+ * @param entries The children of the node to split
+ * @return Pair of indices into entries of the first elements of the two new nodes
+ */
+static std::pair<size_t, size_t> linearSeeds(const std::vector<RTreeNode> &entries) {
+    const size_t NO_ENTRY = entries.size();
+    size_t maxLowSideEntryX = NO_ENTRY;
+    size_t minHighSideEntryX = NO_ENTRY;
+    size_t maxLowSideEntryY = NO_ENTRY;
+    size_t minHighSideEntryY = NO_ENTRY;
+    Rect bounds = entries[0].rect;
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        bounds += entries[i].rect;
+        if (maxLowSideEntryX == NO_ENTRY ||
+                entries[i].rect.getMinX() > entries[maxLowSideEntryX].rect.getMinX()) {
+            maxLowSideEntryX = i;
+        }
+        if (maxLowSideEntryY == NO_ENTRY ||
+                entries[i].rect.getMinY() > entries[maxLowSideEntryY].rect.getMinY()) {
+            maxLowSideEntryY = i;
+        }
+    }
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if ((minHighSideEntryX == NO_ENTRY ||
+                 entries[i].rect.getMaxX() < entries[minHighSideEntryX].rect.getMaxX()) &&
+                i != maxLowSideEntryX) {
+            minHighSideEntryX = i;
+        }
+        if ((minHighSideEntryY == NO_ENTRY ||
+                 entries[i].rect.getMaxY() < entries[minHighSideEntryY].rect.getMaxY()) &&
+                i != maxLowSideEntryY) {
+            minHighSideEntryY = i;
+        }
+    }
+
+    // The gap from the lowest high side to the highest low side, normalized
+    // by the extent of the node, is largest along the axis that separates the
+    // seeds best
+    double separationX = (double)(entries[maxLowSideEntryX].rect.getMinX() -
+                                  entries[minHighSideEntryX].rect.getMaxX()) /
+                         std::max(bounds.size.width, 1.0f);
+    double separationY = (double)(entries[maxLowSideEntryY].rect.getMinY() -
+                                  entries[minHighSideEntryY].rect.getMaxY()) /
+                         std::max(bounds.size.height, 1.0f);
+
+    if (separationY > separationX) {
+        return std::make_pair(maxLowSideEntryY, minHighSideEntryY);
+    }
+    return std::make_pair(maxLowSideEntryX, minHighSideEntryX);
+}
+
+
+/**
+ * Reorders the children of an overflowing node into two groups.
+ *
+ * @param entries The children, including the one that overflowed the node.
+ * @param minGroup The fewest children either group may hold.
+ * @return The number of children in the first group.
+ */
+size_t RTreeLinearSplit::partition(std::vector<RTreeNode> &entries, size_t minGroup) {
+    std::pair<size_t, size_t> seeds = linearSeeds(entries);
+    std::vector<unsigned char> group(entries.size(), 0);
+    Rect bbox[2] = {entries[seeds.first].rect, entries[seeds.second].rect};
+    size_t size[2] = {1, 1};
+    group[seeds.first] = 1;
+    group[seeds.second] = 2;
+
+    size_t remaining = entries.size() - 2;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (group[i] != 0) {
+            continue;
+        }
+        int g = needyGroup(size, remaining, minGroup);
+        if (g < 0) {
+            g = preferredGroup(bbox, size, entries[i].rect);
+        }
+        group[i] = g + 1;
+        bbox[g] += entries[i].rect;
+        size[g] += 1;
+        remaining -= 1;
+    }
+    return gatherFirstGroup(entries, group);
+}
+
+/**
+ * Reorders the children of an overflowing node into two groups.
+ *
+ * @param entries The children, including the one that overflowed the node.
+ * @param minGroup The fewest children either group may hold.
+ * @return The number of children in the first group.
+ */
+size_t RTreeQuadraticSplit::partition(std::vector<RTreeNode> &entries, size_t minGroup) {
+    size_t count = entries.size();
+    size_t seed1 = 0;
+    size_t seed2 = 1;
+    float worstWaste = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t j = i + 1; j < count; ++j) {
+            const Rect &a = entries[i].rect;
+            const Rect &b = entries[j].rect;
+            float waste = area(a.getMerge(b)) - area(a) - area(b);
+            if (waste > worstWaste) {
+                worstWaste = waste;
+                seed1 = i;
+                seed2 = j;
+            }
+        }
+    }
+
+    std::vector<unsigned char> group(count, 0);
+    Rect bbox[2] = {entries[seed1].rect, entries[seed2].rect};
+    size_t size[2] = {1, 1};
+    group[seed1] = 1;
+    group[seed2] = 2;
+
+    for (size_t remaining = count - 2; remaining > 0; --remaining) {
+        int needy = needyGroup(size, remaining, minGroup);
+        if (needy >= 0) {
+            for (size_t i = 0; i < count; ++i) {
+                if (group[i] == 0) {
+                    group[i] = needy + 1;
+                }
+            }
+            break;
+        }
+
+        // Pick the child that cares most about which group it goes to
+        size_t next = count;
+        float strongest = -1;
+        for (size_t i = 0; i < count; ++i) {
+            if (group[i] != 0) {
+                continue;
+            }
+            float growth0 = area(bbox[0].getMerge(entries[i].rect)) - area(bbox[0]);
+            float growth1 = area(bbox[1].getMerge(entries[i].rect)) - area(bbox[1]);
+            float preference = std::abs(growth0 - growth1);
+            if (preference > strongest) {
+                strongest = preference;
+                next = i;
+            }
+        }
+
+        int g = preferredGroup(bbox, size, entries[next].rect);
+        group[next] = g + 1;
+        bbox[g] += entries[next].rect;
+        size[g] += 1;
+    }
+    return gatherFirstGroup(entries, group);
+}
+
+/**
+ * Reorders the children of an overflowing node into two groups.
+ *
+ * @param entries The children, including the one that overflowed the node.
+ * @param minGroup The fewest children either group may hold.
+ * @return The number of children in the first group.
+ */
+size_t RTreeRStarSplit::partition(std::vector<RTreeNode> &entries, size_t minGroup) {
+    size_t count = entries.size();
+
+    // The bounding boxes of every prefix and suffix of the sorted entries
+    std::vector<Rect> prefix(count);
+    std::vector<Rect> suffix(count);
+    auto sweep = [&]() {
+        prefix[0] = entries[0].rect;
+        for (size_t i = 1; i < count; ++i) {
+            prefix[i] = prefix[i - 1].getMerge(entries[i].rect);
+        }
+        suffix[count - 1] = entries[count - 1].rect;
+        for (size_t i = count - 1; i > 0; --i) {
+            suffix[i - 1] = suffix[i].getMerge(entries[i - 1].rect);
+        }
+    };
+    // Every sort starts from the same order and keeps ties in it, so the
+    // final sort reproduces the distribution that was scored
+    const std::vector<RTreeNode> original = entries;
+    auto sortBy = [&](int axis, bool upper) {
+        std::copy(original.begin(), original.end(), entries.begin());
+        std::stable_sort(entries.begin(), entries.end(),
+                  [axis, upper](const RTreeNode &a, const RTreeNode &b) {
+                      float ka = axis == 0 ? (upper ? a.rect.getMaxX() : a.rect.getMinX())
+                                           : (upper ? a.rect.getMaxY() : a.rect.getMinY());
+                      float kb = axis == 0 ? (upper ? b.rect.getMaxX() : b.rect.getMinX())
+                                           : (upper ? b.rect.getMaxY() : b.rect.getMinY());
+                      return ka < kb;
+                  });
+        sweep();
+    };
+
+    // Pick the axis whose distributions have the smallest total margin
+    int bestAxis = 0;
+    float bestMargin = std::numeric_limits<float>::infinity();
+    for (int axis = 0; axis < 2; ++axis) {
+        float margin = 0;
+        for (int upper = 0; upper < 2; ++upper) {
+            sortBy(axis, upper);
+            for (size_t k = minGroup; k <= count - minGroup; ++k) {
+                const Rect &first = prefix[k - 1];
+                const Rect &second = suffix[k];
+                margin += first.size.width + first.size.height +
+                          second.size.width + second.size.height;
+            }
+        }
+        if (margin < bestMargin) {
+            bestMargin = margin;
+            bestAxis = axis;
+        }
+    }
+
+    // Along that axis, pick the distribution with the least overlap
+    int bestUpper = 0;
+    size_t bestSplit = minGroup;
+    float bestOverlap = std::numeric_limits<float>::infinity();
+    float bestArea = std::numeric_limits<float>::infinity();
+    for (int upper = 0; upper < 2; ++upper) {
+        sortBy(bestAxis, upper);
+        for (size_t k = minGroup; k <= count - minGroup; ++k) {
+            float overlap = overlapArea(prefix[k - 1], suffix[k]);
+            float total = area(prefix[k - 1]) + area(suffix[k]);
+            if (overlap < bestOverlap || (overlap == bestOverlap && total < bestArea)) {
+                bestOverlap = overlap;
+                bestArea = total;
+                bestUpper = upper;
+                bestSplit = k;
+            }
+        }
+    }
+    sortBy(bestAxis, bestUpper);
+    return bestSplit;
+}
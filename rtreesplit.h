@@ -0,0 +1,74 @@
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include <cstddef>
+#include <vector>
+
+#include "rtreenode.h"
+
+/**
+ * Split policies for overflowing RTree nodes.
+ *
+ * Each policy reorders the children of an overflowing node so that the first
+ * group comes first, and returns the size of that group. Both groups hold at
+ * least minGroup children. Policies only see and move RTreeNodes, so a split
+ * allocates nothing beyond a few flags or bounding boxes per child.
+ */
+
+/**
+ * Guttman's linear split.
+ *
+ * The seeds are the pair of children farthest apart along either axis,
+ * relative to the extent of all children. The rest are assigned in order to
+ * the group whose bounding box grows least. Runs in O(n).
+ */
+struct RTreeLinearSplit {
+    /**
+     * Reorders the children of an overflowing node into two groups.
+     *
+     * @param entries The children, including the one that overflowed the node.
+     * @param minGroup The fewest children either group may hold.
+     * @return The number of children in the first group.
+     */
+    static size_t partition(std::vector<RTreeNode> &entries, size_t minGroup);
+};
+
+/**
+ * Guttman's quadratic split.
+ *
+ * The seeds are the pair of children that would waste the most area in one
+ * node. Each following child is the one with the strongest preference for one
+ * group, and goes to the group whose bounding box grows least. Runs in O(n²).
+ */
+struct RTreeQuadraticSplit {
+    /**
+     * Reorders the children of an overflowing node into two groups.
+     *
+     * @param entries The children, including the one that overflowed the node.
+     * @param minGroup The fewest children either group may hold.
+     * @return The number of children in the first group.
+     */
+    static size_t partition(std::vector<RTreeNode> &entries, size_t minGroup);
+};
+
+/**
+ * The sort-based split of the R*-tree.
+ *
+ * The children are sorted by their lower and upper bounds along each axis.
+ * The axis is the one where the sum of the margins of all allowed
+ * distributions is smallest, and along it the distribution with the least
+ * overlap between the groups is chosen, breaking ties by the least total area.
+ * Runs in O(n log n).
+ */
+struct RTreeRStarSplit {
+    /**
+     * Reorders the children of an overflowing node into two groups.
+     *
+     * @param entries The children, including the one that overflowed the node.
+     * @param minGroup The fewest children either group may hold.
+     * @return The number of children in the first group.
+     */
+    static size_t partition(std::vector<RTreeNode> &entries, size_t minGroup);
+};
+
+#endif
@@ -0,0 +1,573 @@
+#include "rtreetpr.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Returns the rect of this bound at a time.
+ *
+ * Before the reference time the lower sides move by the highest velocity and
+ * the upper sides by the lowest, which keeps the bound holding its children
+ * in both directions.
+ *
+ * @param dt The time since the reference time.
+ * @return The rect at that time.
+ */
+Rect RTreeTPR::Bound::at(float dt) const {
+    bool ahead = dt >= 0;
+    float x0 = minX + (ahead ? lowVX : highVX) * dt;
+    float y0 = minY + (ahead ? lowVY : highVY) * dt;
+    float x1 = maxX + (ahead ? highVX : lowVX) * dt;
+    float y1 = maxY + (ahead ? highVY : lowVY) * dt;
+    return Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+/**
+ * Grows this bound to hold another bound.
+ *
+ * @param other The bound to hold.
+ */
+void RTreeTPR::Bound::merge(const Bound &other) {
+    minX = std::min(minX, other.minX);
+    minY = std::min(minY, other.minY);
+    maxX = std::max(maxX, other.maxX);
+    maxY = std::max(maxY, other.maxY);
+    lowVX = std::min(lowVX, other.lowVX);
+    lowVY = std::min(lowVY, other.lowVY);
+    highVX = std::max(highVX, other.highVX);
+    highVY = std::max(highVY, other.highVY);
+}
+
+/**
+ * Returns whether this bound holds another bound at every time.
+ *
+ * @param other The bound to test.
+ * @return Whether other lies inside this bound.
+ */
+bool RTreeTPR::Bound::holds(const Bound &other) const {
+    return minX <= other.minX && minY <= other.minY &&
+           maxX >= other.maxX && maxY >= other.maxY &&
+           lowVX <= other.lowVX && lowVY <= other.lowVY &&
+           highVX >= other.highVX && highVY >= other.highVY;
+}
+
+/**
+ * Creates an empty TPR-tree.
+ *
+ * @param maxChildren The maximum number of children a node can have.
+ * @param minChildren The minimum number of children a node can have.
+ * @param horizon The length of time insertions optimize the tree for, about
+ * how long a trajectory is expected to last.
+ * @param time The initial reference time.
+ */
+RTreeTPR::RTreeTPR(unsigned int maxChildren, unsigned int minChildren,
+                   float horizon, float time)
+        : maxPerLevel(maxChildren),
+            minPerLevel(minChildren),
+            horizon(horizon),
+            refTime(time),
+            objectToMotion() {
+    root = allocate(0);
+}
+
+/**
+ * Resets to an empty tree.
+ */
+void RTreeTPR::clear() {
+    nodes.clear();
+    entries.clear();
+    freeNodes.clear();
+    objectToMotion.clear();
+    root = allocate(0);
+}
+
+/**
+ * Creates an empty node.
+ *
+ * @param level The level of the new node.
+ * @return The id of the new node.
+ */
+uint32_t RTreeTPR::allocate(int level) {
+    uint32_t id;
+    if (freeNodes.empty()) {
+        id = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        entries.resize(entries.size() + maxPerLevel + 1);
+    } else {
+        id = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    nodes[id].level = level;
+    nodes[id].count = 0;
+    return id;
+}
+
+/**
+ * Returns a node to the free list.
+ *
+ * @param id The id of the node.
+ */
+void RTreeTPR::release(uint32_t id) {
+    nodes[id].count = 0;
+    freeNodes.push_back(id);
+}
+
+/**
+ * Returns the bound of all entries of a node.
+ *
+ * @param id The id of the node.
+ * @return The bound of its entries.
+ */
+RTreeTPR::Bound RTreeTPR::boundOf(uint32_t id) const {
+    const Entry *children = entriesOf(id);
+    if (nodes[id].count == 0) {
+        return Bound();
+    }
+
+    Bound res = children[0].bound;
+    for (uint32_t i = 1; i < nodes[id].count; ++i) {
+        res.merge(children[i].bound);
+    }
+    return res;
+}
+
+/**
+ * Returns the area a bound sweeps over the horizon.
+ *
+ * @param b The bound.
+ * @param from The time the horizon starts at, relative to the reference time.
+ * @return The integral of its area over the horizon.
+ */
+float RTreeTPR::sweptArea(const Bound &b, float from) const {
+    Rect start = b.at(from);
+    float w = start.size.width;
+    float h = start.size.height;
+    if (horizon <= 0) {
+        return w * h;
+    }
+
+    // The sides move linearly, so the area is a quadratic in time
+    float dw = b.highVX - b.lowVX;
+    float dh = b.highVY - b.lowVY;
+    float t = horizon;
+    return w * h * t + (w * dh + h * dw) * t * t / 2 + dw * dh * t * t * t / 3;
+}
+
+/**
+ * Inserts the entry of an object into a subtree.
+ *
+ * @param id The root of the subtree.
+ * @param entry The entry to insert.
+ * @param from The time of the insertion, relative to the reference time.
+ * @param sibling Set to the entry of the new sibling if the node splits.
+ * @return Whether the node split.
+ */
+bool RTreeTPR::insertHelper(uint32_t id, const Entry &entry, float from,
+                            Entry &sibling) {
+    if (nodes[id].level == 0) {
+        entriesOf(id)[nodes[id].count++] = entry;
+        if (nodes[id].count > maxPerLevel) {
+            sibling = splitNode(id, from);
+            return true;
+        }
+        return false;
+    }
+
+    const Entry *children = entriesOf(id);
+    uint32_t best = 0;
+    float bestGrowth = std::numeric_limits<float>::max();
+    float bestArea = std::numeric_limits<float>::max();
+    for (uint32_t i = 0; i < nodes[id].count; ++i) {
+        Bound merged = children[i].bound;
+        merged.merge(entry.bound);
+        float area = sweptArea(children[i].bound, from);
+        float growth = sweptArea(merged, from) - area;
+        if (growth < bestGrowth || (growth == bestGrowth && area < bestArea)) {
+            best = i;
+            bestGrowth = growth;
+            bestArea = area;
+        }
+    }
+
+    uint32_t child = children[best].child;
+    Entry childSibling;
+    bool split = insertHelper(child, entry, from, childSibling);
+
+    // A split below may have grown the entries and moved them
+    Entry *updated = entriesOf(id);
+    if (!split) {
+        updated[best].bound.merge(entry.bound);
+        return false;
+    }
+
+    updated[best].bound = boundOf(child);
+    updated[nodes[id].count++] = childSibling;
+    if (nodes[id].count > maxPerLevel) {
+        sibling = splitNode(id, from);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Splits an overflowing node in two.
+ *
+ * The entries are sorted by their centers along each axis halfway through the
+ * horizon, and the distribution that sweeps the least total area over the
+ * horizon is chosen.
+ *
+ * @param id The node, holding maxPerLevel + 1 entries.
+ * @param from The time of the insertion, relative to the reference time.
+ * @return The entry of the new sibling.
+ */
+RTreeTPR::Entry RTreeTPR::splitNode(uint32_t id, float from) {
+    size_t count = nodes[id].count;
+    size_t minGroup = std::max<size_t>(1, std::min<size_t>(minPerLevel, count / 2));
+    float middle = from + horizon / 2;
+
+    std::vector<Entry> best;
+    size_t bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    std::vector<Entry> sorted(entriesOf(id), entriesOf(id) + count);
+    std::vector<Bound> suffix(count);
+    for (int axis = 0; axis < 2; ++axis) {
+        std::sort(sorted.begin(), sorted.end(), [&](const Entry &a, const Entry &b) {
+            Rect ra = a.bound.at(middle);
+            Rect rb = b.bound.at(middle);
+            return axis == 0 ? ra.getMidX() < rb.getMidX() : ra.getMidY() < rb.getMidY();
+        });
+
+        suffix[count - 1] = sorted[count - 1].bound;
+        for (size_t i = count - 1; i > 0; --i) {
+            suffix[i - 1] = suffix[i];
+            suffix[i - 1].merge(sorted[i - 1].bound);
+        }
+
+        Bound prefix = sorted[0].bound;
+        for (size_t k = 1; k <= count - minGroup; ++k) {
+            if (k >= minGroup) {
+                float cost = sweptArea(prefix, from) + sweptArea(suffix[k], from);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestSplit = k;
+                    best = sorted;
+                }
+            }
+            prefix.merge(sorted[k].bound);
+        }
+    }
+
+    uint32_t sibling = allocate(nodes[id].level);
+    std::copy(best.begin(), best.begin() + bestSplit, entriesOf(id));
+    std::copy(best.begin() + bestSplit, best.end(), entriesOf(sibling));
+    nodes[id].count = static_cast<uint32_t>(bestSplit);
+    nodes[sibling].count = static_cast<uint32_t>(count - bestSplit);
+
+    Entry res;
+    res.bound = boundOf(sibling);
+    res.child = sibling;
+    res.obj = nullptr;
+    return res;
+}
+
+/**
+ * Inserts the entry of an object, growing a new root if the root splits.
+ *
+ * @param entry The entry to insert.
+ * @param from The time of the insertion, relative to the reference time.
+ */
+void RTreeTPR::insertEntry(const Entry &entry, float from) {
+    Entry sibling;
+    if (insertHelper(root, entry, from, sibling)) {
+        uint32_t newRoot = allocate(nodes[root].level + 1);
+        Entry *children = entriesOf(newRoot);
+        children[0].bound = boundOf(root);
+        children[0].child = root;
+        children[0].obj = nullptr;
+        children[1] = sibling;
+        nodes[newRoot].count = 2;
+        root = newRoot;
+    }
+}
+
+/**
+ * Removes the entry of an object from a subtree.
+ *
+ * Nodes left with too few entries are released and the objects below them
+ * are added to a list to be reinserted.
+ *
+ * @param id The root of the subtree.
+ * @param obj The object to remove.
+ * @param bound The trajectory of the object.
+ * @param toReinsert Objects whose nodes were released.
+ * @return Whether the object was found.
+ */
+bool RTreeTPR::removeHelper(uint32_t id, const RTreeObject *obj, const Bound &bound,
+                            std::vector<RTreeObject *> &toReinsert) {
+    Node &n = nodes[id];
+    Entry *children = entriesOf(id);
+    if (n.level == 0) {
+        for (uint32_t i = 0; i < n.count; ++i) {
+            if (children[i].obj == obj) {
+                children[i] = children[--n.count];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    for (uint32_t i = 0; i < n.count; ++i) {
+        uint32_t child = children[i].child;
+        if (!children[i].bound.holds(bound) ||
+                !removeHelper(child, obj, bound, toReinsert)) {
+            continue;
+        }
+
+        if (nodes[child].count < minPerLevel) {
+            collectObjects(child, toReinsert);
+            children[i] = children[--n.count];
+        } else {
+            children[i].bound = boundOf(child);
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Adds every object of a subtree to a list and releases its nodes.
+ *
+ * @param id The root of the subtree.
+ * @param res The list to add to.
+ */
+void RTreeTPR::collectObjects(uint32_t id, std::vector<RTreeObject *> &res) {
+    const Entry *children = entriesOf(id);
+    for (uint32_t i = 0; i < nodes[id].count; ++i) {
+        if (nodes[id].level > 0) {
+            collectObjects(children[i].child, res);
+        } else {
+            res.push_back(children[i].obj);
+        }
+    }
+    release(id);
+}
+
+/**
+ * Moves every bound of a subtree to a new reference time and tightens it.
+ *
+ * @param id The root of the subtree.
+ * @param dt The new reference time relative to the old one.
+ * @return The tightened bound of the subtree.
+ */
+RTreeTPR::Bound RTreeTPR::advanceHelper(uint32_t id, float dt) {
+    Entry *children = entriesOf(id);
+    for (uint32_t i = 0; i < nodes[id].count; ++i) {
+        if (nodes[id].level > 0) {
+            children[i].bound = advanceHelper(children[i].child, dt);
+        } else {
+            children[i].bound = objectToMotion.find(children[i].obj)->second.bound;
+        }
+    }
+    return boundOf(id);
+}
+
+/**
+ * Inserts an object moving along a straight line.
+ *
+ * The rect of the object is read once, as its rect at the given time. The
+ * tree does not notice later changes to it.
+ *
+ * @param obj The object to insert.
+ * @param velocity The movement of the object per unit of time.
+ * @param time The time the rect of the object is at.
+ */
+void RTreeTPR::insert(std::shared_ptr<RTreeObject> obj, const Vec2 &velocity,
+                      float time) {
+    remove(obj);
+
+    // Store the rect the object had, or will have, at the reference time
+    float dt = time - refTime;
+    Motion motion;
+    motion.obj = obj;
+    motion.bound.minX = obj->rect.getMinX() - velocity.x * dt;
+    motion.bound.minY = obj->rect.getMinY() - velocity.y * dt;
+    motion.bound.maxX = obj->rect.getMaxX() - velocity.x * dt;
+    motion.bound.maxY = obj->rect.getMaxY() - velocity.y * dt;
+    motion.bound.lowVX = velocity.x;
+    motion.bound.lowVY = velocity.y;
+    motion.bound.highVX = velocity.x;
+    motion.bound.highVY = velocity.y;
+    objectToMotion[obj.get()] = motion;
+
+    Entry entry;
+    entry.bound = motion.bound;
+    entry.child = 0;
+    entry.obj = obj.get();
+    insertEntry(entry, dt);
+}
+
+/**
+ * Removes an object from the tree.
+ *
+ * @param obj The object to remove.
+ */
+void RTreeTPR::remove(std::shared_ptr<RTreeObject> obj) {
+    auto motion = objectToMotion.find(obj.get());
+    if (motion == objectToMotion.end()) {
+        return;
+    }
+
+    std::vector<RTreeObject *> toReinsert;
+    removeHelper(root, obj.get(), motion->second.bound, toReinsert);
+    objectToMotion.erase(motion);
+
+    // Collapse roots left with a single child, or none
+    while (nodes[root].level > 0 && nodes[root].count <= 1) {
+        uint32_t old = root;
+        if (nodes[old].count == 1) {
+            root = entriesOf(old)[0].child;
+        } else {
+            root = allocate(0);
+        }
+        release(old);
+    }
+
+    for (RTreeObject *other : toReinsert) {
+        Entry entry;
+        entry.bound = objectToMotion.find(other)->second.bound;
+        entry.child = 0;
+        entry.obj = other;
+        insertEntry(entry, 0);
+    }
+}
+
+/**
+ * Changes the trajectory of an object, for example when it bounces.
+ *
+ * @param obj An object in the tree.
+ * @param velocity The new movement of the object per unit of time.
+ * @param time The time the rect of the object is at.
+ */
+void RTreeTPR::setTrajectory(std::shared_ptr<RTreeObject> obj, const Vec2 &velocity,
+                             float time) {
+    if (objectToMotion.count(obj.get()) != 0) {
+        insert(obj, velocity, time);
+    }
+}
+
+/**
+ * Returns the rect of an object predicted from its trajectory.
+ *
+ * @param obj An object in the tree.
+ * @param time The time to predict the rect at.
+ * @return The predicted rect, or the rect of the object if it is not in the
+ * tree.
+ */
+Rect RTreeTPR::predictedRect(const std::shared_ptr<RTreeObject> &obj, float time) const {
+    auto motion = objectToMotion.find(obj.get());
+    if (motion == objectToMotion.end()) {
+        return obj->rect;
+    }
+    return motion->second.bound.at(time - refTime);
+}
+
+/**
+ * Returns all objects whose predicted rects meet a circle.
+ *
+ * @param center The center of the circle.
+ * @param radius The radius of the circle.
+ * @param time The time to search at.
+ * @return The objects whose predicted rects meet the circle.
+ */
+std::vector<std::shared_ptr<RTreeObject>> RTreeTPR::search(Vec2 center, float radius,
+                                                           float time) const {
+    std::vector<std::shared_ptr<RTreeObject>> res;
+    searchHelper(root, time - refTime, [&](const Rect &r) {
+        return r.doesIntersect(center, radius);
+    }, res);
+    return res;
+}
+
+/**
+ * Returns all objects whose predicted rects meet a rectangle.
+ *
+ * @param area The rectangle.
+ * @param time The time to search at.
+ * @return The objects whose predicted rects meet the rectangle.
+ */
+std::vector<std::shared_ptr<RTreeObject>> RTreeTPR::search(const Rect &area,
+                                                           float time) const {
+    std::vector<std::shared_ptr<RTreeObject>> res;
+    searchHelper(root, time - refTime, [&](const Rect &r) {
+        return r.doesIntersect(area);
+    }, res);
+    return res;
+}
+
+/**
+ * Moves the reference time of the tree and tightens every bound for it.
+ *
+ * Searches near the reference time prune best, so this should be called about
+ * once per horizon as time passes. Runs in time linear in the size of the tree.
+ *
+ * @param time The new reference time.
+ */
+void RTreeTPR::advance(float time) {
+    float dt = time - refTime;
+    for (auto it = objectToMotion.begin(); it != objectToMotion.end(); ++it) {
+        Bound &b = it->second.bound;
+        Rect moved = b.at(dt);
+        b.minX = moved.getMinX();
+        b.minY = moved.getMinY();
+        b.maxX = moved.getMaxX();
+        b.maxY = moved.getMaxY();
+    }
+    refTime = time;
+    advanceHelper(root, dt);
+}
+
+/**
+ * Appends a string representation of a subtree to a string.
+ *
+ * @param id The root of the subtree.
+ * @param height The height of the tree.
+ * @param res The string to append to.
+ */
+void RTreeTPR::printNode(uint32_t id, int height, std::string &res) const {
+    std::string indentation = "";
+    for (int i = 0; i < height - nodes[id].level; ++i) {
+        indentation += " ";
+    }
+
+    const Entry *children = entriesOf(id);
+    for (uint32_t i = 0; i < nodes[id].count; ++i) {
+        const Bound &b = children[i].bound;
+        res += indentation + "[(" + std::to_string(b.minX) + ", " +
+               std::to_string(b.minY) + "), (" + std::to_string(b.maxX) + ", " +
+               std::to_string(b.maxY) + ")] v[(" + std::to_string(b.lowVX) + ", " +
+               std::to_string(b.lowVY) + "), (" + std::to_string(b.highVX) + ", " +
+               std::to_string(b.highVY) + ")]\n";
+        if (nodes[id].level > 0) {
+            printNode(children[i].child, height, res);
+        }
+    }
+}
+
+/**
+ * Returns a string representation of this tree at its reference time.
+ *
+ * @return std::string
+ */
+std::string RTreeTPR::print() const {
+    std::string res = "";
+    printNode(root, nodes[root].level, res);
+    return res;
+}
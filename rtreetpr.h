@@ -0,0 +1,385 @@
+#ifndef TPR_H
+#define TPR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rtreegeometry.h"
+#include "rtreeobject.h"
+
+/**
+ * Time-parameterized R-tree (TPR-tree) of objects moving along straight lines.
+ *
+ * Each object is indexed by its trajectory, that is its rect at some time and
+ * its velocity, so the tree only changes when a trajectory changes and not
+ * when an object moves along it. Every entry stores a bound that is a rect at
+ * the reference time of the tree together with the lowest and highest
+ * velocity along each axis, so the bound at any other time can be computed and
+ * grows just enough to hold its children at that time. Searches take the time
+ * to search at and test the predicted rects of the objects, not their rects.
+ *
+ * Bounds grow looser the further a search is from the reference time, so
+ * advance() should be called every so often to move the reference time and
+ * tighten every bound. Insertions choose subtrees and split nodes by the area
+ * their bounds sweep over the horizon following the insertion.
+ */
+class RTreeTPR {
+public:
+    /** A rect at the reference time of the tree and the velocities it grows by. */
+    struct Bound {
+        /** The rect at the reference time. */
+        float minX, minY, maxX, maxY;
+        /** The lowest and highest velocity of the lower and upper sides. */
+        float lowVX, lowVY, highVX, highVY;
+
+        /**
+         * Returns the rect of this bound at a time.
+         *
+         * Before the reference time the lower sides move by the highest
+         * velocity and the upper sides by the lowest, which keeps the bound
+         * holding its children in both directions.
+         *
+         * @param dt The time since the reference time.
+         * @return The rect at that time.
+         */
+        Rect at(float dt) const;
+
+        /**
+         * Grows this bound to hold another bound.
+         *
+         * @param other The bound to hold.
+         */
+        void merge(const Bound &other);
+
+        /**
+         * Returns whether this bound holds another bound at every time.
+         *
+         * @param other The bound to test.
+         * @return Whether other lies inside this bound.
+         */
+        bool holds(const Bound &other) const;
+    };
+
+private:
+    /** An entry of a node, holding either a child node or an object. */
+    struct Entry {
+        /** The bound of the child or the trajectory of the object. */
+        Bound bound;
+        /** The index of the child node, if the node is an inner node. */
+        uint32_t child;
+        /** The object, if the node is a leaf node. */
+        RTreeObject *obj;
+    };
+
+    /** A node, whose entries are stored in its block of entries. */
+    struct Node {
+        /** The level of this node. Leaf nodes holding objects have a level of 0. */
+        int level;
+        /** The number of entries of this node. */
+        uint32_t count;
+    };
+
+    /** The bookkeeping for an object in the tree. */
+    struct Motion {
+        /** The object, kept alive while it is in the tree. */
+        std::shared_ptr<RTreeObject> obj;
+        /** The trajectory of the object. */
+        Bound bound;
+    };
+
+    /** Maximum number of children for each node. */
+    unsigned int maxPerLevel;
+
+    /** Minimum number of children for each node. */
+    unsigned int minPerLevel;
+
+    /** The length of time insertions optimize the tree for. */
+    float horizon;
+
+    /** The time that bounds are stored at. */
+    float refTime;
+
+    /** The nodes, indexed by id. */
+    std::vector<Node> nodes;
+
+    /**
+     * The entries of every node, in blocks of maxPerLevel + 1 per node id, so
+     * that a node can hold one extra entry while it is being split.
+     */
+    std::vector<Entry> entries;
+
+    /** The ids of released nodes, reused before the node vector grows. */
+    std::vector<uint32_t> freeNodes;
+
+    /** The id of the root node. */
+    uint32_t root;
+
+    /** Map with objects as keys and their trajectories as values. */
+    std::unordered_map<const RTreeObject *, Motion> objectToMotion;
+
+    /**
+     * Returns the first entry of a node.
+     *
+     * @param id The id of the node.
+     * @return A pointer to the block of entries of the node.
+     */
+    Entry *entriesOf(uint32_t id) { return &entries[id * (maxPerLevel + 1)]; }
+
+    /**
+     * Returns the first entry of a node.
+     *
+     * @param id The id of the node.
+     * @return A pointer to the block of entries of the node.
+     */
+    const Entry *entriesOf(uint32_t id) const { return &entries[id * (maxPerLevel + 1)]; }
+
+    /**
+     * Creates an empty node.
+     *
+     * @param level The level of the new node.
+     * @return The id of the new node.
+     */
+    uint32_t allocate(int level);
+
+    /**
+     * Returns a node to the free list.
+     *
+     * @param id The id of the node.
+     */
+    void release(uint32_t id);
+
+    /**
+     * Returns the bound of all entries of a node.
+     *
+     * @param id The id of the node.
+     * @return The bound of its entries.
+     */
+    Bound boundOf(uint32_t id) const;
+
+    /**
+     * Returns the area a bound sweeps over the horizon.
+     *
+     * @param b The bound.
+     * @param from The time the horizon starts at, relative to the reference time.
+     * @return The integral of its area over the horizon.
+     */
+    float sweptArea(const Bound &b, float from) const;
+
+    /**
+     * Inserts the entry of an object into a subtree.
+     *
+     * @param id The root of the subtree.
+     * @param entry The entry to insert.
+     * @param from The time of the insertion, relative to the reference time.
+     * @param sibling Set to the entry of the new sibling if the node splits.
+     * @return Whether the node split.
+     */
+    bool insertHelper(uint32_t id, const Entry &entry, float from, Entry &sibling);
+
+    /**
+     * Splits an overflowing node in two.
+     *
+     * The entries are sorted by their centers along each axis halfway through
+     * the horizon, and the distribution that sweeps the least total area over
+     * the horizon is chosen.
+     *
+     * @param id The node, holding maxPerLevel + 1 entries.
+     * @param from The time of the insertion, relative to the reference time.
+     * @return The entry of the new sibling.
+     */
+    Entry splitNode(uint32_t id, float from);
+
+    /**
+     * Inserts the entry of an object, growing a new root if the root splits.
+     *
+     * @param entry The entry to insert.
+     * @param from The time of the insertion, relative to the reference time.
+     */
+    void insertEntry(const Entry &entry, float from);
+
+    /**
+     * Removes the entry of an object from a subtree.
+     *
+     * Nodes left with too few entries are released and the objects below
+     * them are added to a list to be reinserted.
+     *
+     * @param id The root of the subtree.
+     * @param obj The object to remove.
+     * @param bound The trajectory of the object.
+     * @param toReinsert Objects whose nodes were released.
+     * @return Whether the object was found.
+     */
+    bool removeHelper(uint32_t id, const RTreeObject *obj, const Bound &bound,
+                      std::vector<RTreeObject *> &toReinsert);
+
+    /**
+     * Adds every object of a subtree to a list and releases its nodes.
+     *
+     * @param id The root of the subtree.
+     * @param res The list to add to.
+     */
+    void collectObjects(uint32_t id, std::vector<RTreeObject *> &res);
+
+    /**
+     * Moves every bound of a subtree to a new reference time and tightens it.
+     *
+     * @param id The root of the subtree.
+     * @param dt The new reference time relative to the old one.
+     * @return The tightened bound of the subtree.
+     */
+    Bound advanceHelper(uint32_t id, float dt);
+
+    /**
+     * Adds the objects of a subtree whose predicted rects meet a shape.
+     *
+     * @param id The root of the subtree.
+     * @param dt The time to search at, relative to the reference time.
+     * @param hit Whether a rect meets the shape.
+     * @param res The list to add to.
+     */
+    template <typename Hit>
+    void searchHelper(uint32_t id, float dt, const Hit &hit,
+                      std::vector<std::shared_ptr<RTreeObject>> &res) const;
+
+    /**
+     * Appends a string representation of a subtree to a string.
+     *
+     * @param id The root of the subtree.
+     * @param height The height of the tree.
+     * @param res The string to append to.
+     */
+    void printNode(uint32_t id, int height, std::string &res) const;
+
+public:
+    /**
+     * Creates an empty TPR-tree.
+     *
+     * @param maxChildren The maximum number of children a node can have.
+     * @param minChildren The minimum number of children a node can have.
+     * @param horizon The length of time insertions optimize the tree for,
+     * about how long a trajectory is expected to last.
+     * @param time The initial reference time.
+     */
+    RTreeTPR(unsigned int maxChildren, unsigned int minChildren, float horizon,
+             float time = 0);
+
+    /**
+     * Resets to an empty tree.
+     */
+    void clear();
+
+    /**
+     * Returns the number of objects in the tree.
+     *
+     * @return The number of objects.
+     */
+    size_t size() const { return objectToMotion.size(); }
+
+    /**
+     * Inserts an object moving along a straight line.
+     *
+     * The rect of the object is read once, as its rect at the given time. The
+     * tree does not notice later changes to it.
+     *
+     * @param obj The object to insert.
+     * @param velocity The movement of the object per unit of time.
+     * @param time The time the rect of the object is at.
+     */
+    void insert(std::shared_ptr<RTreeObject> obj, const Vec2 &velocity, float time);
+
+    /**
+     * Removes an object from the tree.
+     *
+     * @param obj The object to remove.
+     */
+    void remove(std::shared_ptr<RTreeObject> obj);
+
+    /**
+     * Changes the trajectory of an object, for example when it bounces.
+     *
+     * @param obj An object in the tree.
+     * @param velocity The new movement of the object per unit of time.
+     * @param time The time the rect of the object is at.
+     */
+    void setTrajectory(std::shared_ptr<RTreeObject> obj, const Vec2 &velocity,
+                       float time);
+
+    /**
+     * Returns the rect of an object predicted from its trajectory.
+     *
+     * @param obj An object in the tree.
+     * @param time The time to predict the rect at.
+     * @return The predicted rect, or the rect of the object if it is not in
+     * the tree.
+     */
+    Rect predictedRect(const std::shared_ptr<RTreeObject> &obj, float time) const;
+
+    /**
+     * Returns all objects whose predicted rects meet a circle.
+     *
+     * @param center The center of the circle.
+     * @param radius The radius of the circle.
+     * @param time The time to search at.
+     * @return The objects whose predicted rects meet the circle.
+     */
+    std::vector<std::shared_ptr<RTreeObject>> search(Vec2 center, float radius,
+                                                     float time) const;
+
+    /**
+     * Returns all objects whose predicted rects meet a rectangle.
+     *
+     * @param area The rectangle.
+     * @param time The time to search at.
+     * @return The objects whose predicted rects meet the rectangle.
+     */
+    std::vector<std::shared_ptr<RTreeObject>> search(const Rect &area, float time) const;
+
+    /**
+     * Moves the reference time of the tree and tightens every bound for it.
+     *
+     * Searches near the reference time prune best, so this should be called
+     * about once per horizon as time passes. Runs in time linear in the size
+     * of the tree.
+     *
+     * @param time The new reference time.
+     */
+    void advance(float time);
+
+    /**
+     * Returns the reference time of the tree.
+     *
+     * @return The time that bounds are stored at.
+     */
+    float getReferenceTime() const { return refTime; }
+
+    /**
+     * Returns a string representation of this tree at its reference time.
+     *
+     * @return std::string
+     */
+    std::string print() const;
+};
+
+template <typename Hit>
+void RTreeTPR::searchHelper(uint32_t id, float dt, const Hit &hit,
+                            std::vector<std::shared_ptr<RTreeObject>> &res) const {
+    const Node &n = nodes[id];
+    const Entry *children = entriesOf(id);
+    for (uint32_t i = 0; i < n.count; ++i) {
+        if (!hit(children[i].bound.at(dt))) {
+            continue;
+        }
+        // The bound of an object is its trajectory, so no exact test is left
+        if (n.level > 0) {
+            searchHelper(children[i].child, dt, hit, res);
+        } else {
+            res.push_back(children[i].obj->shared_from_this());
+        }
+    }
+}
+
+#endif